@@ -0,0 +1,98 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.hpp"
+
+#ifdef DEBUG_ALLOCATIONS
+
+/* allocations of the calling thread */
+static thread_local long thread_count = 0;
+
+/*
+Replacements of the global allocation functions, which count the allocations
+of the calling thread.
+*/
+void* operator new(std::size_t size) {
+    thread_count++;
+    if(void* const p = std::malloc(size>0 ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    thread_count++;
+    return std::malloc(size>0 ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+#endif
+
+/*
+Returns true when the program counts the allocations.
+*/
+bool AllocationCounter::is_enabled() {
+    #ifdef DEBUG_ALLOCATIONS
+        return true;
+    #else
+        return false;
+    #endif
+}
+
+/*
+Returns the number of allocations made by the calling thread since it
+started.
+*/
+long AllocationCounter::get_thread_count() {
+    #ifdef DEBUG_ALLOCATIONS
+        return thread_count;
+    #else
+        return 0;
+    #endif
+}
+
+/*
+Counts an allocation made by the calling thread without operator new.
+*/
+void AllocationCounter::count_allocation() {
+    #ifdef DEBUG_ALLOCATIONS
+        thread_count++;
+    #endif
+}
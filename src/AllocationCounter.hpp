@@ -0,0 +1,53 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+This class counts the allocations made on the heap by every thread. It is a
+debugging tool, used to check that the training threads make no allocation
+once their first batch is done (see TrainingWorkspace in FNN.hpp):
+
+    const long before = AllocationCounter::get_thread_count();
+    ...                                   // code that should not allocate
+    const long count  = AllocationCounter::get_thread_count() - before;
+
+Counting replaces the global operator new, so it is only enabled when the
+program is built with make linux DEBUG_ALLOCATIONS=1. The allocations of
+the aligned memory of the matrices and of the buffers of the kernels, which
+do not go through operator new, are counted by SIMD::aligned_alloc. When
+counting is disabled, is_enabled returns false and the counts stay 0.
+*/
+
+#ifndef AllocationCounter_hpp
+#define AllocationCounter_hpp
+
+class AllocationCounter {
+
+    public:
+
+        static bool is_enabled();
+        static long get_thread_count();
+        static void count_allocation();
+
+};
+
+#endif
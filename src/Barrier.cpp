@@ -0,0 +1,50 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Barrier.hpp"
+
+/*
+Creates a barrier for p_nb_threads threads.
+*/
+Barrier::Barrier(const int p_nb_threads) :
+    nb_threads(p_nb_threads),
+    waiting(0),
+    generation(0) {
+}
+
+/*
+Waits until all the threads reached the barrier. The last thread releases
+the others and starts a new generation, so that a thread which quickly
+comes back to the barrier waits for the next release.
+*/
+void Barrier::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    const long current = generation;
+    if(++waiting==nb_threads) {
+        waiting = 0;
+        generation++;
+        released.notify_all();
+        return;
+    }
+    released.wait(lock, [&] { return generation!=current; });
+}
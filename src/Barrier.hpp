@@ -0,0 +1,66 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+This class defines a barrier: a point of a loop that a fixed number of
+threads must all reach before any of them continues. It is reusable, so the
+threads of the synchronous training meet at the same barrier twice per
+batch: once the gradients of their shards are computed, and once the
+parameters are updated.
+
+    Barrier barrier(4);
+    ...                                   // in each of the 4 threads
+    barrier.wait();                       // returns when the 4 threads are here
+
+The threads waiting at the barrier sleep on a condition variable rather than
+spin, so that a machine with fewer cores than threads is not slowed down.
+*/
+
+#ifndef Barrier_hpp
+#define Barrier_hpp
+
+#include <condition_variable>
+#include <mutex>
+
+class Barrier {
+
+    public:
+
+        Barrier(const int);
+
+        void wait();
+
+    private:
+
+        Barrier(const Barrier&);
+        Barrier& operator=(const Barrier&);
+
+        std::mutex              mutex;        /* protects the state of the barrier */
+        std::condition_variable released;     /* all the threads reached the barrier */
+        const int               nb_threads;   /* number of threads meeting at the barrier */
+        int                     waiting;      /* threads waiting at the barrier */
+        long                    generation;   /* number of times the barrier was released */
+
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+#include "Benchmark.hpp"
+#include "Blas.hpp"
+#include "DigitScanner.hpp"
+#include "Matrix.hpp"
+#include "ThreadPool.hpp"
+
+constexpr double Benchmark::min_time;
+constexpr int    Benchmark::averaging_periods[];
+
+/*
+Runs the products with every engine available and prints their speed. The
+engine selected before is selected again at the end.
+*/
+void Benchmark::products() {
+    const Blas::Engine engine = Blas::get_engine();
+    std::vector<Blas::Engine> engines = {Blas::engine_builtin};
+    if(Blas::is_available()) engines.push_back(Blas::engine_cblas);
+    /* operands, filled with small values */
+    Matrix<float> W(100, 784);                      W.fill(0.01f);
+    Matrix<float> Wc(784, 100);  Wc.self_transpose(); Wc.fill(0.01f);
+    Matrix<float> x(784, 1);                        x.fill(0.5f);
+    Matrix<float> y(100, 1);                        y.fill(0);
+    Matrix<float> NW(100, 784);                     NW.fill(0);
+    Matrix<float> X(784, 10);                       X.fill(0.5f);
+    Matrix<float> Y(100, 10);                       Y.fill(0);
+    Matrix<float> W8(800, 784);                     W8.fill(0.01f);
+    Matrix<float> X8(784, 100);                     X8.fill(0.5f);
+    Matrix<float> Y8(800, 100);                     Y8.fill(0);
+    struct Product {
+        std::string           name;
+        double                flops;
+        std::function<void()> run;
+    };
+    const std::vector<Product> list = {
+        {"gemv     100x784       W*x",           2.0*100*784,     [&]() { y.gemm(1, W, false, x, false, 0); }},
+        {"gemv     100x784       W*x, by cols",  2.0*100*784,     [&]() { y.gemm(1, Wc, false, x, false, 0); }},
+        {"gemv     784x100       W^t*y",         2.0*100*784,     [&]() { x.gemm(1, W, true, y, false, 0); }},
+        {"ger      100x784       NW += y*x^t",   2.0*100*784,     [&]() { NW.ger(1, y, x); }},
+        {"gemm     100x784x10    W*X",           2.0*100*784*10,  [&]() { Y.gemm(1, W, false, X, false, 0); }},
+        {"gemm     100x10x784    NW += Y*X^t",   2.0*100*784*10,  [&]() { NW.gemm(1, Y, false, X, true, 1); }},
+        {"gemm     800x784x100   W*X",           2.0*800*784*100, [&]() { Y8.gemm(1, W8, false, X8, false, 0); }}
+    };
+    /* header */
+    std::cerr << "matrix products in float, " << ThreadPool::get_nb_threads() << " thread(s) per product, GFLOP/s:" << std::endl;
+    std::cerr << "    " << std::left << std::setw(40) << "product";
+    for(const Blas::Engine e : engines) std::cerr << std::right << std::setw(12) << Blas::get_engine_name(e);
+    std::cerr << std::endl;
+    /* one line per product */
+    for(const Product& product : list) {
+        std::cerr << "    " << std::left << std::setw(40) << product.name << std::right << std::fixed << std::setprecision(2);
+        for(const Blas::Engine e : engines) {
+            Blas::select_engine(e);
+            std::cerr << std::setw(12) << gflops(product.flops, product.run) << std::flush;
+        }
+        std::cerr << std::endl;
+    }
+    std::cerr.unsetf(std::ios_base::floatfield);
+    Blas::select_engine(engine);
+}
+
+/*
+Trains a network with the given layers on the training set, with a single
+thread, then with 2, 4, 8... up to max_threads threads in every parallelism
+mode, and prints the speed of every training and the accuracy of the
+network on the whole testing set. Local SGD is run once per period of
+averaging_periods, then with the adaptive period starting from
+averaging_period, so that the periods can be compared from the same runs.
+Every training starts from the same initial weights, and the training set
+is shuffled from the same seed. The synchronous mode needs at least one
+picture of every batch per thread.
+*/
+void Benchmark::training(const std::string& path_data, const std::vector<int>& layers, const int nb_images, const int nb_images_to_skip, const int nb_epochs, const int batch_len, const double eta, const double alpha, const int max_threads, const int averaging_period, const unsigned int seed) {
+    typedef DigitScanner<float> Scanner;
+    struct Run {
+        std::string mode;
+        int         nb_threads;
+        double      speed;      /* pictures trained per second */
+        double      accuracy;   /* percentage of the testing set correctly classified */
+    };
+    std::vector<Run> runs;
+    std::vector<int> threads;
+    for(int n=1 ; n<max_threads ; n*=2) threads.push_back(n);
+    threads.push_back(max_threads);
+    /* periods of local SGD, the adaptive one last */
+    std::vector<std::pair<int, bool>> averagings;
+    for(const int period : averaging_periods) averagings.push_back(std::make_pair(period, false));
+    averagings.push_back(std::make_pair(averaging_period, true));
+    const auto train = [&](const std::string& mode, const int nb_threads, const Scanner::Parallelism parallelism, const int period, const bool adaptive) {
+        std::cerr << "training benchmark: " << mode << ", " << nb_threads << " thread(s)" << std::endl;
+        srand(seed);
+        Scanner dgs(layers);
+        dgs.set_parallelism(parallelism);
+        dgs.set_averaging(period, adaptive);
+        const double time    = dgs.train(path_data, nb_images, nb_images_to_skip, nb_epochs, batch_len, eta, alpha, nb_threads);
+        const int    correct = dgs.test(path_data, 10000, 0, 1);
+        runs.push_back(Run{mode, nb_threads, static_cast<double>(nb_images)*nb_epochs/time, correct/100.0});
+    };
+    for(const int nb_threads : threads) {
+        /* with one thread, every mode is the single-thread training */
+        if(nb_threads==1) {
+            train("single", nb_threads, Scanner::parallel_hogwild, averaging_period, false);
+            continue;
+        }
+        train("hogwild", nb_threads, Scanner::parallel_hogwild, averaging_period, false);
+        if(nb_threads<=batch_len) train("sync", nb_threads, Scanner::parallel_sync, averaging_period, false);
+        for(const std::pair<int, bool>& averaging : averagings) {
+            const std::string mode = "local " + std::string(averaging.second ? "K<=" : "K=") + std::to_string(averaging.first);
+            train(mode, nb_threads, Scanner::parallel_local, averaging.first, averaging.second);
+        }
+    }
+    /* summary */
+    std::cerr << "training on " << nb_images << " pictures, " << nb_epochs << " epoch(s), batches of " << batch_len << ", " << ThreadPool::get_nb_threads() << " thread(s) per product:" << std::endl;
+    std::cerr << "    " << std::left << std::setw(16) << "mode" << std::right << std::setw(10) << "threads" << std::setw(16) << "pictures/s" << std::setw(12) << "speedup" << std::setw(14) << "accuracy %" << std::endl;
+    for(const Run& run : runs) {
+        std::cerr << "    " << std::left << std::setw(16) << run.mode << std::right << std::setw(10) << run.nb_threads << std::fixed << std::setprecision(0) << std::setw(16) << run.speed;
+        std::cerr << std::setprecision(2) << std::setw(12) << run.speed/runs.front().speed << std::setw(14) << run.accuracy << std::endl;
+    }
+    std::cerr.unsetf(std::ios_base::floatfield);
+}
+
+/*
+Speed of a product of the given number of floating point operations, in
+GFLOP/s. The product is run once to warm up the caches, then repeated until
+min_time seconds have elapsed.
+*/
+double Benchmark::gflops(const double flops, const std::function<void()>& product) {
+    typedef std::chrono::high_resolution_clock clock;
+    product();
+    long                    n     = 0;
+    const clock::time_point begin = clock::now();
+    double                  time  = 0;
+    do {
+        for(int i=0 ; i<10 ; i++) product();
+        n   += 10;
+        time = std::chrono::duration<double>(clock::now() - begin).count();
+    } while(time<min_time);
+    return n*flops/time*1e-9;
+}
@@ -0,0 +1,69 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines the benchmarks of the engines computing the matrix
+products. Every product is run with the built-in engine, then with the BLAS
+library when the program was built with one (see Blas.hpp), and its speed
+is printed in GFLOP/s for both:
+
+        bin/digitscanner --bench --opthreads 4
+
+The products are the ones of the 784-100-50-10 network and of a larger
+network, in float: the matrix-vector products and rank-1 updates of the
+training on one picture at a time, and the general products of a batch of
+pictures. Every product is repeated for at least min_time seconds.
+
+The training is also benchmarked: a network is trained on the MNIST dataset
+with a single thread, then with 2, 4, 8... threads up to a maximum in the
+hogwild, synchronous and local SGD modes (see DigitScanner::train), local
+SGD with several periods of averaging. The speed of every training, in
+pictures per second, and the accuracy of the network on the testing set are
+printed side by side:
+
+        bin/digitscanner --benchtrain 32 --hlayers 100 50 --train 60000 0 1 10 --mnist mnist_data
+*/
+
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class Benchmark {
+
+    public:
+
+        static void products();
+        static void training(const std::string&, const std::vector<int>&, const int, const int, const int, const int, const double, const double, const int, const int, const unsigned int);
+
+    private:
+
+        static constexpr double min_time            = 0.2;              /* seconds per product and engine */
+        static constexpr int    averaging_periods[] = {1, 4, 16, 64};   /* batches between two averagings of local SGD */
+
+        static double gflops(const double, const std::function<void()>&);
+
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Blas.hpp"
+
+#if defined(BLAS_OPENBLAS)
+    #include <cblas.h>
+    #define BLAS_LIBRARY "OpenBLAS"
+    extern "C" void openblas_set_num_threads(int);
+#elif defined(BLAS_BLIS)
+    #include <blis/cblas.h>
+    #define BLAS_LIBRARY "BLIS"
+    extern "C" void bli_thread_set_num_threads(long);
+#elif defined(BLAS_CBLAS)
+    #include <cblas.h>
+    #define BLAS_LIBRARY "CBLAS"
+#endif
+
+#ifdef BLAS_LIBRARY
+    #define BLAS_AVAILABLE
+#endif
+
+/*
+Engine in use, CBLAS when available.
+*/
+Blas::Engine& Blas::engine() {
+#ifdef BLAS_AVAILABLE
+    static Engine e = engine_cblas;
+#else
+    static Engine e = engine_builtin;
+#endif
+    return e;
+}
+
+/*
+Tells whether the program was built with a BLAS library, and which one.
+*/
+bool Blas::is_available() {
+#ifdef BLAS_AVAILABLE
+    return true;
+#else
+    return false;
+#endif
+}
+std::string Blas::get_library() {
+#ifdef BLAS_AVAILABLE
+    return BLAS_LIBRARY;
+#else
+    return "none";
+#endif
+}
+
+/*
+Selects the engine. CBLAS can only be selected when it is available.
+*/
+void Blas::select_engine(const Engine e) {
+    engine() = is_available() ? e : engine_builtin;
+}
+
+/*
+Name of the engine.
+*/
+std::string Blas::get_engine_name(const Engine e) {
+    return e==engine_cblas ? get_library() : "built-in";
+}
+
+/*
+Sets the number of threads of the library.
+*/
+void Blas::set_nb_threads(const int n) {
+#if defined(BLAS_OPENBLAS)
+    openblas_set_num_threads(n);
+#elif defined(BLAS_BLIS)
+    bli_thread_set_num_threads(n);
+#else
+    (void)n;
+#endif
+}
+
+#ifdef BLAS_AVAILABLE
+
+/*
+Products computed with CBLAS, in row-major order. op(A) has M rows and K
+columns, so A is stored with K columns, or M when it is transposed.
+*/
+bool Blas::gemm(const bool transA, const bool transB, const int M, const int N, const int K, const float alpha, const float* const A, const int lda, const float* const B, const int ldb, const float beta, float* const C, const int ldc) {
+    if(engine()!=engine_cblas) return false;
+    cblas_sgemm(CblasRowMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+    return true;
+}
+bool Blas::gemm(const bool transA, const bool transB, const int M, const int N, const int K, const double alpha, const double* const A, const int lda, const double* const B, const int ldb, const double beta, double* const C, const int ldc) {
+    if(engine()!=engine_cblas) return false;
+    cblas_dgemm(CblasRowMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+    return true;
+}
+bool Blas::gemv(const bool transA, const int M, const int K, const float alpha, const float* const A, const int lda, const float* const x, const int incx, const float beta, float* const y, const int incy) {
+    if(engine()!=engine_cblas) return false;
+    cblas_sgemv(CblasRowMajor, transA ? CblasTrans : CblasNoTrans, transA ? K : M, transA ? M : K, alpha, A, lda, x, incx, beta, y, incy);
+    return true;
+}
+bool Blas::gemv(const bool transA, const int M, const int K, const double alpha, const double* const A, const int lda, const double* const x, const int incx, const double beta, double* const y, const int incy) {
+    if(engine()!=engine_cblas) return false;
+    cblas_dgemv(CblasRowMajor, transA ? CblasTrans : CblasNoTrans, transA ? K : M, transA ? M : K, alpha, A, lda, x, incx, beta, y, incy);
+    return true;
+}
+
+/*
+Rank-1 updates C = alpha*x*y^t + C, CBLAS has no scaling of C.
+*/
+bool Blas::ger(const int M, const int N, const float alpha, const float* const x, const int incx, const float* const y, const int incy, const float beta, float* const C, const int ldc) {
+    if(engine()!=engine_cblas || beta!=1) return false;
+    cblas_sger(CblasRowMajor, M, N, alpha, x, incx, y, incy, C, ldc);
+    return true;
+}
+bool Blas::ger(const int M, const int N, const double alpha, const double* const x, const int incx, const double* const y, const int incy, const double beta, double* const C, const int ldc) {
+    if(engine()!=engine_cblas || beta!=1) return false;
+    cblas_dger(CblasRowMajor, M, N, alpha, x, incx, y, incy, C, ldc);
+    return true;
+}
+
+#else
+
+/*
+Without BLAS, everything is computed by the built-in engine.
+*/
+bool Blas::gemm(const bool, const bool, const int, const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int)         { return false; }
+bool Blas::gemm(const bool, const bool, const int, const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int)     { return false; }
+bool Blas::gemv(const bool, const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int)                                { return false; }
+bool Blas::gemv(const bool, const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int)                            { return false; }
+bool Blas::ger(const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int)                                             { return false; }
+bool Blas::ger(const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int)                                         { return false; }
+
+#endif
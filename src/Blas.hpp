@@ -0,0 +1,86 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class routes the products of the gemm engine (see Gemm.hpp) to an
+external BLAS library through its C interface, CBLAS, for float and double.
+The library is chosen when building:
+
+        make linux BLAS=openblas       OpenBLAS
+        make linux BLAS=blis           BLIS
+        make linux BLAS=cblas          any other library providing CBLAS
+
+Without BLAS, the built-in engine is the only one. With it, the engine is
+selected at startup, CBLAS by default, and can be changed at any time:
+
+        Blas::select_engine(Blas::engine_builtin);
+
+The general products, matrix-vector products and rank-1 updates of the
+engine are routed: the functions below compute them with CBLAS and return
+true, or return false when they are left to the built-in engine (built-in
+engine selected, other type than float or double, or rank-1 update with a
+scaling of C). The products with the weights in 16 bits and the kernels of
+the networks with a fixed topology always use the built-in code.
+
+The library uses its own threads, their number is set with set_nb_threads
+for OpenBLAS and BLIS.
+*/
+
+#ifndef Blas_hpp
+#define Blas_hpp
+
+#include <string>
+
+class Blas {
+
+    public:
+
+        enum Engine {engine_builtin, engine_cblas};
+
+        static bool        is_available();
+        static std::string get_library();
+        static Engine      get_engine()                { return engine(); }
+        static void        select_engine(const Engine);
+        static std::string get_engine_name(const Engine);
+        static void        set_nb_threads(const int);
+
+        static bool gemm(const bool, const bool, const int, const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int);
+        static bool gemm(const bool, const bool, const int, const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int);
+        static bool gemv(const bool, const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int);
+        static bool gemv(const bool, const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int);
+        static bool ger(const int, const int, const float, const float* const, const int, const float* const, const int, const float, float* const, const int);
+        static bool ger(const int, const int, const double, const double* const, const int, const double* const, const int, const double, double* const, const int);
+
+        template<typename T>
+        static bool gemm(const bool, const bool, const int, const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int) { return false; }
+        template<typename T>
+        static bool gemv(const bool, const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int) { return false; }
+        template<typename T>
+        static bool ger(const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int) { return false; }
+
+    private:
+
+        static Engine& engine();
+
+};
+
+#endif
@@ -24,17 +24,40 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 This class defines the digit scanner. It has a neural network and functions
 to train, test and play with it. This class is a template so that the neural-
 network can have several floating point accuracies.
+
+When the topology of the neural network is one of the topologies used in
+production, testing and guessing use a copy of the network whose dimensions
+are known at compile time (see FixedFNN.hpp). The weights used for testing
+and guessing can also be stored in 16 bits, in a copy of the network in
+fp16 or bf16 (see HalfFNN.hpp). Testing then also classifies every picture
+with the full precision network and reports the accuracy lost. The copies
+are updated every time the network is created, loaded or trained.
+
+The network can also be quantized to int8 after training, calibrated on the
+first pictures of the training set (see QuantizedFNN.hpp). The quantized
+network can be saved and loaded on its own. When there is one, testing and
+guessing use it, and testing reports its accuracy and speed side by side
+with the ones of the float network. Training the network discards it.
 */
 
 #ifndef DigitScanner_hpp
 #define DigitScanner_hpp
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <vector>
 
 #include "GLUT.hpp"
 
+#include "AllocationCounter.hpp"
+#include "Barrier.hpp"
+#include "FixedFNN.hpp"
 #include "FNN.hpp"
+#include "HalfFNN.hpp"
 #include "Matrix.hpp"
+#include "MatrixView.hpp"
+#include "QuantizedFNN.hpp"
 
 template<typename T>
 class DigitScanner {
@@ -52,6 +75,15 @@ class DigitScanner {
             int         nb_threads;          /* number of threads to be launched */
             int         data_counter_init;   /* where to start the training in the dataset - used to split work in mutiple threads */
             int         data_upper_lim;      /* where to finish in the dataset - used to split work in multiple threads */
+            int         averaging_period;    /* batches between two averagings of the replicas with local SGD */
+            bool        adaptive_averaging;  /* whether the period decreases with the cost, with local SGD */
+        };
+    
+        struct averaging_state {
+            std::vector<double> costs;          /* cost of the batches of every thread since the last averaging */
+            std::vector<int>    nb_data;        /* pictures trained by every thread since the last averaging */
+            double              initial_cost;   /* cost per picture over the first period, 0 until known */
+            int                 period;         /* batches between two averagings */
         };
     
         struct test_settings {
@@ -63,6 +95,18 @@ class DigitScanner {
             int         img_upper_limit;     /* where to finish in the dataset - used to split work in multiple threads */
         };
 
+        struct test_results {
+            int    correct;             /* pictures correctly classified */
+            int    correct_full;        /* pictures correctly classified in full precision, when the weights are in 16 bits */
+            int    different;           /* pictures classified differently in 16 bits and in full precision */
+            int    correct_quantized;   /* pictures correctly classified by the quantized network */
+            double time;                /* seconds spent in the float network */
+            double time_quantized;      /* seconds spent in the quantized network */
+        };
+    
+        enum Precision {precision_full, precision_fp16, precision_bf16};
+        enum Parallelism {parallel_hogwild, parallel_sync, parallel_local};
+
         typedef std::chrono::time_point<std::chrono::high_resolution_clock> chrono_clock;
     
         DigitScanner();
@@ -71,13 +115,20 @@ class DigitScanner {
     
         void init();
         void set_layers(std::vector<int>);
+        void set_sigmoids(const SIMD::Sigmoid, const SIMD::Sigmoid);
+        void set_precision(const Precision);
+        void set_parallelism(const Parallelism);
+        void set_averaging(const int, const bool);
     
         bool load(std::string);
         bool save(std::string);
-        void train(std::string, const int, const int, const int, const int, const double, const double, const int);
-        void train_thread(train_settings, const int, std::map<int, int>, bool, bool*);
-        void test(std::string, const int, const int, const int);
-        void test_thread(test_settings, bool, int*, bool*);
+        bool quantize(std::string, const int);
+        bool load_quantized(std::string);
+        bool save_quantized(std::string);
+        double train(std::string, const int, const int, const int, const int, const double, const double, const int);
+        void   train_thread(train_settings, const int, const std::map<int, int>&, std::vector<TrainingWorkspace<T>>*, const int, std::vector<FNN<T>*>*, Barrier*, averaging_state*, long*, bool, bool*);
+        int    test(std::string, const int, const int, const int);
+        void   test_thread(test_settings, bool, test_results*, bool*);
     
         void draw(bool);
         void guess();
@@ -88,9 +139,17 @@ class DigitScanner {
     
         std::string create_progress_bar(double);
         double      elapsed_time(chrono_clock);
+        void        update_copies();
 
-        FNN<T>*       fnn;     /* feedforward neural network */
-        Matrix<float> digit;   /* input digit, 784 pixels of the picture */
+        FNN<T>*          fnn;                 /* feedforward neural network */
+        FixedFNNBase<T>* fixed_fnn;           /* copy of fnn with a fixed topology, 0 if none */
+        HalfFNNBase<T>*  half_fnn;            /* copy of fnn with its weights in 16 bits, 0 in full precision */
+        QuantizedFNN<T>* quantized_fnn;       /* fnn quantized to int8, 0 if none */
+        Precision        precision;           /* storage of the weights for testing and guessing */
+        Parallelism      parallelism;         /* how the training threads update the network */
+        int              averaging_period;    /* batches between two averagings with parallel_local */
+        bool             adaptive_averaging;  /* whether the period decreases with the cost with parallel_local */
+        Matrix<float>    digit;               /* input digit, 784 pixels of the picture */
 
 };
 
@@ -100,7 +159,15 @@ class DigitScanner {
 Initializes the variables.
 */
 template<typename T>
-DigitScanner<T>::DigitScanner() {
+DigitScanner<T>::DigitScanner() :
+    fnn(0),
+    fixed_fnn(0),
+    half_fnn(0),
+    quantized_fnn(0),
+    precision(precision_full),
+    parallelism(parallel_hogwild),
+    averaging_period(8),
+    adaptive_averaging(false) {
     init();
 }
 
@@ -109,18 +176,28 @@ Initializes the variables
 */
 template<typename T>
 DigitScanner<T>::DigitScanner(std::vector<int> p_layers) :
-    fnn(new FNN<T>(p_layers)) {
+    fnn(new FNN<T>(p_layers)),
+    fixed_fnn(0),
+    half_fnn(0),
+    quantized_fnn(0),
+    precision(precision_full),
+    parallelism(parallel_hogwild),
+    averaging_period(8),
+    adaptive_averaging(false) {
     init();
+    update_copies();
 }
 
 /*
-Frees the memory by deleting the neural network
-and the input matrix.
+Frees the memory by deleting the neural networks.
+The input matrix frees its coefficients itself.
 */
 template<typename T>
 DigitScanner<T>::~DigitScanner() {
+    delete quantized_fnn;
+    delete half_fnn;
+    delete fixed_fnn;
     delete fnn;
-    digit.free();
 }
 
 /*
@@ -139,6 +216,45 @@ template<typename T>
 void DigitScanner<T>::set_layers(std::vector<int> p_layers) {
     if(fnn) delete fnn;
     fnn = new FNN<T>(p_layers);
+    update_copies();
+}
+
+/*
+Sets the accuracy tiers of the sigmoid function used for training and for
+inference. Must be called once the neural network is created or loaded.
+*/
+template<typename T>
+void DigitScanner<T>::set_sigmoids(const SIMD::Sigmoid training, const SIMD::Sigmoid inference) {
+    fnn->set_sigmoids(training, inference);
+    update_copies();
+}
+
+/*
+Sets the storage of the weights used for testing and guessing: in full
+precision, or in 16 bits in fp16 or bf16.
+*/
+template<typename T>
+void DigitScanner<T>::set_precision(const Precision p_precision) {
+    precision = p_precision;
+    update_copies();
+}
+
+/*
+Sets how the training threads update the network (see train).
+*/
+template<typename T>
+void DigitScanner<T>::set_parallelism(const Parallelism p_parallelism) {
+    parallelism = p_parallelism;
+}
+
+/*
+Sets the number of batches between two averagings of the replicas with
+parallel_local, and whether this period decreases with the cost (see train).
+*/
+template<typename T>
+void DigitScanner<T>::set_averaging(const int p_period, const bool p_adaptive) {
+    averaging_period   = p_period;
+    adaptive_averaging = p_adaptive;
 }
 
 /*
@@ -170,9 +286,21 @@ output of the neural network that has the highest value.
 */
 template<typename T>
 void DigitScanner<T>::guess() {
-    const Matrix<T> y = fnn->feedforward(&digit);
     int kmax = 0;
-    for(int k=0 ; k<10 ; k++) { if(y(k, 0)>y(kmax, 0)) kmax = k; }
+    if(quantized_fnn) {
+        kmax = quantized_fnn->classify(&digit(0, 0));
+    }
+    else if(half_fnn) {
+        kmax = half_fnn->classify(&digit(0, 0));
+    }
+    else if(fixed_fnn) {
+        kmax = fixed_fnn->classify(&digit(0, 0));
+    }
+    else {
+        std::vector<Matrix<T>> activations = fnn->create_activations();
+        const Matrix<T>&       y           = fnn->feedforward(&digit, activations);
+        for(int k=0 ; k<10 ; k++) { if(y(k, 0)>y(kmax, 0)) kmax = k; }
+    }
     std::cout << "You drew: " << kmax << std::endl;
 }
 
@@ -210,6 +338,7 @@ bool DigitScanner<T>::load(std::string path) {
         layers.reserve(nb_layers);
         /* number of nodes in each layer */
         for(int i=0 ; i<nb_layers ; i++) { int nb_nodes; file >> nb_nodes; layers.push_back(nb_nodes); }
+        if(fnn) delete fnn;
         fnn = new FNN<T>(layers);
         /* weights and biases */
         for(int i=0 ; i<nb_layers-1 ; i++) {
@@ -228,6 +357,7 @@ bool DigitScanner<T>::load(std::string path) {
                 file >> B(j, 0);
             }
         }
+        update_copies();
         std::cerr << "FNN successfully loaded: " << nb_layers << " layers (";
         for(int i=0 ; i<nb_layers ; i++) {
             std::cerr << layers.at(i);
@@ -297,6 +427,81 @@ bool DigitScanner<T>::save(std::string path) {
     }
 }
 
+/*
+Quantizes the neural network to int8. The inputs of the layers are
+calibrated on the first nb_images pictures of the training set. Fails like
+load_quantized when a layer is too large for a quantized network.
+*/
+template<typename T>
+bool DigitScanner<T>::quantize(std::string path_data, const int nb_images) {
+    std::cerr << "quantizing FNN on " << nb_images << " training images... " << std::flush;
+    if(!QuantizedFNN<T>::supports(fnn->get_layers())) {
+        std::cerr << "couldn't quantize the FNN: a layer has too many nodes for the products in int32" << std::endl;
+        return false;
+    }
+    const int     image_len        = 784;
+    const int     image_header_len = 16;
+    std::ifstream file_images(path_data + "train-images.idx3-ubyte", std::ifstream::in | std::ifstream::binary);
+    if(!file_images) {
+        std::cerr << "couldn't open training dataset in folder \"" << path_data << "\"" << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> images(nb_images*image_len);
+    file_images.seekg(image_header_len, std::ios_base::cur);
+    file_images.read(reinterpret_cast<char*>(images.data()), nb_images*image_len);
+    if(file_images.gcount()!=static_cast<std::streamsize>(nb_images)*image_len) {
+        std::cerr << "couldn't read " << nb_images << " images from the training dataset in folder \"" << path_data << "\"" << std::endl;
+        return false;
+    }
+    /* one picture per column */
+    Matrix<T> calibration(nb_images, image_len);
+    for(int j=0 ; j<nb_images ; j++) {
+        for(int k=0 ; k<image_len ; k++) calibration(j, k) = static_cast<double>(images[j*image_len + k])/255;
+    }
+    calibration.self_transpose();
+    delete quantized_fnn;
+    quantized_fnn = new QuantizedFNN<T>(*fnn, calibration);
+    std::cerr << "weights: " << quantized_fnn->get_weights_size()/1024 << " kB" << std::endl;
+    return true;
+}
+
+/*
+Loads a quantized network, which must have the topology of the network.
+*/
+template<typename T>
+bool DigitScanner<T>::load_quantized(std::string path) {
+    std::cerr << "loading quantized FNN... " << std::flush;
+    QuantizedFNN<T>* q = QuantizedFNN<T>::load(path);
+    if(!q) {
+        std::cerr << "couldn't read file \"" << path << "\", or it is not a valid quantized FNN" << std::endl;
+        return false;
+    }
+    if(q->get_layers()!=fnn->get_layers()) {
+        std::cerr << "the quantized FNN and the FNN don't have the same layers" << std::endl;
+        delete q;
+        return false;
+    }
+    delete quantized_fnn;
+    quantized_fnn = q;
+    quantized_fnn->set_sigmoid(fnn->get_inference_sigmoid());
+    std::cerr << "quantized FNN successfully loaded" << std::endl;
+    return true;
+}
+
+/*
+Saves the quantized network.
+*/
+template<typename T>
+bool DigitScanner<T>::save_quantized(std::string path) {
+    std::cerr << "saving quantized FNN... " << std::flush;
+    if(!quantized_fnn || !quantized_fnn->save(path)) {
+        std::cerr << "couldn't create file \"" << path << "\"" << std::endl;
+        return false;
+    }
+    std::cerr << "quantized FNN successfully saved to \"" << path << "\"" << std::endl;
+    return true;
+}
+
 /*
 Trains a Neural Network using the Stochastic Gradient Descent algorithm.
 The whole dataset is shuffled and sliced in groups of ten pictures. For
@@ -304,10 +509,51 @@ every batch, the gradient is computed and the matrices are updated using
 the backpropagation algorithm. This runs until the whole dataset has been
 completed. Depending on the number of epochs, the whole process can be
 run more than once.
+
+With several threads, the training depends on the parallelism. With
+parallel_hogwild, the dataset is split between the threads, which train on
+their own batches and update the shared network without waiting for each
+other: every thread computes its nablas with a replica of the network, and
+the shared network is read and updated with relaxed atomic operations, so
+that the threads do not race (see FNN::update_parameters_relaxed). With
+parallel_sync, every batch is split between the threads: each one
+computes the nablas of its part of the batch, then they update the network
+together, once per batch (see FNN::reduce_and_update). The result is then
+the same for every run with the same shuffling and number of threads.
+
+With parallel_local, the dataset is split between the threads, which train
+their own replica of the network and never share a parameter while they
+train. Every averaging_period batches, the threads wait for each other and
+the network becomes the average of the replicas, which all restart from it.
+With adaptive_averaging, the period decreases with the cost, from
+averaging_period when training starts: after every averaging, it becomes
+averaging_period*sqrt(cost/initial cost), rounded up, the costs being the
+ones per picture over the last period and the first one (Wang and Joshi,
+"Adaptive Communication Strategies to Achieve the Best Error-Runtime
+Trade-off in Local-Update SGD"). The replicas diverge less when the
+averagings are frequent, which matters more as the training converges.
+
+Returns the training time in seconds.
 */
 template<typename T>
-void DigitScanner<T>::train(std::string path_data, const int nb_images, const int nb_images_to_skip, const int nb_epoch, const int batch_len, const double eta, const double alpha, const int nb_threads) {
-    bool display_stats = true;
+double DigitScanner<T>::train(std::string path_data, const int nb_images, const int nb_images_to_skip, const int nb_epoch, const int batch_len, const double eta, const double alpha, const int nb_threads) {
+    bool                  display_stats = true;
+    MatrixArena::Counters counters      = MatrixArena::get_counters();
+    /* one workspace per thread, reused for every batch of the training, for a part of the batch when synchronous */
+    std::vector<TrainingWorkspace<T>> workspaces;
+    std::vector<long>                 allocations(nb_threads, 0);
+    workspaces.reserve(nb_threads);
+    for(int j=0 ; j<nb_threads ; j++) {
+        if(parallelism==parallel_sync) workspaces.emplace_back(*fnn, batch_len*(j+1)/nb_threads - batch_len*j/nb_threads);
+        else                           workspaces.emplace_back(*fnn, batch_len);
+    }
+    Barrier barrier(nb_threads);
+    /* one replica of the network per thread, which computes the nablas with hogwild and is trained with local SGD */
+    std::vector<FNN<T>*> replicas;
+    averaging_state      averaging{std::vector<double>(nb_threads, 0), std::vector<int>(nb_threads, 0), 0, averaging_period};
+    if((parallelism==parallel_hogwild && nb_threads>1) || parallelism==parallel_local) {
+        for(int j=0 ; j<nb_threads ; j++) replicas.push_back(new FNN<T>(*fnn));
+    }
     /* begining */
     chrono_clock begin_training, begin_epoch;
     begin_training = std::chrono::high_resolution_clock::now();
@@ -329,32 +575,46 @@ void DigitScanner<T>::train(std::string path_data, const int nb_images, const in
         int                      nb_batches_per_subsets = nb_batches/nb_threads;
         for(int j=0 ; j<nb_threads ; j++) {
             train_settings ts;
-            ts.path_data         = path_data;
-            ts.nb_images         = nb_images;
-            ts.nb_images_to_skip = nb_images_to_skip;
-            ts.nb_epoch          = nb_epoch;
-            ts.batch_len         = batch_len;
-            ts.eta               = eta;
-            ts.alpha             = alpha;
-            ts.nb_threads        = nb_threads;
-            if(j==0) {
+            ts.path_data          = path_data;
+            ts.nb_images          = nb_images;
+            ts.nb_images_to_skip  = nb_images_to_skip;
+            ts.nb_epoch           = nb_epoch;
+            ts.batch_len          = batch_len;
+            ts.eta                = eta;
+            ts.alpha              = alpha;
+            ts.nb_threads         = nb_threads;
+            ts.averaging_period   = averaging_period;
+            ts.adaptive_averaging = adaptive_averaging;
+            if(parallelism==parallel_local) {
+                /* the batches are split evenly, so that the threads wait as little as possible for each other */
+                ts.data_counter_init = static_cast<int>(static_cast<long>(nb_batches)*j/nb_threads)*batch_len;
+                ts.data_upper_lim    = static_cast<int>(static_cast<long>(nb_batches)*(j+1)/nb_threads)*batch_len;
+                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, std::cref(shuffle), &workspaces, j, &replicas, &barrier, &averaging, &allocations.at(j), j==0, j==0 ? &display_stats : nullptr));
+            }
+            else if(parallelism==parallel_sync) {
+                /* every thread goes through all the batches */
+                ts.data_counter_init = 0;
+                ts.data_upper_lim    = nb_batches*batch_len;
+                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, std::cref(shuffle), &workspaces, j, nullptr, &barrier, nullptr, &allocations.at(j), j==0, j==0 ? &display_stats : nullptr));
+            }
+            else if(j==0) {
                 /* first thread shows progress */
                 ts.data_counter_init = 0;
                 ts.data_upper_lim    = nb_batches_per_subsets*batch_len;
-                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, shuffle, true, &display_stats));
+                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, std::cref(shuffle), &workspaces, j, &replicas, nullptr, nullptr, &allocations.at(j), true, &display_stats));
             }
             else if(j==nb_threads-1) {
                 /* last thread computes maximum batches available */
                 int nb_batches_available = nb_batches - j*nb_batches_per_subsets;
                 ts.data_counter_init     = j*nb_batches_per_subsets*batch_len;
                 ts.data_upper_lim        = (j*nb_batches_per_subsets + nb_batches_available)*batch_len;
-                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, shuffle, false, nullptr));
+                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, std::cref(shuffle), &workspaces, j, &replicas, nullptr, nullptr, &allocations.at(j), false, nullptr));
             }
             else {
                 /* middle threads compute nb_batches_per_subset batches */
                 ts.data_counter_init = j*nb_batches_per_subsets*batch_len;
                 ts.data_upper_lim    = (j+1)*nb_batches_per_subsets*batch_len;
-                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, shuffle, false, nullptr));
+                threads.push_back(std::thread(&DigitScanner<T>::train_thread, this, ts, i, std::cref(shuffle), &workspaces, j, &replicas, nullptr, nullptr, &allocations.at(j), false, nullptr));
             }
         }
         /* join all threads */
@@ -366,15 +626,54 @@ void DigitScanner<T>::train(std::string path_data, const int nb_images, const in
             std::cerr << "                          " << std::endl;
         }
     }
-    if(display_stats) std::cerr << "    training completed in " << elapsed_time(begin_training) << " s" << std::endl;
+    const double training_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin_training).count();
+    for(FNN<T>* replica : replicas) delete replica;
+    if(display_stats) {
+        const MatrixArena::Counters end = MatrixArena::get_counters();
+        std::cerr << "    training completed in " << elapsed_time(begin_training) << " s" << std::endl;
+        std::cerr << "    matrices allocated on the heap: " << (end.heap-counters.heap) << std::endl;
+        if(parallelism==parallel_local) std::cerr << "    replicas averaged every " << averaging.period << " batch(es) at the end of the training" << std::endl;
+        if(AllocationCounter::is_enabled()) {
+            long sum = 0;
+            for(int j=0 ; j<nb_threads ; j++) sum += allocations.at(j);
+            std::cerr << "    heap allocations after the first batch of each thread: " << sum << std::endl;
+        }
+    }
+    /* the quantized network has the old weights */
+    delete quantized_fnn;
+    quantized_fnn = 0;
+    update_copies();
+    return training_time;
 }
 
 /*
 Training function callback. One thread creates batches of pictures,
 runs the backpropagation algorithm on them and correct the W and B matrices.
+The batches are created and trained in the matrices of workspace number
+worker. The first batch allocates the thread-local buffers of the kernels,
+the heap allocations made for the next ones are added to allocations, when
+they are counted (see AllocationCounter.hpp).
+
+When replicas is not null nor empty, the thread has replica number worker.
+Without averaging, the network is shared with other threads: the replica
+computes the nablas, the network is updated with relaxed atomic operations,
+and its new parameters are copied to the replica for the next batch. The
+parameters are loaded into the replica before the first batch.
+
+With averaging, the thread trains its replica (local SGD). When the replicas
+are to be averaged, it waits at the barrier for the other threads, averages
+its part of the network, and waits again before loading the network into
+its replica. Every thread averages at the same batches of the longest share
+of the dataset, even once it has trained all its batches, so that they all
+reach the barrier the same number of times.
+
+When barrier is not null without replicas, the training is synchronous: the
+thread creates its part of every batch, computes its nablas, and waits at
+the barrier for the other threads. Then it updates its part of the network
+with the nablas of all the workspaces, and waits again before the next batch.
 */
 template<typename T>
-void DigitScanner<T>::train_thread(train_settings settings, const int epoch, std::map<int, int> shuffle, bool display, bool* display_stats) {
+void DigitScanner<T>::train_thread(train_settings settings, const int epoch, const std::map<int, int>& shuffle, std::vector<TrainingWorkspace<T>>* workspaces, const int worker, std::vector<FNN<T>*>* replicas, Barrier* barrier, averaging_state* averaging, long* allocations, bool display, bool* display_stats) {
     std::string   train_images           = settings.path_data + "train-images.idx3-ubyte";
     std::string   train_labels           = settings.path_data + "train-labels.idx1-ubyte";
     const int     image_len              = 784;
@@ -382,18 +681,47 @@ void DigitScanner<T>::train_thread(train_settings settings, const int epoch, std
     const int     image_header_len       = 16;
     const int     label_header_len       = 8;
     int           image_counter          = settings.data_counter_init;
-    int           nb_batches             = settings.nb_images/settings.batch_len;
-    int           nb_batches_per_subsets = nb_batches/settings.nb_threads;
     chrono_clock  begin_batch            = std::chrono::high_resolution_clock::now();
     std::ifstream file_images(train_images, std::ifstream::in | std::ifstream::binary);
     std::ifstream file_labels(train_labels, std::ifstream::in | std::ifstream::binary);
     if(file_images && file_labels) {
-        unsigned char*         image = new unsigned char[image_len];
-        unsigned char*         label = new unsigned char[label_len];
-        std::vector<Matrix<T>> batch_input;  batch_input.reserve(settings.batch_len);
-        std::vector<Matrix<T>> batch_output; batch_output.reserve(settings.batch_len);
-        for(int k=0 ; k<settings.batch_len ; k++) { Matrix<T> m(image_len, 1); batch_input.push_back(m); }
-        for(int k=0 ; k<settings.batch_len ; k++) { Matrix<T> m(10, 1);        batch_output.push_back(m); }
+        unsigned char* image = new unsigned char[image_len];
+        unsigned char* label = new unsigned char[label_len];
+        /* one picture per row, sparse: the pixels which are zero are not stored */
+        TrainingWorkspace<T>& workspace    = workspaces->at(worker);
+        SparseMatrix<T>&      batch_input  = workspace.get_batch_input();
+        Matrix<T>&            batch_output = workspace.get_batch_output();
+        bool                  first_batch  = true;
+        FNN<T>* const         replica      = replicas && !replicas->empty() ? replicas->at(worker) : nullptr;
+        /* part of the batches of this thread, the whole batches unless synchronous */
+        const int part_begin = barrier && !replica ? settings.batch_len*worker/settings.nb_threads : 0;
+        const int part_len   = workspace.get_batch_len();
+        /* local SGD: batches trained, batches of the longest share at the last averaging, and period */
+        const int nb_batches     = settings.nb_images/settings.batch_len;
+        const int longest_share  = (nb_batches + settings.nb_threads - 1)/settings.nb_threads;
+        int       batches        = 0;
+        int       averaged       = 0;
+        int       period         = averaging ? averaging->period : 0;
+        double    initial_cost   = averaging ? averaging->initial_cost : 0;
+        auto      average        = [&]() {
+            barrier->wait();
+            /* the costs are written before the first wait and read before the second one */
+            if(settings.adaptive_averaging) {
+                double cost    = 0;
+                long   nb_data = 0;
+                for(int j=0 ; j<settings.nb_threads ; j++) { cost += averaging->costs.at(j); nb_data += averaging->nb_data.at(j); }
+                if(nb_data>0) {
+                    cost /= nb_data;
+                    if(initial_cost==0) initial_cost = cost;
+                    period = std::min(settings.averaging_period, std::max(1, static_cast<int>(std::ceil(settings.averaging_period*std::sqrt(cost/initial_cost)))));
+                }
+            }
+            fnn->average_replicas(*replicas, worker, settings.nb_threads);
+            barrier->wait();
+            replica->load_parameters(*fnn);
+            averaging->costs.at(worker)   = 0;
+            averaging->nb_data.at(worker) = 0;
+        };
         /* variables for progress bar */
         unsigned long int nb_epoch_len = std::to_string(settings.nb_epoch).length();
         unsigned long int this_epo_len = std::to_string(epoch+1).length();
@@ -403,34 +731,75 @@ void DigitScanner<T>::train_thread(train_settings settings, const int epoch, std
             std::cerr << "    epoch " << (epoch+1) << "/" << settings.nb_epoch << ": " << begin_spaces << "[----------]     0 %" << std::flush;
         }
         while(image_counter<settings.data_upper_lim) {
+            const long allocations_begin = AllocationCounter::get_thread_count();
             /* create batch */
-            for(int k=0 ; k<settings.batch_len ; k++, image_counter++) {
+            batch_input.clear();
+            for(int k=0 ; k<part_len ; k++) {
+                const int index = settings.nb_images_to_skip + shuffle.at(image_counter + part_begin + k);
                 /* set cursor in file */
-                file_images.seekg(image_header_len + (settings.nb_images_to_skip + shuffle.at(image_counter))*image_len, std::ios_base::beg);
-                file_labels.seekg(label_header_len + (settings.nb_images_to_skip + shuffle.at(image_counter))*label_len, std::ios_base::beg);
+                file_images.seekg(image_header_len + index*image_len, std::ios_base::beg);
+                file_labels.seekg(label_header_len + index*label_len, std::ios_base::beg);
                 /* read an image from the file */
                 file_images.read((char*)image, image_len);
-                for(int j=0 ; j<image_len ; j++) batch_input.at(k)(j, 0) = static_cast<double>(image[j])/255;
+                batch_input.append_rows(image, 1, static_cast<T>(1/255.0));
                 /* read the label from the data set and create the expected output matrix */
                 file_labels.read((char*)label, label_len);
-                batch_output.at(k).fill(0);
-                batch_output.at(k)(label[0], 0) = 1;
+                for(int j=0 ; j<10 ; j++) batch_output(j, k) = 0;
+                batch_output(label[0], k) = 1;
             }
+            image_counter += settings.batch_len;
             /* SGD on the batch */
-            fnn->SGD_batch(batch_input, batch_output, settings.nb_images, settings.batch_len, settings.eta, settings.alpha);
+            if(replica && averaging) {
+                if(first_batch) replica->load_parameters(*fnn);
+                replica->SGD_batch(batch_input, batch_output, workspace, settings.nb_images, settings.eta, settings.alpha);
+                if(settings.adaptive_averaging) {
+                    averaging->costs.at(worker)   += workspace.get_cost();
+                    averaging->nb_data.at(worker) += part_len;
+                }
+                if(++batches==averaged+period) {
+                    averaged = batches;
+                    average();
+                }
+            }
+            else if(replica) {
+                if(first_batch) replica->load_parameters(*fnn);
+                replica->compute_nablas(batch_input, batch_output, workspace);
+                fnn->update_parameters_relaxed(workspace, settings.nb_images, settings.eta, settings.alpha, replica);
+            }
+            else if(!barrier) {
+                fnn->SGD_batch(batch_input, batch_output, workspace, settings.nb_images, settings.eta, settings.alpha);
+            }
+            else {
+                fnn->compute_nablas(batch_input, batch_output, workspace);
+                barrier->wait();
+                fnn->reduce_and_update(*workspaces, worker, settings.nb_threads, settings.nb_images, settings.batch_len, settings.eta, settings.alpha);
+                barrier->wait();
+            }
+            if(!first_batch) *allocations += AllocationCounter::get_thread_count() - allocations_begin;
+            first_batch = false;
             /* draw progress bar for thread 1 */
             if(display && elapsed_time(begin_batch)>=0.25) {
-                double percentage = static_cast<int>(10000*image_counter/static_cast<double>(nb_batches_per_subsets*settings.batch_len))/100.0;
+                double percentage = static_cast<int>(10000*(image_counter-settings.data_counter_init)/static_cast<double>(settings.data_upper_lim-settings.data_counter_init))/100.0;
                 std::string begin_spaces = "";
                 for(int k=0 ; k<nb_epoch_len-this_epo_len ; k++) begin_spaces += " ";
                 std::cerr << "\r    epoch " << (epoch+1) << "/" << settings.nb_epoch << ": " << begin_spaces << create_progress_bar(percentage) << percentage << " %";
-                if(settings.nb_threads>1) std::cout << " (thread 1/" << settings.nb_threads << ")";
+                if(settings.nb_threads>1 && (!barrier || replica)) std::cout << " (thread 1/" << settings.nb_threads << ")";
                 std::cout << std::flush;
                 begin_batch = std::chrono::high_resolution_clock::now();
             }
         }
-        for(Matrix<T> m : batch_input)  m.free();
-        for(Matrix<T> m : batch_output) m.free();
+        /* local SGD: the averagings of the batches left to the longest share */
+        if(replica && averaging) {
+            if(first_batch) replica->load_parameters(*fnn);
+            while(averaged<longest_share) {
+                averaged = std::min(averaged+period, longest_share);
+                average();
+            }
+            if(worker==0 && averaged>0) {
+                averaging->period       = period;
+                averaging->initial_cost = initial_cost;
+            }
+        }
         delete [] image;
         delete [] label;
         file_images.close();
@@ -443,10 +812,11 @@ void DigitScanner<T>::train_thread(train_settings settings, const int epoch, std
 }
 
 /*
-Tests a Neural Network across the MNIST dataset.
+Tests a Neural Network across the MNIST dataset. Returns the number of
+pictures correctly classified.
 */
 template<typename T>
-void DigitScanner<T>::test(std::string path_data, const int nb_images, const int nb_images_to_skip, const int nb_threads) {
+int DigitScanner<T>::test(std::string path_data, const int nb_images, const int nb_images_to_skip, const int nb_threads) {
     bool display_stats = true;
     /* beginning */
     chrono_clock begin_test = std::chrono::high_resolution_clock::now();
@@ -454,7 +824,7 @@ void DigitScanner<T>::test(std::string path_data, const int nb_images, const int
     std::cerr << "    testing [----------]     0 %" << std::flush;
     /* skip the first images */
     std::vector<std::thread> threads;
-    std::vector<int>         correct_classification(nb_threads, 0);
+    std::vector<test_results> results(nb_threads, test_results{0, 0, 0, 0, 0, 0});
     int                      nb_images_per_thread = nb_images/nb_threads;
     for(int i=0 ; i<nb_threads ; i++) {
         test_settings ts;
@@ -466,33 +836,60 @@ void DigitScanner<T>::test(std::string path_data, const int nb_images, const int
             /* first thread shows progress */
             ts.img_offset      = nb_images_to_skip;
             ts.img_upper_limit = nb_images_per_thread;
-            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, true, &correct_classification.at(0), &display_stats));
+            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, true, &results.at(0), &display_stats));
         }
         else if(i==nb_threads-1) {
             /* last thread tests maximum available pictures */
             int nb_images_available = nb_images - i*nb_images_per_thread;
             ts.img_offset      = nb_images_to_skip + i*nb_images_per_thread;
             ts.img_upper_limit = nb_images_available;
-            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, false, &correct_classification.at(i), nullptr));
+            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, false, &results.at(i), nullptr));
         }
         else {
             /* middle threads */
             ts.img_offset      = nb_images_to_skip + i*nb_images_per_thread;
             ts.img_upper_limit = nb_images_per_thread;
-            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, false, &correct_classification.at(i), nullptr));
+            threads.push_back(std::thread(&DigitScanner<T>::test_thread, this, ts, false, &results.at(i), nullptr));
         }
     }
     /* join all threads */
     for(int i=0 ; i<nb_threads ; i++) {
         threads.at(i).join();
     }
+    test_results total{0, 0, 0, 0, 0, 0};
+    for(const test_results& r : results) {
+        total.correct           += r.correct;
+        total.correct_full      += r.correct_full;
+        total.different         += r.different;
+        total.correct_quantized += r.correct_quantized;
+        total.time              += r.time;
+        total.time_quantized    += r.time_quantized;
+    }
     if(display_stats) {
-        int correct = 0;
-        for(int c : correct_classification) correct += c;
         std::cerr << "\r    testing completed in " << elapsed_time(begin_test) << " s";
         std::cerr << "                           " << std::endl;
-        std::cerr << "    " << correct << "/" << nb_images << " (" << 100*static_cast<double>(correct)/nb_images << " %) images correctly classified" << std::endl;
+        std::cerr << "    " << total.correct << "/" << nb_images << " (" << 100*static_cast<double>(total.correct)/nb_images << " %) images correctly classified" << std::endl;
+        if(half_fnn) {
+            const std::string format = precision==precision_bf16 ? "bf16" : "fp16";
+            std::cerr << "    weights in " << format << ": " << half_fnn->get_weights_size()/1024 << " kB" << std::endl;
+            std::cerr << "    full precision: " << total.correct_full << "/" << nb_images << " (" << 100*static_cast<double>(total.correct_full)/nb_images << " %), ";
+            std::cerr << "accuracy delta " << 100*static_cast<double>(total.correct-total.correct_full)/nb_images << " %, ";
+            std::cerr << total.different << " images classified differently" << std::endl;
+        }
+        if(quantized_fnn) {
+            size_t float_size = 0;
+            for(int i=0 ; i<fnn->get_nb_fully_connected_layers() ; i++) {
+                const Matrix<T>& W = *fnn->get_fully_connected_layer(i)->get_weights();
+                float_size += static_cast<size_t>(W.is_transposed() ? W.get_J() : W.get_I())*W.get_ld()*sizeof(T);
+            }
+            std::cerr << "    int8: " << total.correct_quantized << "/" << nb_images << " (" << 100*static_cast<double>(total.correct_quantized)/nb_images << " %) images correctly classified, ";
+            std::cerr << "accuracy delta " << 100*static_cast<double>(total.correct_quantized-total.correct)/nb_images << " %" << std::endl;
+            std::cerr << "    weights: " << float_size/1024 << " kB in float, " << quantized_fnn->get_weights_size()/1024 << " kB in int8" << std::endl;
+            std::cerr << "    throughput per thread: " << static_cast<int>(nb_images/total.time) << " images/s in float, ";
+            std::cerr << static_cast<int>(nb_images/total.time_quantized) << " images/s in int8" << std::endl;
+        }
     }
+    return total.correct;
 }
 
 /*
@@ -500,7 +897,7 @@ Testing thread function. One thread loads pictures, tries to guess
 the digits that they represent, and compares its guesses to the labels.
 */
 template<typename T>
-void DigitScanner<T>::test_thread(test_settings settings, bool display, int* correct_classifications, bool* display_stats) {
+void DigitScanner<T>::test_thread(test_settings settings, bool display, test_results* results, bool* display_stats) {
     std::string   test_images          = settings.path_data + "t10k-images.idx3-ubyte";
     std::string   test_labels          = settings.path_data + "t10k-labels.idx1-ubyte";
     const int     image_len            = 784;
@@ -511,25 +908,54 @@ void DigitScanner<T>::test_thread(test_settings settings, bool display, int* cor
     std::ifstream file_images(test_images, std::ifstream::in | std::ifstream::binary);
     std::ifstream file_labels(test_labels, std::ifstream::in | std::ifstream::binary);
     if(file_images && file_labels) {
-        unsigned char* image = new unsigned char[image_len];
-        unsigned char* label = new unsigned char[label_len];
+        const int      nb_images = settings.img_upper_limit;
+        unsigned char* images    = new unsigned char[nb_images*image_len];
+        unsigned char* labels    = new unsigned char[nb_images*label_len];
         /* set the file cursor */
         file_images.seekg(image_header_len + settings.img_offset*image_len, std::ios_base::cur);
         file_labels.seekg(label_header_len + settings.img_offset*label_len, std::ios_base::cur);
+        /* read the pictures of this thread, one per row in memory, read transposed */
+        file_images.read((char*)images, nb_images*image_len);
+        file_labels.read((char*)labels, nb_images*label_len);
+        Matrix<T> dataset(nb_images, image_len);
+        for(int j=0 ; j<nb_images ; j++) {
+            for(int k=0 ; k<image_len ; k++) dataset(j, k) = static_cast<double>(images[j*image_len + k])/255;
+        }
+        dataset.self_transpose();
+        /* the network without a fixed copy reads the pictures as sparse rows */
+        SparseMatrix<T> sparse_dataset(image_len);
+        if(!fixed_fnn) sparse_dataset.append_rows(images, nb_images, static_cast<T>(1/255.0));
         /* compute the results */
-        Matrix<T>    test_input(image_len, 1);
-        chrono_clock begin_sub_test = std::chrono::high_resolution_clock::now();
-        for(int j=0 ; j<settings.img_upper_limit ; j++) {
-            /* create input matrix */
-            file_images.read((char*)image, image_len);
-            for(int k=0 ; k<image_len ; k++) test_input(k, 0) = static_cast<double>(image[k])/255;
-            /* read output label */
-            file_labels.read((char*)label, label_len);
-            /* compute output */
-            const Matrix<T> y = fnn->feedforward(&test_input);
-            int kmax = 0;
-            for(int k=0 ; k<10 ; k++) { if(y(k, 0)>y(kmax, 0)) kmax = k; }
-            if(kmax==label[0]) (*correct_classifications)++;
+        std::vector<Matrix<T>> activations = fnn->create_activations();
+        chrono_clock           begin_sub_test = std::chrono::high_resolution_clock::now();
+        for(int j=0 ; j<nb_images ; j++) {
+            /* compute output, the input picture is a column of the dataset */
+            int          kmax        = 0;
+            chrono_clock begin_image = std::chrono::high_resolution_clock::now();
+            if(fixed_fnn) {
+                kmax = fixed_fnn->classify(&dataset(0, j));
+            }
+            else {
+                const SparseMatrix<T> test_input = sparse_dataset.row(j);
+                const Matrix<T>&      y          = fnn->feedforward(&test_input, activations);
+                for(int k=0 ; k<10 ; k++) { if(y(k, 0)>y(kmax, 0)) kmax = k; }
+            }
+            results->time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin_image).count();
+            /* with the weights in 16 bits, the full precision output is the reference */
+            if(half_fnn) {
+                const int kmax_half = half_fnn->classify(&dataset(0, j));
+                if(kmax==labels[j])      results->correct_full++;
+                if(kmax_half!=kmax)      results->different++;
+                kmax = kmax_half;
+            }
+            if(kmax==labels[j]) results->correct++;
+            /* the quantized network is timed separately */
+            if(quantized_fnn) {
+                begin_image = std::chrono::high_resolution_clock::now();
+                const int kmax_quantized = quantized_fnn->classify(&dataset(0, j));
+                results->time_quantized += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin_image).count();
+                if(kmax_quantized==labels[j]) results->correct_quantized++;
+            }
             /* prints progress bar */
             if(display && elapsed_time(begin_sub_test)>=0.25) {
                 double percentage = static_cast<int>(10000*j/static_cast<double>(nb_images_per_thread))/100.0;
@@ -539,9 +965,8 @@ void DigitScanner<T>::test_thread(test_settings settings, bool display, int* cor
                 begin_sub_test = std::chrono::high_resolution_clock::now();
             }
         }
-        test_input.free();
-        delete [] image;
-        delete [] label;
+        delete [] images;
+        delete [] labels;
         file_images.close();
         file_labels.close();
     }
@@ -581,4 +1006,21 @@ double DigitScanner<T>::elapsed_time(chrono_clock begin) {
     return static_cast<int>(ms/10.0)/100.0;
 }
 
+/*
+Creates again the copies of the neural network used for testing and
+guessing, with a fixed topology and in 16 bits, so that they have the
+current weights and sigmoid tier. The quantized network gets the sigmoid
+tier.
+*/
+template<typename T>
+void DigitScanner<T>::update_copies() {
+    delete fixed_fnn;
+    delete half_fnn;
+    fixed_fnn = FixedFNNBase<T>::create(*fnn);
+    half_fnn  = 0;
+    if(precision==precision_fp16)      half_fnn = HalfFNNBase<T>::create(*fnn, SIMD::half_fp16);
+    else if(precision==precision_bf16) half_fnn = HalfFNNBase<T>::create(*fnn, SIMD::half_bf16);
+    if(quantized_fnn) quantized_fnn->set_sigmoid(fnn->get_inference_sigmoid());
+}
+
 #endif
@@ -45,12 +45,60 @@ An FNNInputLayer just has a number of nodes, while a FNNFullyConnectedLayer
 has weight and bias matrices. The main purpose of this scheme is to be able
 to pass a pointer to the previous layer when creating a new one, might it
 be an input layer or a fully connected layer.
+
+The sigmoid function can be computed with different accuracy tiers during
+training (feedforward_complete) and inference (feedforward). See SIMD.hpp
+for the available tiers and their accuracy.
+
+The inputs can also be given as sparse matrices, one picture per row (see
+SparseMatrix.hpp). The products of the first layer then skip the pixels
+which are zero, for the activations as well as for the gradient of the
+weights, which is computed directly for the whole batch. For
+this purpose, the weights of the first layer are a transposed matrix: they
+are stored column by column, one column per input node, so that the
+columns of the nonzero pixels are processed with vectorized kernels.
+
+The matrices used to train the network on a batch are gathered in a
+TrainingWorkspace, created once for the shape of the network and the length
+of the batches, and reused for every batch:
+
+    TrainingWorkspace<float> workspace(fnn, 10);
+    for(...) {
+        ...                               // fill the batch of the workspace
+        fnn.SGD_batch(workspace.get_batch_input(), workspace.get_batch_output(), workspace, 60000, 0.5, 5);
+    }
+
+A workspace is used by a single thread at a time: every training thread
+has its own. Once the workspace is created, training on a batch does not
+allocate any memory (see AllocationCounter.hpp).
+
+Several threads can train the same network without waiting for each other
+(hogwild). Every thread then computes the nablas of its batches with its own
+replica of the network, and updates the shared network with the nablas. The
+update also copies the new parameters of the shared network, with the
+updates of the other threads, to the replica for the next batch. The shared
+parameters are only read and written with relaxed atomic operations, so that
+there is no data race:
+
+    replica.load_parameters(fnn);
+    for(...) {
+        replica.compute_nablas(workspace.get_batch_input(), workspace.get_batch_output(), workspace);
+        fnn.update_parameters_relaxed(workspace, 60000, 0.5, 5, &replica);
+    }
+
+The threads can also train their own replicas independently, with
+SGD_batch, and average them into the network every few batches (local
+SGD). The averaging is split between the threads like the synchronous
+update, each thread averaging its own rows of the parameters (see
+average_replicas).
 */
 
 #ifndef FNN_hpp
 #define FNN_hpp
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <list>
 #include <iostream>
 #include <fstream>
@@ -61,39 +109,100 @@ be an input layer or a fully connected layer.
 #include <vector>
 
 #include "Matrix.hpp"
+#include "MatrixView.hpp"
+#include "SparseMatrix.hpp"
 
 template<typename T> class FNNInputLayer;
 template<typename T> class FNNFullyConnectedLayer;
+template<typename T> class TrainingWorkspace;
 
 template<typename T>
 class FNN {
 
     typedef std::chrono::time_point<std::chrono::high_resolution_clock> chrono_clock;
-    typedef std::pair<std::vector<Matrix<T>>, std::vector<Matrix<T>>>   nabla_pair;
 
     public:
 
-        FNN(std::vector<int>);
+        FNN(std::vector<int>, const bool=true);
+        FNN(const FNN<T>&);
         ~FNN();
     
         int                        get_nb_fully_connected_layers()  const { return nb_fully_connected_layers; }
         std::vector<int>           get_layers()                     const { return layers; }
         FNNFullyConnectedLayer<T>* get_fully_connected_layer(int i) const { return fully_connected_layers[i]; }
+        SIMD::Sigmoid              get_training_sigmoid()           const { return training_sigmoid; }
+        SIMD::Sigmoid              get_inference_sigmoid()          const { return inference_sigmoid; }
     
-        const Matrix<T>        feedforward(Matrix<T>*);
-        std::vector<Matrix<T>> feedforward_complete(Matrix<T>*);
+        void set_sigmoids(const SIMD::Sigmoid p_training, const SIMD::Sigmoid p_inference) { training_sigmoid = p_training; inference_sigmoid = p_inference; }
+    
+        std::vector<Matrix<T>> create_activations(const int=1) const;
+        const Matrix<T>&       feedforward(const Matrix<T>*, std::vector<Matrix<T>>&);
+        const Matrix<T>&       feedforward(const SparseMatrix<T>*, std::vector<Matrix<T>>&);
+        const Matrix<T>&       feedforward_complete(const Matrix<T>*, std::vector<Matrix<T>>&);
+        const Matrix<T>&       feedforward_complete(const SparseMatrix<T>*, std::vector<Matrix<T>>&);
         void                   random_init_values(FNNFullyConnectedLayer<T>*);
-        void                   SGD_batch(std::vector<Matrix<T>>, std::vector<Matrix<T>>, const int, const int, const double, const double);
+        void                   SGD_batch(const Matrix<T>&, const Matrix<T>&, TrainingWorkspace<T>&, const int, const double, const double);
+        void                   SGD_batch(const SparseMatrix<T>&, const Matrix<T>&, TrainingWorkspace<T>&, const int, const double, const double);
+        template<typename X>
+        void                   compute_nablas(const X&, const Matrix<T>&, TrainingWorkspace<T>&);
+        void                   reduce_and_update(std::vector<TrainingWorkspace<T>>&, const int, const int, const int, const int, const double, const double);
+        void                   load_parameters(const FNN<T>&);
+        void                   update_parameters_relaxed(const TrainingWorkspace<T>&, const int, const double, const double, FNN<T>* const=0);
+        void                   average_replicas(const std::vector<FNN<T>*>&, const int, const int);
     
     private:
     
-        double     elapsed_time(chrono_clock);
-        nabla_pair backpropagation_cross_entropy(Matrix<T>&, Matrix<T>&);
+        static void gradient(Matrix<T>&, const Matrix<T>&, const Matrix<T>&);
+        static void gradient(Matrix<T>&, const Matrix<T>&, const SparseMatrix<T>&);
+        static MatrixView<T> rows_in_memory(const Matrix<T>&, const int, const int);
+    
+        double elapsed_time(chrono_clock);
+        template<typename X>
+        void   SGD_batch_nablas(const X&, const Matrix<T>&, TrainingWorkspace<T>&, const int, const double, const double);
+        template<typename X>
+        void   backpropagation_cross_entropy(const X&, const Matrix<T>&, std::vector<Matrix<T>>&, std::vector<Matrix<T>>&, const Matrix<T>&, std::vector<Matrix<T>>&, std::vector<Matrix<T>>&);
+        void   update_parameters(const std::vector<Matrix<T>>&, const std::vector<Matrix<T>>&, const int, const int, const double, const double);
+        template<typename F>
+        void   reduce_and_apply(Matrix<T>&, std::vector<TrainingWorkspace<T>>&, std::vector<Matrix<T>> TrainingWorkspace<T>::*, const int, const int, const int, const F&);
+        void   average_parameters(Matrix<T>* (FNNFullyConnectedLayer<T>::*)(), const std::vector<FNN<T>*>&, const int, const int, const int);
+    
+        static const int reduction_block = 1 << 12;   /* coefficients reduced at once by reduce_and_update and average_replicas */
     
         std::vector<int>            layers;
         FNNInputLayer<T>*           input;
         int                         nb_fully_connected_layers;
         FNNFullyConnectedLayer<T>** fully_connected_layers;
+        SIMD::Sigmoid               training_sigmoid;    /* sigmoid tier used by feedforward_complete */
+        SIMD::Sigmoid               inference_sigmoid;   /* sigmoid tier used by feedforward */
+    
+};
+
+template<typename T>
+class TrainingWorkspace {
+
+    public:
+    
+        TrainingWorkspace(const FNN<T>&, const int);
+    
+        int                           get_batch_len() const { return batch_len; }
+        SparseMatrix<T>&              get_batch_input()     { return batch_input; }
+        Matrix<T>&                    get_batch_output()    { return batch_output; }
+        const std::vector<Matrix<T>>& get_nabla_CW()  const { return nabla_CW; }
+        const std::vector<Matrix<T>>& get_nabla_CB()  const { return nabla_CB; }
+        double                        get_cost()      const;
+    
+    private:
+    
+        friend class FNN<T>;
+    
+        int                    batch_len;      /* number of data in a batch */
+        SparseMatrix<T>        batch_input;    /* inputs of a batch, one picture per row */
+        Matrix<T>              batch_output;   /* expected outputs of a batch, one per column */
+        std::vector<Matrix<T>> activations;    /* activations of the layers, one column per data */
+        std::vector<Matrix<T>> deltas;         /* errors of the layers, one column per data */
+        std::vector<Matrix<T>> nabla_CW;       /* gradients of the weights, stored like the weights */
+        std::vector<Matrix<T>> nabla_CB;       /* gradients of the biases */
+        Matrix<T>              ones;           /* column of ones, sums the errors of the batch */
     
 };
 
@@ -124,51 +233,82 @@ virtual ~FNNInputLayer() {}
 
 };
 
+/*
+Fully connected layer. Its weights W have one row per node and one column
+per node of the previous layer. When the layer is created by_columns, which
+is the case of the first layer of a network, W is stored by columns: it is
+the transposition of a matrix with one row per node of the previous layer,
+so that the weights of an input are contiguous for the sparse pictures.
+get_weights returns W with this layout. W(i, k) and the expressions read the
+same weight either way, but code reading data() and get_ld() directly must
+check is_transposed(), and a matrix stored like W is created transposed too.
+*/
 template<typename T>
 class FNNFullyConnectedLayer: public FNNLayer<T> {
 
     public:
     
-        FNNFullyConnectedLayer(int nb_nodes, FNNLayer<T>* p_previous_layer) :
+        FNNFullyConnectedLayer(int nb_nodes, FNNLayer<T>* p_previous_layer, bool by_columns=false) :
             FNNLayer<T>(nb_nodes),
             previous_layer(p_previous_layer),
-            W(nb_nodes, previous_layer->get_nb_nodes()),
-            B(nb_nodes, 1) {}
+            W(by_columns ? previous_layer->get_nb_nodes() : nb_nodes, by_columns ? nb_nodes : previous_layer->get_nb_nodes()),
+            B(nb_nodes, 1) { if(by_columns) W.self_transpose(); }
 virtual ~FNNFullyConnectedLayer() {}
     
         FNNLayer<T>* get_previous_layer() { return previous_layer; }
         Matrix<T>*   get_biases()         { return &B; }
         Matrix<T>*   get_weights()        { return &W; }
     
+        void backward(const Matrix<T>&, const Matrix<T>&, Matrix<T>&) const;
+    
     private:
     
         FNNLayer<T>* previous_layer;
-        Matrix<T>    W;
-        Matrix<T>    B;
+        Matrix<T>    W;                /* weights, transposed when stored by columns */
+        Matrix<T>    B;                /* biases, one per node */
     
 };
 
+template<typename T> const int FNN<T>::reduction_block;
+
 
 
 /*
 Initializes the variables and creates the layers according to the
-p_layer vector. The layers are linked to each other.
+p_layer vector. The layers are linked to each other. Their parameters are
+drawn with rand() when random_init is true, and must be set by the caller
+otherwise.
 */
 template<typename T>
-FNN<T>::FNN(std::vector<int> p_layers) :
+FNN<T>::FNN(std::vector<int> p_layers, const bool random_init) :
     layers(p_layers),
     input(new FNNInputLayer<T>(p_layers[0])),
     nb_fully_connected_layers(static_cast<int>(p_layers.size())-1),
-    fully_connected_layers(new FNNFullyConnectedLayer<T>*[nb_fully_connected_layers]) {
+    fully_connected_layers(new FNNFullyConnectedLayer<T>*[nb_fully_connected_layers]),
+    training_sigmoid(SIMD::sigmoid_poly),
+    inference_sigmoid(SIMD::sigmoid_poly) {
     FNNLayer<T>* previous = input;
     for(int i=0 ; i<nb_fully_connected_layers ; i++) {
-        FNNFullyConnectedLayer<T>* l = new FNNFullyConnectedLayer<T>(layers[i+1], previous);
+        /* the weights of the first layer are stored by columns, for the sparse inputs */
+        FNNFullyConnectedLayer<T>* l = new FNNFullyConnectedLayer<T>(layers[i+1], previous, i==0);
         fully_connected_layers[i]    = l;
         previous                     = l;
-        random_init_values(l);
+        if(random_init) random_init_values(l);
     }
 }
 
+/*
+Creates a network with the layers, parameters and sigmoids of another one.
+It does not call rand(), so that copying a network does not change the
+pseudo-random sequence, used to shuffle the training set.
+*/
+template<typename T>
+FNN<T>::FNN(const FNN<T>& source) :
+    FNN(source.layers, false) {
+    load_parameters(source);
+    set_sigmoids(source.training_sigmoid, source.inference_sigmoid);
+}
+
 /*
 Deletes the input, hidden and output layers.
 */
@@ -185,9 +325,8 @@ computes the difference between the output for a given set of input and the
 expected output. This gives what should be corrected. This first step is the
 feedforward step. The next step is the backpropagation, in which all the weights
 and biases differences are computed. This function returns these differences
-for one pair of input and output. Usually, the training is done using batches
-of input-output data. The parameters are updated only once for the whole batch
-of data. Below is the whole mathematical explanation.
+summed over a batch of input and output data. The parameters are updated only
+once for the whole batch of data. Below is the whole mathematical explanation.
 
 The goal of this algorithm is to reduce the cross-entropy cost C defined as
 
@@ -277,100 +416,145 @@ In these expressions:
         (1) means a column of ones of height that of A(k+1).
          °  means an element wise product (Hadamard product)
          *  means a product of matrices
+
+The whole batch is processed at once: Y and the A(k) have one column per
+data of the batch, the columns of A(1) being the inputs, so that D(k) has
+one column per data as well. D(k) * A(k)^t is then the sum over the batch
+of the products of the columns of D(k) and A(k), and NCB(k) is the sum of
+the columns of D(k), computed as D(k) * (1) with a column of ones of the
+length of the batch. Each formula is a single matrix product per layer
+instead of one matrix-vector product per data, so the weights are read
+once per batch. The result is the sum of the nablas of the data, up to the
+order of the additions.
+
+The code below writes these formulas with the destination-passing
+functions of class Matrix, into the matrices of the workspace given by the
+caller: the activations A(k) and the errors D(k). Each formula is computed in one pass, the transposed
+matrices being read in place, and D(k) is computed together with the
+derivative of the sigmoid (see FNNFullyConnectedLayer::backward). NCW(k) and
+NCB(k) are written to the matrices of the batch. When the input is sparse,
+with one picture per row, the first product only reads the columns of the
+nonzero pixels.
 */
 template<typename T>
-typename FNN<T>::nabla_pair FNN<T>::backpropagation_cross_entropy(Matrix<T>& training_input, Matrix<T>& training_output) {
+template<typename X>
+void FNN<T>::backpropagation_cross_entropy(const X& training_input, const Matrix<T>& training_output, std::vector<Matrix<T>>& activations, std::vector<Matrix<T>>& deltas, const Matrix<T>& ones, std::vector<Matrix<T>>& nabla_CW, std::vector<Matrix<T>>& nabla_CB) {
     /* feedforward */
-    std::vector<Matrix<T>> activations = feedforward_complete(&training_input);
-    /* backpropagation */
-    std::vector<Matrix<T>> nabla_CW; nabla_CW.resize(nb_fully_connected_layers);
-    std::vector<Matrix<T>> nabla_CB; nabla_CB.resize(nb_fully_connected_layers);
-    Matrix<T> D(activations[nb_fully_connected_layers], true);
-    Matrix<T> At(activations[nb_fully_connected_layers-1], true);
-        D -= training_output;
-        At.self_transpose();
-    Matrix<T> NCW(D, true);
-        NCW *= At;
-        At.free();
-    nabla_CW[nb_fully_connected_layers-1] = NCW;
-    nabla_CB[nb_fully_connected_layers-1] = D;
-    activations[nb_fully_connected_layers].free();
-    /* activations[0] = input, do not free */
-    /* backward propagation */
-    for(int i=nb_fully_connected_layers-2 ; i>=0 ; i--) {
-        Matrix<T> Wt(fully_connected_layers[i+1]->get_weights(), true);
-            Wt.self_transpose();
-            D = Wt*D;
-            Wt.free();
-        Matrix<T>* A = &activations[i+1];
-        Matrix<T> SP(A->get_I(), 1);
-            SP.fill(1);
-            SP -= A;
-            SP.element_wise_product(A);
-            D.element_wise_product(SP);
-            SP.free();
-        Matrix<T> At(activations[i], true);
-            At.self_transpose();
-        Matrix<T> NCW(D, true);
-            NCW *= At;
-            At.free();
-        nabla_CW[i] = NCW;
-        nabla_CB[i] = D;
-        activations[i+1].free();
+    const Matrix<T>& output = feedforward_complete(&training_input, activations);
+    /* backpropagation, activations[i] and deltas[i] being the output and the error of layer i */
+    sub_into(deltas[nb_fully_connected_layers-1], output, training_output);
+    for(int i=nb_fully_connected_layers-1 ; i>=0 ; i--) {
+        const Matrix<T>& D = deltas[i];
+        if(i>0) gradient(nabla_CW[i], D, activations[i-1]);
+        else    gradient(nabla_CW[i], D, training_input);
+        nabla_CB[i].gemm(1, D, false, ones, false, 0);
+        /* backward propagation */
+        if(i>0) fully_connected_layers[i]->backward(D, activations[i-1], deltas[i-1]);
     }
-    return nabla_pair(nabla_CW, nabla_CB);
 }
 
 /*
-Feedforward algorithm to be used to compute the output.
-O = WA+B. This function uses the sigmoid function to range
-the output in [0 1]. This function is to be called when just
-the output is needed.
+Writes D*A^t, the gradient of the weights summed over a batch, to NCW. A is
+the input of the layer, with one column per data when dense, and one row
+per data when sparse.
 */
 template<typename T>
-const Matrix<T> FNN<T>::feedforward(Matrix<T>* X) {
+void FNN<T>::gradient(Matrix<T>& NCW, const Matrix<T>& D, const Matrix<T>& A) {
+    NCW.gemm(1, D, false, A, true, 0);
+}
+template<typename T>
+void FNN<T>::gradient(Matrix<T>& NCW, const Matrix<T>& D, const SparseMatrix<T>& A) {
+    SparseMatrix<T>::gemm(1, D, A, false, 0, NCW);
+}
+
+/*
+Creates the matrices that receive the activations of the fully connected
+layers in feedforward, with one column per input. They can be reused for
+any number of calls with this number of inputs.
+*/
+template<typename T>
+std::vector<Matrix<T>> FNN<T>::create_activations(const int nb_inputs) const {
     std::vector<Matrix<T>> activations;
-    activations.push_back(*X);
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) activations.emplace_back(layers[i+1], nb_inputs);
+    return activations;
+}
+
+/*
+Feedforward algorithm to be used to compute the output.
+O = sigmoid(WA+B). This function is to be called when just the output is
+needed. The activations of each fully connected layer are written to the
+matrices given by the caller (see create_activations), and a reference to
+the output is returned. The weights are read in place, nothing is allocated.
+The sigmoid is computed with the inference tier.
+*/
+template<typename T>
+const Matrix<T>& FNN<T>::feedforward(const Matrix<T>* X, std::vector<Matrix<T>>& activations) {
+    const Matrix<T>* a = X;
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) {
+        FNNFullyConnectedLayer<T>* layer = fully_connected_layers[i];
+        activations[i].sigmoid_affine(*layer->get_weights(), *a, *layer->get_biases(), inference_sigmoid);
+        a = &activations[i];
+    }
+    return activations[nb_fully_connected_layers-1];
+}
+
+/*
+Feedforward algorithm for a sparse input, the picture being the only row
+of X. The first layer only reads the weights of the nonzero pixels.
+*/
+template<typename T>
+const Matrix<T>& FNN<T>::feedforward(const SparseMatrix<T>* X, std::vector<Matrix<T>>& activations) {
     for(int i=0 ; i<nb_fully_connected_layers ; i++) {
         FNNFullyConnectedLayer<T>* layer = fully_connected_layers[i];
-        Matrix<T> a(layer->get_weights(), true);
-            a *= activations[i];
-            a += layer->get_biases();
-            a.sigmoid();
-            activations.push_back(a);
-            if(i>0) activations[i].free();
+        if(i==0) SparseMatrix<T>::sigmoid_affine(activations[i], *layer->get_weights(), *X, *layer->get_biases(), inference_sigmoid);
+        else     activations[i].sigmoid_affine(*layer->get_weights(), activations[i-1], *layer->get_biases(), inference_sigmoid);
     }
-    return activations[nb_fully_connected_layers];
+    return activations[nb_fully_connected_layers-1];
 }
 
 /*
 Feedforward algorithm to be used in the backpropagation algorithm.
 This function is to be called when all the activations are needed,
-for instance during the backpropagation step.
+for instance during the backpropagation step. Like feedforward, it writes
+the activations of the fully connected layers to the matrices given by the
+caller and returns a reference to the output, but the sigmoid is computed
+with the training tier.
 */
 template<typename T>
-std::vector<Matrix<T>> FNN<T>::feedforward_complete(Matrix<T>* X) {
-    std::vector<Matrix<T>> activations;
-    activations.push_back(*X);
+const Matrix<T>& FNN<T>::feedforward_complete(const Matrix<T>* X, std::vector<Matrix<T>>& activations) {
+    const Matrix<T>* a = X;
     for(int i=0 ; i<nb_fully_connected_layers ; i++) {
         FNNFullyConnectedLayer<T>* layer = fully_connected_layers[i];
-        Matrix<T> a(layer->get_weights(), true);
-            a *= activations[i];
-            a += layer->get_biases();
-            a.sigmoid();
-            activations.push_back(a);
+        activations[i].sigmoid_affine(*layer->get_weights(), *a, *layer->get_biases(), training_sigmoid);
+        a = &activations[i];
     }
-    return activations;
+    return activations[nb_fully_connected_layers-1];
 }
 
 /*
-Initializes the network's weights and biases with a Gaussian generator.
+Feedforward algorithm to be used in the backpropagation algorithm, for a
+sparse input, one picture per row of X.
+*/
+template<typename T>
+const Matrix<T>& FNN<T>::feedforward_complete(const SparseMatrix<T>* X, std::vector<Matrix<T>>& activations) {
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) {
+        FNNFullyConnectedLayer<T>* layer = fully_connected_layers[i];
+        if(i==0) SparseMatrix<T>::sigmoid_affine(activations[i], *layer->get_weights(), *X, *layer->get_biases(), training_sigmoid);
+        else     activations[i].sigmoid_affine(*layer->get_weights(), activations[i-1], *layer->get_biases(), training_sigmoid);
+    }
+    return activations[nb_fully_connected_layers-1];
+}
+
+/*
+Initializes the network's weights and biases with a Gaussian generator. The
+generator is seeded from rand, so that the initial weights follow the seed
+given to srand, like the shuffling of the training set.
 */
 template<typename T>
 void FNN<T>::random_init_values(FNNFullyConnectedLayer<T>* l) {
     Matrix<T> W = l->get_weights();
     Matrix<T> B = l->get_biases();
-    std::default_random_engine       generator;
+    std::default_random_engine       generator(static_cast<unsigned int>(rand()));
     std::normal_distribution<double> gauss_biases(0, 1);
     std::normal_distribution<double> gauss_weights(0, 1.0/sqrt(l->get_previous_layer()->get_nb_nodes()));
     for(int i = 0 ; i<W.get_I() ; i++) {
@@ -382,37 +566,214 @@ void FNN<T>::random_init_values(FNNFullyConnectedLayer<T>* l) {
 /*
 Stochastic Gradient Descent algorithm for a batch.
 This function is the actual SGD algorithm. It runs the backpropagation
-on the whole batch before updating the weights and biases.
+on the whole batch before updating the weights and biases. The inputs and
+the expected outputs are the columns of batch_input and batch_output, the
+batch being processed as a whole (see backpropagation_cross_entropy) in the
+matrices of the workspace, which must have been created for this network
+and the length of the batch.
+*/
+template<typename T>
+void FNN<T>::SGD_batch(const Matrix<T>& batch_input, const Matrix<T>& batch_output, TrainingWorkspace<T>& workspace, const int training_set_len, const double eta, const double alpha) {
+    SGD_batch_nablas(batch_input, batch_output, workspace, training_set_len, eta, alpha);
+}
+
+/*
+Stochastic Gradient Descent algorithm for a batch of sparse inputs, one
+picture per row of batch_input.
+*/
+template<typename T>
+void FNN<T>::SGD_batch(const SparseMatrix<T>& batch_input, const Matrix<T>& batch_output, TrainingWorkspace<T>& workspace, const int training_set_len, const double eta, const double alpha) {
+    SGD_batch_nablas(batch_input, batch_output, workspace, training_set_len, eta, alpha);
+}
+
+/*
+Computes the nablas of a batch, dense or sparse, summed over its inputs,
+then updates the parameters.
 */
 template<typename T>
-void FNN<T>::SGD_batch(std::vector<Matrix<T>> batch_input, std::vector<Matrix<T>> batch_output, const int training_set_len, const int batch_len, const double eta, const double alpha) {
-    /* create nabla matrices vectors */
-    std::vector<Matrix<T>> nabla_CW;
-    std::vector<Matrix<T>> nabla_CB;
+template<typename X>
+void FNN<T>::SGD_batch_nablas(const X& batch_input, const Matrix<T>& batch_output, TrainingWorkspace<T>& workspace, const int training_set_len, const double eta, const double alpha) {
+    compute_nablas(batch_input, batch_output, workspace);
+    update_parameters(workspace.nabla_CW, workspace.nabla_CB, training_set_len, workspace.batch_len, eta, alpha);
+}
+
+/*
+Computes the nablas of a batch, dense or sparse, summed over its inputs, in
+the matrices of the workspace, without updating the parameters.
+*/
+template<typename T>
+template<typename X>
+void FNN<T>::compute_nablas(const X& batch_input, const Matrix<T>& batch_output, TrainingWorkspace<T>& workspace) {
+    /* feedforward-backpropagation for the whole batch */
+    backpropagation_cross_entropy(batch_input, batch_output, workspace.activations, workspace.deltas, workspace.ones, workspace.nabla_CW, workspace.nabla_CB);
+}
+
+/*
+Updates the weights and biases with the nablas summed over a batch, with
+the weight decay. The weights are read and written in a single pass.
+*/
+template<typename T>
+void FNN<T>::update_parameters(const std::vector<Matrix<T>>& nabla_CW, const std::vector<Matrix<T>>& nabla_CB, const int training_set_len, const int batch_len, const double eta, const double alpha) {
+    const T rate  = eta/static_cast<double>(batch_len);
+    const T decay = 1-(alpha*eta)/static_cast<double>(training_set_len);
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) {
+        Matrix<T>& W = *fully_connected_layers[i]->get_weights();
+        Matrix<T>& B = *fully_connected_layers[i]->get_biases();
+        W.zip(W, nabla_CW[i], [=](const T w, const T nw) { return decay*w - rate*nw; });
+        B -= rate*nabla_CB[i];
+    }
+}
+
+/*
+Synchronous update of the parameters for a batch split over several
+workspaces, the nablas of every part of the batch having been computed in
+its own workspace (see compute_nablas). The nablas are summed over the
+workspaces, then the parameters are updated once, like update_parameters
+does for a whole batch. batch_len is the length of the whole batch.
+
+The work is split over nb_parts threads, this call doing part number part:
+the rows of the weights and biases in memory are split in nb_parts ranges,
+the same for the nablas, so that every thread reduces and updates its own
+rows without any synchronization. The caller must wait for all the parts
+to be done before using the parameters.
+
+The nablas are summed with a tree reduction: the nablas of workspace t+s are
+added to the ones of workspace t for s = 1, 2, 4... and t a multiple of
+2*s, the sum ending in workspace 0. Every coefficient is therefore summed
+in the same order whatever the thread that sums it, so the result only
+depends on the number of workspaces, and training is reproducible. The rows
+are reduced and updated by blocks of about reduction_block coefficients,
+whose nablas in all the workspaces stay in the cache from the first step of
+the tree to the update.
+*/
+template<typename T>
+void FNN<T>::reduce_and_update(std::vector<TrainingWorkspace<T>>& workspaces, const int part, const int nb_parts, const int training_set_len, const int batch_len, const double eta, const double alpha) {
+    const T rate  = eta/static_cast<double>(batch_len);
+    const T decay = 1-(alpha*eta)/static_cast<double>(training_set_len);
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) {
+        reduce_and_apply(*fully_connected_layers[i]->get_weights(), workspaces, &TrainingWorkspace<T>::nabla_CW, i, part, nb_parts, [=](const T w, const T nw) { return decay*w - rate*nw; });
+        reduce_and_apply(*fully_connected_layers[i]->get_biases(), workspaces, &TrainingWorkspace<T>::nabla_CB, i, part, nb_parts, [=](const T b, const T nb) { return b - rate*nb; });
+    }
+}
+
+/*
+Copies the weights and biases of source, a network with the same layers, to
+this network. The parameters of source are read with relaxed atomic loads,
+so that other threads can update them with update_parameters_relaxed at the
+same time. The copy may then mix coefficients from before and after these
+updates.
+*/
+template<typename T>
+void FNN<T>::load_parameters(const FNN<T>& source) {
+    for(int i=0 ; i<nb_fully_connected_layers ; i++) {
+        fully_connected_layers[i]->get_weights()->load_relaxed(*source.fully_connected_layers[i]->get_weights());
+        fully_connected_layers[i]->get_biases()->load_relaxed(*source.fully_connected_layers[i]->get_biases());
+    }
+}
+
+/*
+Updates the weights and biases with the nablas of a batch computed in the
+workspace, like update_parameters, the parameters being read and written
+with relaxed atomic operations. Several threads can therefore update the
+network at the same time, or read it with load_parameters, without locking.
+When two threads update the same coefficient at the same time, one of the
+updates may be lost, which the hogwild training tolerates.
+
+The new parameters are also copied to replica, if not null, in the same
+pass: the replica then has the parameters of this network with the updates
+of all the threads so far, as load_parameters would give.
+*/
+template<typename T>
+void FNN<T>::update_parameters_relaxed(const TrainingWorkspace<T>& workspace, const int training_set_len, const double eta, const double alpha, FNN<T>* const replica) {
+    const T rate  = eta/static_cast<double>(workspace.batch_len);
+    const T decay = 1-(alpha*eta)/static_cast<double>(training_set_len);
     for(int i=0 ; i<nb_fully_connected_layers ; i++) {
-        nabla_CW.emplace_back(layers[i+1], layers[i]); nabla_CW.back().fill(0);
-        nabla_CB.emplace_back(layers[i+1], 1);         nabla_CB.back().fill(0);
+        Matrix<T>* const replica_W = replica ? replica->fully_connected_layers[i]->get_weights() : 0;
+        Matrix<T>* const replica_B = replica ? replica->fully_connected_layers[i]->get_biases() : 0;
+        fully_connected_layers[i]->get_weights()->zip_relaxed(workspace.nabla_CW[i], [=](const T w, const T nw) { return decay*w - rate*nw; }, replica_W);
+        fully_connected_layers[i]->get_biases()->zip_relaxed(workspace.nabla_CB[i], [=](const T b, const T nb) { return b - rate*nb; }, replica_B);
     }
-    /* feedforward-backpropagation for each data in the batch and sum the nablas */
-    for(int i=0 ; i<batch_len ; i++) {
-        nabla_pair delta_nabla = backpropagation_cross_entropy(batch_input[i], batch_output[i]);
-        for(int j=0 ; j<nb_fully_connected_layers ; j++) {
-            nabla_CW[j] += delta_nabla.first[j];  delta_nabla.first[j].free();
-            nabla_CB[j] += delta_nabla.second[j]; delta_nabla.second[j].free();
+}
+
+/*
+Sums the nablas of layer i of the workspaces for part part of the rows in
+memory of the parameters P, then updates them with p = f(p, nabla). nablas
+selects the weights or biases nablas of the workspaces.
+*/
+template<typename T>
+template<typename F>
+void FNN<T>::reduce_and_apply(Matrix<T>& P, std::vector<TrainingWorkspace<T>>& workspaces, std::vector<Matrix<T>> TrainingWorkspace<T>::* nablas, const int i, const int part, const int nb_parts, const F& f) {
+    const int nb_workspaces = static_cast<int>(workspaces.size());
+    const int nb_rows       = P.is_transposed() ? P.get_J() : P.get_I();
+    const int row_len       = P.is_transposed() ? P.get_I() : P.get_J();
+    const int begin         = static_cast<int>(static_cast<long>(nb_rows)*part/nb_parts);
+    const int end           = static_cast<int>(static_cast<long>(nb_rows)*(part+1)/nb_parts);
+    const int block         = std::max(1, reduction_block/row_len);
+    for(int r=begin ; r<end ; r+=block) {
+        const int n = std::min(block, end-r);
+        for(int s=1 ; s<nb_workspaces ; s*=2) {
+            for(int t=0 ; t+s<nb_workspaces ; t+=2*s) {
+                MatrixView<T> sum = rows_in_memory((workspaces[t].*nablas)[i], r, n);
+                sum += rows_in_memory((workspaces[t+s].*nablas)[i], r, n);
+            }
         }
+        MatrixView<T> p = rows_in_memory(P, r, n);
+        p.zip(p, rows_in_memory((workspaces[0].*nablas)[i], r, n), f);
     }
-    /* update the parameters */
+}
+
+/*
+Local SGD: averages the parameters of the replicas, networks with the same
+layers trained independently from the parameters of this network, into this
+network. The work is split over nb_parts threads like reduce_and_update, this
+call averaging part number part of the rows in memory of the parameters. The
+replicas must not be trained during the call, and the caller must wait for
+all the parts to be done before loading the average into the replicas. The
+replicas are summed in order, so the average only depends on the number of
+replicas.
+*/
+template<typename T>
+void FNN<T>::average_replicas(const std::vector<FNN<T>*>& replicas, const int part, const int nb_parts) {
     for(int i=0 ; i<nb_fully_connected_layers ; i++) {
-        nabla_CW[i] *= eta/static_cast<double>(batch_len);
-        nabla_CB[i] *= eta/static_cast<double>(batch_len);
-        fully_connected_layers[i]->get_weights()->operator*=((1-(alpha*eta)/static_cast<double>(training_set_len)));
-        fully_connected_layers[i]->get_weights()->operator-=(&nabla_CW[i]);
-        fully_connected_layers[i]->get_biases()->operator-=(&nabla_CB[i]);
-        nabla_CW[i].free();
-        nabla_CB[i].free();
+        average_parameters(&FNNFullyConnectedLayer<T>::get_weights, replicas, i, part, nb_parts);
+        average_parameters(&FNNFullyConnectedLayer<T>::get_biases, replicas, i, part, nb_parts);
+    }
+}
+
+/*
+Averages the weights or biases of layer i of the replicas, selected by
+parameters, for part part of their rows in memory, by blocks of about
+reduction_block coefficients which stay in the cache while the replicas are
+added to them.
+*/
+template<typename T>
+void FNN<T>::average_parameters(Matrix<T>* (FNNFullyConnectedLayer<T>::* parameters)(), const std::vector<FNN<T>*>& replicas, const int i, const int part, const int nb_parts) {
+    Matrix<T>& P            = *(fully_connected_layers[i]->*parameters)();
+    const int  nb_replicas  = static_cast<int>(replicas.size());
+    const int  nb_rows      = P.is_transposed() ? P.get_J() : P.get_I();
+    const int  row_len      = P.is_transposed() ? P.get_I() : P.get_J();
+    const int  begin        = static_cast<int>(static_cast<long>(nb_rows)*part/nb_parts);
+    const int  end          = static_cast<int>(static_cast<long>(nb_rows)*(part+1)/nb_parts);
+    const int  block        = std::max(1, reduction_block/row_len);
+    for(int r=begin ; r<end ; r+=block) {
+        const int     n = std::min(block, end-r);
+        MatrixView<T> p = rows_in_memory(P, r, n);
+        p = rows_in_memory(*(replicas[0]->fully_connected_layers[i]->*parameters)(), r, n);
+        for(int t=1 ; t<nb_replicas ; t++) p += rows_in_memory(*(replicas[t]->fully_connected_layers[i]->*parameters)(), r, n);
+        p *= static_cast<T>(1.0/nb_replicas);
     }
 }
 
+/*
+Views n rows in memory of M starting at row i, which are columns when M is
+a transposed matrix.
+*/
+template<typename T>
+MatrixView<T> FNN<T>::rows_in_memory(const Matrix<T>& M, const int i, const int n) {
+    if(M.is_transposed()) return MatrixView<T>(M, 0, i, M.get_I(), n);
+    else                  return MatrixView<T>(M, i, 0, n, M.get_J());
+}
+
 /*
 Computes execution time.
 */
@@ -424,4 +785,66 @@ double FNN<T>::elapsed_time(chrono_clock begin) {
     return static_cast<int>(ms/10.0)/100.0;
 }
 
+/*
+Creates the matrices used to train fnn on batches of batch_len data. The
+batch input has room for pictures whose pixels are all nonzero, so that it
+is never reallocated. The nabla matrices are stored like the weights, by
+columns for the first layer. They are entirely written by the
+backpropagation, so they are not initialized.
+*/
+template<typename T>
+TrainingWorkspace<T>::TrainingWorkspace(const FNN<T>& fnn, const int p_batch_len) :
+    batch_len(p_batch_len),
+    batch_input(fnn.get_layers().front()),
+    batch_output(p_batch_len, fnn.get_layers().back()),
+    activations(fnn.create_activations(p_batch_len)),
+    deltas(fnn.create_activations(p_batch_len)),
+    ones(p_batch_len, 1) {
+    const std::vector<int> layers = fnn.get_layers();
+    batch_input.reserve(batch_len, batch_len*layers.front());
+    batch_output.self_transpose();
+    for(int i=0 ; i<fnn.get_nb_fully_connected_layers() ; i++) {
+        if(fnn.get_fully_connected_layer(i)->get_weights()->is_transposed()) {
+            nabla_CW.emplace_back(layers[i], layers[i+1]); nabla_CW.back().self_transpose();
+        }
+        else {
+            nabla_CW.emplace_back(layers[i+1], layers[i]);
+        }
+        nabla_CB.emplace_back(layers[i+1], 1);
+    }
+    ones.fill(1);
+}
+
+/*
+Cross-entropy cost of the last batch trained in this workspace, summed over
+its data. The outputs are the ones of the network before it was updated
+with the batch. They are clamped away from 0 and 1 for the logarithms.
+*/
+template<typename T>
+double TrainingWorkspace<T>::get_cost() const {
+    const Matrix<T>& A    = activations.back();
+    double           cost = 0;
+    for(int k=0 ; k<batch_len ; k++) {
+        for(int j=0 ; j<A.get_I() ; j++) {
+            const double a = std::min(std::max(static_cast<double>(A(j, k)), 1e-12), 1-1e-12);
+            const double y = batch_output(j, k);
+            cost -= y*std::log(a) + (1-y)*std::log(1-a);
+        }
+    }
+    return cost;
+}
+
+/*
+Backward step of the layer: given the error D of this layer and the output
+A of the previous layer, writes the error of the previous layer,
+(W^t*D)°A°(1-A), to D_previous. The product and the derivative of the
+sigmoid are computed in one pass over the weights, without intermediate
+matrix (see Matrix::sigmoid_backward). D_previous must have the dimensions
+of A.
+*/
+template<typename T>
+void FNNFullyConnectedLayer<T>::backward(const Matrix<T>& D, const Matrix<T>& A, Matrix<T>& D_previous) const {
+    D_previous.sigmoid_backward(W, D, A);
+}
+
 #endif
@@ -0,0 +1,210 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines feedforward neural networks whose topology is known at
+compile time, for inference only. They are created from a trained FNN, from
+which they copy the weights and biases and the inference sigmoid tier:
+
+    FixedFNN<float, 784, 100, 50, 10> net(fnn);
+    int digit = net.classify(pixels);
+
+The weights and biases are stored in FixedMatrix objects inside the network
+and the activations of the layers are FixedMatrix vectors on the stack, so
+classifying a picture allocates nothing and checks no dimension at runtime.
+This is what limits the latency of a single picture with class FNN, in
+which every matrix is a heap allocation with runtime dimensions.
+
+The layers are built recursively from the list of the numbers of nodes.
+FixedFNNLayers<T, N0, N1, L...> holds the weights from N0 to N1 nodes, and
+the following layers, FixedFNNLayers<T, N1, L...>.
+
+The topologies used in production are instantiated by FixedFNNBase::create,
+which returns a network through the abstract class FixedFNNBase, or 0 when
+the topology of the FNN is not one of them:
+
+                     ----------------
+                     | FixedFNNBase |
+                     ----------------
+                            ^
+                            |
+               -----------------------------
+               | FixedFNN<T, 784, 400, 10> |  ...
+               -----------------------------
+
+The networks are allocated on 64 bytes, the alignment of the coefficients
+of FixedMatrix. The network is a copy: it must be created again when the
+FNN is trained.
+*/
+
+#ifndef FixedFNN_hpp
+#define FixedFNN_hpp
+
+#include <vector>
+
+#include "FixedMatrix.hpp"
+#include "FNN.hpp"
+
+template<typename T>
+class FixedFNNBase {
+
+    public:
+    
+virtual ~FixedFNNBase() {}
+    
+        static FixedFNNBase* create(const FNN<T>&);
+    
+        static void* operator new(const size_t size) { return SIMD::aligned_alloc(size); }
+        static void  operator delete(void* const p)  { SIMD::aligned_free(p); }
+    
+virtual int classify(const T* const) const = 0;
+
+};
+
+template<typename T, int N0, int N1, int... L>
+class FixedFNNLayers {
+
+    public:
+    
+        typedef typename FixedFNNLayers<T, N1, L...>::Output Output;
+    
+        void copy(const FNN<T>&, const int);
+        void feedforward(const T* const, Output&, const SIMD::Sigmoid) const;
+    
+    private:
+    
+        FixedMatrix<T, N1, N0>      W;      /* weights from N0 to N1 nodes */
+        FixedMatrix<T, N1, 1>       B;      /* biases of the N1 nodes */
+        FixedFNNLayers<T, N1, L...> next;   /* following layers */
+
+};
+
+template<typename T, int N0, int N1>
+class FixedFNNLayers<T, N0, N1> {
+
+    public:
+    
+        typedef FixedMatrix<T, N1, 1> Output;
+    
+        void copy(const FNN<T>&, const int);
+        void feedforward(const T* const, Output&, const SIMD::Sigmoid) const;
+    
+    private:
+    
+        FixedMatrix<T, N1, N0> W;   /* weights from N0 to N1 nodes */
+        FixedMatrix<T, N1, 1>  B;   /* biases of the N1 output nodes */
+
+};
+
+template<typename T, int... L>
+class FixedFNN: public FixedFNNBase<T> {
+
+    public:
+    
+        FixedFNN(const FNN<T>&);
+virtual ~FixedFNN() {}
+    
+        void feedforward(const T* const, typename FixedFNNLayers<T, L...>::Output&) const;
+        int  classify(const T* const) const;
+    
+    private:
+    
+        FixedFNNLayers<T, L...> layers;   /* weights and biases */
+        SIMD::Sigmoid           tier;     /* sigmoid tier, the inference tier of the FNN */
+
+};
+
+
+
+/*
+Creates the fixed network matching the topology of fnn, or returns 0 if
+there is none. The topologies are the ones used in production.
+*/
+template<typename T>
+FixedFNNBase<T>* FixedFNNBase<T>::create(const FNN<T>& fnn) {
+    const std::vector<int> layers = fnn.get_layers();
+    if(layers==std::vector<int>{784, 100, 50, 10}) return new FixedFNN<T, 784, 100, 50, 10>(fnn);
+    if(layers==std::vector<int>{784, 400, 10})     return new FixedFNN<T, 784, 400, 10>(fnn);
+    return 0;
+}
+
+/*
+Copies the weights and biases of the fully connected layer i of fnn, and
+of the following ones.
+*/
+template<typename T, int N0, int N1, int... L>
+void FixedFNNLayers<T, N0, N1, L...>::copy(const FNN<T>& fnn, const int i) {
+    W.copy(*fnn.get_fully_connected_layer(i)->get_weights());
+    B.copy(*fnn.get_fully_connected_layer(i)->get_biases());
+    next.copy(fnn, i+1);
+}
+template<typename T, int N0, int N1>
+void FixedFNNLayers<T, N0, N1>::copy(const FNN<T>& fnn, const int i) {
+    W.copy(*fnn.get_fully_connected_layer(i)->get_weights());
+    B.copy(*fnn.get_fully_connected_layer(i)->get_biases());
+}
+
+/*
+Feedforward from the N0 coefficients of x: the activation of this layer is
+computed on the stack and given to the next one.
+*/
+template<typename T, int N0, int N1, int... L>
+void FixedFNNLayers<T, N0, N1, L...>::feedforward(const T* const x, Output& y, const SIMD::Sigmoid tier) const {
+    FixedMatrix<T, N1, 1> a;
+    a.sigmoid_affine(W, x, B, tier);
+    next.feedforward(a.data(), y, tier);
+}
+template<typename T, int N0, int N1>
+void FixedFNNLayers<T, N0, N1>::feedforward(const T* const x, Output& y, const SIMD::Sigmoid tier) const {
+    y.sigmoid_affine(W, x, B, tier);
+}
+
+/*
+Copies the weights, the biases and the inference tier of fnn, whose
+topology must be L.
+*/
+template<typename T, int... L>
+FixedFNN<T, L...>::FixedFNN(const FNN<T>& fnn) :
+    tier(fnn.get_inference_sigmoid()) {
+    layers.copy(fnn, 0);
+}
+
+/*
+Computes the output of the network for the input x, an array with as many
+coefficients as the input layer has nodes.
+*/
+template<typename T, int... L>
+void FixedFNN<T, L...>::feedforward(const T* const x, typename FixedFNNLayers<T, L...>::Output& y) const {
+    layers.feedforward(x, y, tier);
+}
+
+/*
+Returns the index of the output node with the highest value.
+*/
+template<typename T, int... L>
+int FixedFNN<T, L...>::classify(const T* const x) const {
+    typename FixedFNNLayers<T, L...>::Output y;
+    layers.feedforward(x, y, tier);
+    return y.argmax();
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines a matrix whose dimensions are template parameters. The
+coefficients are stored in the object itself, row by row and aligned on 64
+bytes, so a small FixedMatrix declared in a function lives on the stack and
+a large one lives in the object that contains it: nothing is allocated on
+the heap.
+
+    FixedMatrix<float, 10, 1>   y;            // output of a network
+    FixedMatrix<float, 100, 784> W;           // weights, in a FixedFNN
+
+The dimensions of the operands are checked by the compiler: an operation
+on matrices of incompatible sizes does not compile, so there is no runtime
+check and no exception, except when the coefficients are copied from a
+Matrix. The loops have constant bounds and can be unrolled by the compiler.
+The matrix-vector product and the sigmoid use the vectorized kernels
+selected at startup (see SIMD.hpp), called with constant sizes.
+
+This class only offers what the inference of a network with a fixed
+topology needs (see FixedFNN.hpp). Class Matrix is to be used for
+everything else.
+*/
+
+#ifndef FixedMatrix_hpp
+#define FixedMatrix_hpp
+
+#include "Matrix.hpp"
+#include "SIMD.hpp"
+
+template<typename T, int I, int J>
+class FixedMatrix {
+
+    public:
+    
+        T        operator()(const int i, const int j) const { return coefs[i*J + j]; }
+        T&       operator()(const int i, const int j)       { return coefs[i*J + j]; }
+    
+        const T* data() const { return coefs; }
+        T*       data()       { return coefs; }
+    
+        void     copy(const Matrix<T>&);
+        void     fill(const T);
+        int      argmax() const;
+        void     sigmoid(const SIMD::Sigmoid=SIMD::sigmoid_poly);
+        template<int K>
+        void     sigmoid_affine(const FixedMatrix<T, I, K>&, const T* const, const FixedMatrix<T, I, 1>&, const SIMD::Sigmoid=SIMD::sigmoid_poly);
+    
+    private:
+    
+        alignas(SIMD::alignment) T coefs[I*J];   /* coefficients, row by row */
+
+};
+
+
+
+/*
+Copies the coefficients of M, which must have the same dimensions.
+*/
+template<typename T, int I, int J>
+void FixedMatrix<T, I, J>::copy(const Matrix<T>& M) {
+    if(M.get_I()!=I || M.get_J()!=J) {
+        const std::string desc     = "Unable to copy the matrix to a fixed matrix: dimensions don't match.";
+        const std::string function = "void FixedMatrix<T, I, J>::copy(const Matrix<T>& M)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(I, J, M.get_I(), M.get_J(), function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    for(int i=0 ; i<I ; i++) {
+        for(int j=0 ; j<J ; j++) coefs[i*J + j] = M(i, j);
+    }
+}
+
+/*
+Sets all the coefficients to alpha.
+*/
+template<typename T, int I, int J>
+void FixedMatrix<T, I, J>::fill(const T alpha) {
+    for(int k=0 ; k<I*J ; k++) coefs[k] = alpha;
+}
+
+/*
+Index of the largest coefficient, the first one in case of a tie.
+*/
+template<typename T, int I, int J>
+int FixedMatrix<T, I, J>::argmax() const {
+    int kmax = 0;
+    for(int k=1 ; k<I*J ; k++) { if(coefs[k]>coefs[kmax]) kmax = k; }
+    return kmax;
+}
+
+/*
+Applies the sigmoid function to every coefficient, with the given tier.
+*/
+template<typename T, int I, int J>
+void FixedMatrix<T, I, J>::sigmoid(const SIMD::Sigmoid tier) {
+    SIMD::kernels<T>().sigmoid[tier](I*J, coefs);
+}
+
+/*
+Computes sigmoid(W*x + B) in this column vector, x being an array of K
+coefficients. The product and the bias are computed by one matrix-vector
+product followed by a single pass on the result, as in Matrix.
+*/
+template<typename T, int I, int J>
+template<int K>
+void FixedMatrix<T, I, J>::sigmoid_affine(const FixedMatrix<T, I, K>& W, const T* const x, const FixedMatrix<T, I, 1>& B, const SIMD::Sigmoid tier) {
+    static_assert(J==1, "sigmoid_affine computes a column vector");
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    kernels.gemv(I, K, W.data(), K, x, coefs);
+    kernels.bias_sigmoid[tier](I, B.data(), coefs);
+}
+
+#endif
@@ -0,0 +1,493 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines the engine used by class Matrix to compute products of
+matrices. It works on raw row-major arrays of coefficients and computes
+
+        C = alpha * op(A) * op(B) + beta * C
+
+where op(X) is either X or X^t. op(A) has M rows and K columns, op(B) has
+K rows and N columns and C has M rows and N columns. The leading dimensions
+lda, ldb and ldc give the distance between two consecutive rows in memory.
+
+The general case follows the usual structure of high performance gemm
+implementations:
+
+        for every block of NC columns of op(B)             (L3)
+            for every block of KC rows of op(B)            (L2/L1)
+                pack the KC*NC block of op(B) in slivers of NR columns
+                for every block of MC rows of op(A)        (L2)
+                    pack the MC*KC block of op(A) in slivers of MR rows
+                    for every MR*NR tile of C:
+                        run the micro-kernel
+
+Packing copies the blocks in the exact order the micro-kernel reads them,
+so the micro-kernel only reads contiguous memory whatever the transposition
+of A and B. The micro-kernel keeps the MR*NR tile of C in registers during
+the whole loop over KC. Packed blocks are padded with zeros, so tiles on the
+edges of C are computed as full tiles and only the valid part is written.
+
+Matrix-vector products (N=1 or M=1) and outer products (K=1) do not benefit
+from packing and are dispatched to dedicated loops. So are the products
+with fewer columns than half a tile, for instance the products of a layer
+with a small batch: most of the tiles would be padding, so they are
+computed as one matrix-vector product per column.
+
+gemv_sigmoid_prime computes the error of a layer in the backpropagation,
+y = (op(A)*x)°a°(1-a), a being the output of a sigmoid, in one pass over A:
+the derivative of the sigmoid is applied while the last row of A is added
+to y, or right after the dot products, so no other vector is written.
+
+gemm_half computes the same product with A stored in 16 bits (see Half.hpp).
+A is converted to T while it is packed, or in registers by the matrix-vector
+kernels, so the products are accumulated in T.
+
+The micro-kernel and its tile size (MR and NR) come from the table of
+vectorized kernels selected at startup (see SIMD.hpp), so are the loops
+used for matrix-vector products.
+
+The packing buffers are aligned on cache lines and thread local, so that
+the engine can be used by multiple training threads at the same time.
+
+When the program is built with a BLAS library, the general products, the
+matrix-vector products and the rank-1 updates in float and double are
+computed by this library instead (see Blas.hpp), unless the built-in engine
+is selected.
+
+Products with at least parallel_threshold multiply-adds are split over the
+threads of the pool (see ThreadPool.hpp) when it has more than one thread.
+General products are split over the rows of C, or over its columns when C
+is wider than tall, in multiples of the tile size. Every part packs its own
+blocks. Matrix-vector and outer products are split over the rows of the
+result. Smaller products stay on the calling thread, where waking up the
+pool would cost more than it saves.
+*/
+
+#ifndef Gemm_hpp
+#define Gemm_hpp
+
+#include <algorithm>
+#include <vector>
+
+#include "Blas.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+template<typename T>
+class Gemm {
+
+    public:
+
+        static void gemm(const bool, const bool, const int, const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int);
+        static void gemv(const bool, const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int);
+        static void ger(const int, const int, const T, const T* const, const int, const T* const, const int, const T, T* const, const int);
+        static void gemv_sigmoid_prime(const bool, const int, const int, const T* const, const int, const T* const, const int, const T* const, const int, T* const, const int);
+        template<typename H>
+        static void gemm_half(const bool, const bool, const int, const int, const int, const T, const H* const, const int, const T* const, const int, const T, T* const, const int);
+
+        static const int KC      = 256;   /* depth of the packed blocks */
+        static const int MC_ROWS = 24;    /* rows of the packed blocks of A, in number of MR */
+        static const int NC_COLS = 128;   /* columns of the packed blocks of B, in number of NR */
+
+        static const long parallel_threshold = 1 << 17;   /* multiply-adds from which a product uses the thread pool */
+
+    private:
+
+        static bool parallel(const long work) { return work>=parallel_threshold && ThreadPool::get_nb_threads()>1; }
+        template<typename S>
+        static void gemm_parallel(const bool, const bool, const int, const int, const int, const T, const S* const, const int, const T* const, const int, const T, T* const, const int);
+        template<typename S>
+        static void gemm_blocks(const bool, const bool, const int, const int, const int, const T, const S* const, const int, const T* const, const int, const T, T* const, const int);
+        template<typename H>
+        static void gemv_half(const int, const int, const T, const H* const, const int, const T* const, const int, const T, T* const, const int);
+        template<typename S>
+        static void pack_A(const int, const bool, const int, const int, const S* const, const int, T* const);
+        static void pack_B(const int, const bool, const int, const int, const T* const, const int, T* const);
+        static void store_tile(const int, const int, const int, const T, const T* const, const T, T* const, const int);
+        static void scale(const int, const int, const T, T* const, const int);
+        static void update_vector(const int, const T, const T* const, const T, T* const, const int);
+
+};
+
+template<typename T> const int  Gemm<T>::KC;
+template<typename T> const long Gemm<T>::parallel_threshold;
+
+
+
+/*
+Computes C = alpha * op(A) * op(B) + beta * C. When beta is 0, C does not
+need to be initialized. op(A) is A^t if transA is true, op(B) is B^t if
+transB is true.
+*/
+template<typename T>
+void Gemm<T>::gemm(const bool transA, const bool transB, const int M, const int N, const int K, const T alpha, const T* const A, const int lda, const T* const B, const int ldb, const T beta, T* const C, const int ldc) {
+    if(M<=0 || N<=0) return;
+    if(K<=0 || alpha==0) { scale(M, N, beta, C, ldc); return; }
+    /* matrix-vector and outer products */
+    if(N==1) { gemv(transA, M, K, alpha, A, lda, B, transB ? 1 : ldb, beta, C, ldc); return; }
+    if(M==1) { gemv(!transB, N, K, alpha, B, ldb, A, transA ? lda : 1, beta, C, 1); return; }
+    if(K==1) { ger(M, N, alpha, A, transA ? 1 : lda, B, transB ? ldb : 1, beta, C, ldc); return; }
+    if(Blas::gemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc)) return;
+    if(2*N<=SIMD::kernels<T>().nr) {
+        for(int j=0 ; j<N ; j++) gemv(transA, M, K, alpha, A, lda, transB ? B + j*ldb : B + j, transB ? 1 : ldb, beta, C + j, ldc);
+        return;
+    }
+    gemm_parallel(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+/*
+Computes C = alpha * op(A) * op(B) + beta * C like gemm, A being stored in
+16 bits (Float16 or BFloat16). Matrix-vector products use the kernels in 16
+bits, the other products go through the packed blocks, A being converted to
+T while it is packed.
+*/
+template<typename T>
+template<typename H>
+void Gemm<T>::gemm_half(const bool transA, const bool transB, const int M, const int N, const int K, const T alpha, const H* const A, const int lda, const T* const B, const int ldb, const T beta, T* const C, const int ldc) {
+    if(M<=0 || N<=0) return;
+    if(K<=0 || alpha==0) { scale(M, N, beta, C, ldc); return; }
+    if(N==1 && !transA) { gemv_half(M, K, alpha, A, lda, B, transB ? 1 : ldb, beta, C, ldc); return; }
+    gemm_parallel(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+/*
+General case of gemm, A having coefficients of type S. Large products are
+split over the threads.
+*/
+template<typename T>
+template<typename S>
+void Gemm<T>::gemm_parallel(const bool transA, const bool transB, const int M, const int N, const int K, const T alpha, const S* const A, const int lda, const T* const B, const int ldb, const T beta, T* const C, const int ldc) {
+    /* large products are split over the rows or the columns of C */
+    if(parallel(static_cast<long>(M)*N*K)) {
+        const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+        if(M>=N) {
+            ThreadPool::parallel_for(M, kernels.mr, [&](const int begin, const int end) {
+                gemm_blocks(transA, transB, end-begin, N, K, alpha, transA ? A + begin : A + begin*lda, lda, B, ldb, beta, C + begin*ldc, ldc);
+            });
+        }
+        else {
+            ThreadPool::parallel_for(N, kernels.nr, [&](const int begin, const int end) {
+                gemm_blocks(transA, transB, M, end-begin, K, alpha, A, lda, transB ? B + begin*ldb : B + begin, ldb, beta, C + begin, ldc);
+            });
+        }
+        return;
+    }
+    gemm_blocks(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+/*
+General case of gemm, on the calling thread.
+*/
+template<typename T>
+template<typename S>
+void Gemm<T>::gemm_blocks(const bool transA, const bool transB, const int M, const int N, const int K, const T alpha, const S* const A, const int lda, const T* const B, const int ldb, const T beta, T* const C, const int ldc) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    const int             MR      = kernels.mr;
+    const int             NR      = kernels.nr;
+    const int             MC      = MC_ROWS*MR;
+    const int             NC      = NC_COLS*NR;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_A;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_B;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_tile;
+    if(buffer_A.size()<static_cast<size_t>(MC*KC))     buffer_A.resize(MC*KC);
+    if(buffer_B.size()<static_cast<size_t>(KC*NC))     buffer_B.resize(KC*NC);
+    if(buffer_tile.size()<static_cast<size_t>(MR*NR)) buffer_tile.resize(MR*NR);
+    T* const Ap   = buffer_A.data();
+    T* const Bp   = buffer_B.data();
+    T* const tile = buffer_tile.data();
+    for(int jc=0 ; jc<N ; jc+=NC) {
+        const int nc = std::min(NC, N-jc);
+        for(int pc=0 ; pc<K ; pc+=KC) {
+            const int kc = std::min(KC, K-pc);
+            /* the first block along K applies beta, the next ones accumulate */
+            const T   beta_block = pc==0 ? beta : static_cast<T>(1);
+            /* B(pc:pc+kc, jc:jc+nc) */
+            pack_B(NR, transB, kc, nc, transB ? B + jc*ldb + pc : B + pc*ldb + jc, ldb, Bp);
+            for(int ic=0 ; ic<M ; ic+=MC) {
+                const int mc = std::min(MC, M-ic);
+                /* A(ic:ic+mc, pc:pc+kc) */
+                pack_A(MR, transA, mc, kc, transA ? A + pc*lda + ic : A + ic*lda + pc, lda, Ap);
+                for(int jr=0 ; jr<nc ; jr+=NR) {
+                    const int nr = std::min(NR, nc-jr);
+                    for(int ir=0 ; ir<mc ; ir+=MR) {
+                        const int mr = std::min(MR, mc-ir);
+                        kernels.micro_kernel(kc, Ap + ir*kc, Bp + jr*kc, tile);
+                        store_tile(NR, mr, nr, alpha, tile, beta_block, C + (ic+ir)*ldc + jc+jr, ldc);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+Matrix-vector product y = alpha * op(A) * x + beta * y, op(A) having M rows
+and K columns. incx and incy are the distances between two consecutive
+coefficients of x and y.
+*/
+template<typename T>
+void Gemm<T>::gemv(const bool transA, const int M, const int K, const T alpha, const T* const A, const int lda, const T* const x, const int incx, const T beta, T* const y, const int incy) {
+    if(M<=0) return;
+    if(K<=0 || alpha==0) { scale(M, 1, beta, y, incy); return; }
+    if(Blas::gemv(transA, M, K, alpha, A, lda, x, incx, beta, y, incy)) return;
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    /* contiguous copy of x if needed */
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_x;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_y;
+    const T* xc = x;
+    if(incx!=1) {
+        if(buffer_x.size()<static_cast<size_t>(K)) buffer_x.resize(K);
+        for(int k=0 ; k<K ; k++) buffer_x[k] = x[k*incx];
+        xc = buffer_x.data();
+    }
+    /* the result is written directly to y when no scaling is needed */
+    const bool direct = incy==1 && alpha==1 && beta==0;
+    if(!direct && buffer_y.size()<static_cast<size_t>(M)) buffer_y.resize(M);
+    T* const yc = direct ? y : buffer_y.data();
+    /* coefficients begin to end-1 of op(A)*x, split over the threads when large */
+    const auto product = [&](const int begin, const int end) {
+        if(!transA) {
+            /* dot products of the rows of A with x */
+            kernels.gemv(end-begin, K, A + begin*lda, lda, xc, yc + begin);
+        }
+        else {
+            /* op(A) = A^t: y is a linear combination of the rows of A */
+            kernels.fill(end-begin, 0, yc + begin);
+            for(int k=0 ; k<K ; k++) {
+                if(xc[k]!=0) kernels.axpy(end-begin, xc[k], A + k*lda + begin, yc + begin);
+            }
+        }
+    };
+    if(parallel(static_cast<long>(M)*K)) ThreadPool::parallel_for(M, SIMD::alignment/static_cast<int>(sizeof(T)), product);
+    else                                 product(0, M);
+    if(!direct) update_vector(M, alpha, yc, beta, y, incy);
+}
+
+/*
+Computes y = (op(A)*x)°a°(1-a), op(A) having M rows and K columns. When
+op(A) is A^t, y is a linear combination of the rows of A and the derivative
+is applied together with the last one. Otherwise the derivative is applied
+to every part of y right after its dot products, while it is in cache. y
+does not need to be initialized and must not overlap x or a. The built-in
+kernels are used whatever the engine, a BLAS library cannot fuse the
+derivative into the product.
+*/
+template<typename T>
+void Gemm<T>::gemv_sigmoid_prime(const bool transA, const int M, const int K, const T* const A, const int lda, const T* const x, const int incx, const T* const a, const int inca, T* const y, const int incy) {
+    if(M<=0) return;
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_x;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_a;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_y;
+    const T* xc = x;
+    const T* ac = a;
+    if(incx!=1) {
+        if(buffer_x.size()<static_cast<size_t>(K)) buffer_x.resize(K);
+        for(int k=0 ; k<K ; k++) buffer_x[k] = x[k*incx];
+        xc = buffer_x.data();
+    }
+    if(inca!=1) {
+        if(buffer_a.size()<static_cast<size_t>(M)) buffer_a.resize(M);
+        for(int i=0 ; i<M ; i++) buffer_a[i] = a[i*inca];
+        ac = buffer_a.data();
+    }
+    if(incy!=1 && buffer_y.size()<static_cast<size_t>(M)) buffer_y.resize(M);
+    T* const yc = incy==1 ? y : buffer_y.data();
+    /* coefficients begin to end-1 of y, split over the threads when large */
+    const auto product = [&](const int begin, const int end) {
+        const int n = end - begin;
+        if(K<=0) {
+            kernels.fill(n, 0, yc + begin);
+        }
+        else if(!transA) {
+            kernels.gemv(n, K, A + begin*lda, lda, xc, yc + begin);
+            kernels.axpy_sigmoid_prime(n, 0, ac + begin, ac + begin, yc + begin);
+        }
+        else {
+            kernels.fill(n, 0, yc + begin);
+            for(int k=0 ; k<K-1 ; k++) {
+                if(xc[k]!=0) kernels.axpy(n, xc[k], A + k*lda + begin, yc + begin);
+            }
+            kernels.axpy_sigmoid_prime(n, xc[K-1], A + (K-1)*lda + begin, ac + begin, yc + begin);
+        }
+    };
+    if(parallel(static_cast<long>(M)*K)) ThreadPool::parallel_for(M, SIMD::alignment/static_cast<int>(sizeof(T)), product);
+    else                                 product(0, M);
+    if(incy!=1) for(int i=0 ; i<M ; i++) y[i*incy] = yc[i];
+}
+
+/*
+Matrix-vector product y = alpha * A * x + beta * y, A having M rows and K
+columns stored in 16 bits. The rows of A are converted in registers.
+*/
+template<typename T>
+template<typename H>
+void Gemm<T>::gemv_half(const int M, const int K, const T alpha, const H* const A, const int lda, const T* const x, const int incx, const T beta, T* const y, const int incy) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    const uint16_t* const Ab      = reinterpret_cast<const uint16_t*>(A);
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_x;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_y;
+    const T* xc = x;
+    if(incx!=1) {
+        if(buffer_x.size()<static_cast<size_t>(K)) buffer_x.resize(K);
+        for(int k=0 ; k<K ; k++) buffer_x[k] = x[k*incx];
+        xc = buffer_x.data();
+    }
+    const bool direct = incy==1 && alpha==1 && beta==0;
+    if(!direct && buffer_y.size()<static_cast<size_t>(M)) buffer_y.resize(M);
+    T* const yc = direct ? y : buffer_y.data();
+    const auto product = [&](const int begin, const int end) {
+        kernels.gemv_half[H::format](end-begin, K, Ab + begin*lda, lda, xc, yc + begin);
+    };
+    if(parallel(static_cast<long>(M)*K)) ThreadPool::parallel_for(M, SIMD::alignment/static_cast<int>(sizeof(T)), product);
+    else                                 product(0, M);
+    if(!direct) update_vector(M, alpha, yc, beta, y, incy);
+}
+
+/*
+Outer product C = alpha * x * y^t + beta * C, x having M coefficients and y
+having N coefficients.
+*/
+template<typename T>
+void Gemm<T>::ger(const int M, const int N, const T alpha, const T* const x, const int incx, const T* const y, const int incy, const T beta, T* const C, const int ldc) {
+    if(Blas::ger(M, N, alpha, x, incx, y, incy, beta, C, ldc)) return;
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer_y;
+    const T* yc = y;
+    if(incy!=1) {
+        if(buffer_y.size()<static_cast<size_t>(N)) buffer_y.resize(N);
+        for(int j=0 ; j<N ; j++) buffer_y[j] = y[j*incy];
+        yc = buffer_y.data();
+    }
+    /* rows begin to end-1 of C, split over the threads when large */
+    const auto rows = [&](const int begin, const int end) {
+        for(int i=begin ; i<end ; i++) {
+            const T  xi = alpha*x[i*incx];
+            T* const ci = C + i*ldc;
+            if(beta==1) kernels.axpy(N, xi, yc, ci);
+            else        kernels.axpby(N, xi, yc, beta, ci);
+        }
+    };
+    if(parallel(static_cast<long>(M)*N)) ThreadPool::parallel_for(M, 1, rows);
+    else                                 rows(0, M);
+}
+
+/*
+Packs a block of op(A) with mc rows and kc columns in slivers of MR rows.
+In a sliver, the MR coefficients of a column are contiguous. The last
+sliver is padded with zeros.
+*/
+template<typename T>
+template<typename S>
+void Gemm<T>::pack_A(const int MR, const bool transA, const int mc, const int kc, const S* const A, const int lda, T* const Ap) {
+    T* dst = Ap;
+    for(int i=0 ; i<mc ; i+=MR) {
+        const int mr = std::min(MR, mc-i);
+        if(!transA) {
+            for(int k=0 ; k<kc ; k++) {
+                int ii = 0;
+                for( ; ii<mr ; ii++) dst[ii] = static_cast<T>(A[(i+ii)*lda + k]);
+                for( ; ii<MR ; ii++) dst[ii] = 0;
+                dst += MR;
+            }
+        }
+        else {
+            for(int k=0 ; k<kc ; k++) {
+                const S* const src = A + k*lda + i;
+                int ii = 0;
+                for( ; ii<mr ; ii++) dst[ii] = static_cast<T>(src[ii]);
+                for( ; ii<MR ; ii++) dst[ii] = 0;
+                dst += MR;
+            }
+        }
+    }
+}
+
+/*
+Packs a block of op(B) with kc rows and nc columns in slivers of NR columns.
+In a sliver, the NR coefficients of a row are contiguous. The last sliver
+is padded with zeros.
+*/
+template<typename T>
+void Gemm<T>::pack_B(const int NR, const bool transB, const int kc, const int nc, const T* const B, const int ldb, T* const Bp) {
+    T* dst = Bp;
+    for(int j=0 ; j<nc ; j+=NR) {
+        const int nr = std::min(NR, nc-j);
+        if(!transB) {
+            for(int k=0 ; k<kc ; k++) {
+                const T* const src = B + k*ldb + j;
+                int jj = 0;
+                for( ; jj<nr ; jj++) dst[jj] = src[jj];
+                for( ; jj<NR ; jj++) dst[jj] = 0;
+                dst += NR;
+            }
+        }
+        else {
+            for(int k=0 ; k<kc ; k++) {
+                int jj = 0;
+                for( ; jj<nr ; jj++) dst[jj] = B[(j+jj)*ldb + k];
+                for( ; jj<NR ; jj++) dst[jj] = 0;
+                dst += NR;
+            }
+        }
+    }
+}
+
+/*
+Writes the valid part (mr rows and nr columns) of a tile to C:
+C = alpha * tile + beta * C.
+*/
+template<typename T>
+void Gemm<T>::store_tile(const int NR, const int mr, const int nr, const T alpha, const T* const tile, const T beta, T* const C, const int ldc) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    for(int ii=0 ; ii<mr ; ii++) {
+        if(beta==1) kernels.axpy(nr, alpha, tile + ii*NR, C + ii*ldc);
+        else        kernels.axpby(nr, alpha, tile + ii*NR, beta, C + ii*ldc);
+    }
+}
+
+/*
+y = alpha * yc + beta * y, yc being contiguous and y having a stride of incy.
+When beta is 0, y is not read.
+*/
+template<typename T>
+void Gemm<T>::update_vector(const int M, const T alpha, const T* const yc, const T beta, T* const y, const int incy) {
+    if(incy==1)      { SIMD::kernels<T>().axpby(M, alpha, yc, beta, y); }
+    else if(beta==0) { for(int i=0 ; i<M ; i++) y[i*incy] = alpha*yc[i]; }
+    else             { for(int i=0 ; i<M ; i++) y[i*incy] = alpha*yc[i] + beta*y[i*incy]; }
+}
+
+/*
+C = beta * C. Used when the product itself is zero.
+*/
+template<typename T>
+void Gemm<T>::scale(const int M, const int N, const T beta, T* const C, const int ldc) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    for(int i=0 ; i<M ; i++) {
+        if(N==1) { if(beta==0) C[i*ldc] = 0; else C[i*ldc] *= beta; }
+        else if(beta==0) kernels.fill(N, 0, C + i*ldc);
+        else             kernels.scale(N, beta, C + i*ldc);
+    }
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines the types of the coefficients stored in 16 bits: Float16
+(IEEE half precision, fp16) and BFloat16 (bfloat16, bf16). See SIMD.hpp for
+their accuracy. They only store numbers: they are converted from and to
+float, rounded to the nearest, and all the computations are done in float.
+
+They can be used as the coefficients of a Matrix, to halve the memory taken
+by a matrix and the bandwidth needed to read it:
+
+    Matrix<BFloat16> W16(W.get_I(), W.get_J());
+    for(int i=0 ; i<W.get_I() ; i++) {
+        for(int j=0 ; j<W.get_J() ; j++) W16(i, j) = W(i, j);
+    }
+
+Such a matrix has no arithmetic of its own. Its products are computed by
+Gemm::gemm_half, which converts the coefficients in registers and
+accumulates in float. An array of Float16 or BFloat16 has the layout of an
+array of uint16_t, which is how the kernels read it.
+*/
+
+#ifndef Half_hpp
+#define Half_hpp
+
+#include <cstdint>
+
+#include "SIMD.hpp"
+
+template<SIMD::Half h>
+class Half16 {
+
+    public:
+    
+        static const SIMD::Half format = h;
+    
+        Half16() {}
+        Half16(const float x) : bits(SIMD::float_to_half(h, x)) {}
+    
+        operator float() const { return SIMD::half_to_float(h, bits); }
+    
+        uint16_t bits;   /* the coefficient in format h */
+
+};
+
+typedef Half16<SIMD::half_fp16> Float16;
+typedef Half16<SIMD::half_bf16> BFloat16;
+
+static_assert(sizeof(Float16)==sizeof(uint16_t) && sizeof(BFloat16)==sizeof(uint16_t), "coefficients in 16 bits must be stored in 16 bits");
+
+template<SIMD::Half h> const SIMD::Half Half16<h>::format;
+
+#endif
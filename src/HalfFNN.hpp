@@ -0,0 +1,175 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines copies of feedforward neural networks whose weights are
+stored in 16 bits, for inference only. They are created from a trained FNN,
+from which they convert the weights and copy the biases and the inference
+sigmoid tier:
+
+    HalfFNNBase<float>* net = HalfFNNBase<float>::create(fnn, SIMD::half_bf16);
+    int digit = net->classify(pixels);
+
+The weights are Matrix<Float16> or Matrix<BFloat16> objects (see Half.hpp),
+half the size of the original ones. Inference is limited by the bandwidth
+needed to read the weights, so a network in 16 bits reads half the memory
+per picture. The products are computed by Gemm::gemm_half, which converts
+the weights in registers and accumulates in T. The biases and the
+activations stay in T.
+
+The format of the weights is chosen at runtime, so the networks are used
+through the abstract class HalfFNNBase:
+
+                     ---------------
+                     | HalfFNNBase |
+                     ---------------
+                            ^
+                            |
+                 -------------------------
+                 | HalfFNN<T, Float16>   |  ...
+                 -------------------------
+
+Rounding the weights changes the outputs of the network slightly. The
+accuracy lost on the testing set is reported by DigitScanner::test. The
+network is a copy: it must be created again when the FNN is trained.
+*/
+
+#ifndef HalfFNN_hpp
+#define HalfFNN_hpp
+
+#include <algorithm>
+#include <vector>
+
+#include "FNN.hpp"
+#include "Gemm.hpp"
+#include "Half.hpp"
+#include "Matrix.hpp"
+
+template<typename T>
+class HalfFNNBase {
+
+    public:
+    
+virtual ~HalfFNNBase() {}
+    
+        static HalfFNNBase* create(const FNN<T>&, const SIMD::Half);
+    
+virtual int    classify(const T* const) const = 0;
+virtual size_t get_weights_size() const = 0;
+
+};
+
+template<typename T, typename H>
+class HalfFNN: public HalfFNNBase<T> {
+
+    public:
+    
+        HalfFNN(const FNN<T>&);
+virtual ~HalfFNN() {}
+    
+        int    classify(const T* const) const;
+        size_t get_weights_size() const;
+    
+    private:
+    
+        std::vector<int>       layers;    /* number of nodes of every layer */
+        std::vector<Matrix<H>> weights;   /* weights of the fully connected layers, in 16 bits */
+        std::vector<Matrix<T>> biases;    /* biases of the fully connected layers */
+        int                    width;     /* largest number of nodes after the input layer */
+        SIMD::Sigmoid          tier;      /* sigmoid tier, the inference tier of the FNN */
+
+};
+
+
+
+/*
+Creates the copy of fnn with its weights in the format given.
+*/
+template<typename T>
+HalfFNNBase<T>* HalfFNNBase<T>::create(const FNN<T>& fnn, const SIMD::Half format) {
+    if(format==SIMD::half_bf16) return new HalfFNN<T, BFloat16>(fnn);
+    else                        return new HalfFNN<T, Float16>(fnn);
+}
+
+/*
+Converts the weights of every fully connected layer of fnn to 16 bits, row
+by row, and copies the biases.
+*/
+template<typename T, typename H>
+HalfFNN<T, H>::HalfFNN(const FNN<T>& fnn) :
+    layers(fnn.get_layers()),
+    width(0),
+    tier(fnn.get_inference_sigmoid()) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    for(size_t i=0 ; i+1<layers.size() ; i++) {
+        const Matrix<T>& W = *fnn.get_fully_connected_layer(i)->get_weights();
+        Matrix<H>        W16(W.get_I(), W.get_J());
+        std::vector<T>   row(W.get_J());
+        for(int r=0 ; r<W.get_I() ; r++) {
+            /* the rows of a transposed matrix are not contiguous */
+            const T* src = W.data() + r*W.get_ld();
+            if(W.is_transposed()) {
+                for(int k=0 ; k<W.get_J() ; k++) row[k] = W(r, k);
+                src = row.data();
+            }
+            kernels.to_half[H::format](W.get_J(), src, reinterpret_cast<uint16_t*>(&W16(r, 0)));
+        }
+        weights.push_back(W16);
+        biases.push_back(Matrix<T>(fnn.get_fully_connected_layer(i)->get_biases(), true));
+        width = std::max(width, layers[i+1]);
+    }
+}
+
+/*
+Returns the index of the output node with the highest value for the input
+x, an array with as many coefficients as the input layer has nodes. The
+activations go back and forth between two halves of a buffer of the thread.
+*/
+template<typename T, typename H>
+int HalfFNN<T, H>::classify(const T* const x) const {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer;
+    if(buffer.size()<static_cast<size_t>(2*width)) buffer.resize(2*width);
+    const T* a = x;
+    T*       y = buffer.data();
+    for(size_t i=0 ; i<weights.size() ; i++) {
+        Gemm<T>::gemm_half(false, false, layers[i+1], 1, layers[i], 1, weights[i].data(), weights[i].get_ld(), a, 1, 0, y, 1);
+        kernels.bias_sigmoid[tier](layers[i+1], biases[i].data(), y);
+        a = y;
+        y = y==buffer.data() ? buffer.data() + width : buffer.data();
+    }
+    int kmax = 0;
+    for(int k=1 ; k<layers.back() ; k++) { if(a[k]>a[kmax]) kmax = k; }
+    return kmax;
+}
+
+/*
+Size of the weights in bytes, padding included.
+*/
+template<typename T, typename H>
+size_t HalfFNN<T, H>::get_weights_size() const {
+    size_t size = 0;
+    for(const Matrix<H>& W : weights) size += static_cast<size_t>(W.get_I())*W.get_ld()*sizeof(H);
+    return size;
+}
+
+#endif
@@ -24,7 +24,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 This class defines a matrix and operations that can be applied to it.
 Matrices defined with this class are pointers. They all point to an
 array of coefficients. One array of coefficients in memory can be
-common to several matrices.
+common to several matrices. The array counts the matrices pointing to it
+and is deleted with the last one.
 
 This was intented for the following reasons. Doing so avoids allocating
 and freeing memory when objects are copied. This could, of course, have
@@ -58,23 +59,100 @@ Creating a new matrix:
     This creates a "deep copy" of M2.
 
 Using the simple operators + - *:
-    When using these operators, a new matrix is created in memory and returned.
-    This can be inneficient if called many times. Instead, if possible, prefer
-    the +=, -= and *=, operators that use the existing matrices in memory to
-    do the computation.
+    These operators do not compute anything. They return an expression that
+    is evaluated when it is assigned to a matrix, in a single pass and without
+    intermediate matrices (see MatrixExpr.hpp). The code can follow the math:
+        D  = hadamard(transpose(W)*D, hadamard(A, 1 - A));
+        W -= eta*NW;
+    Assigning an expression with = allocates a new matrix of coefficients,
+    while +=, -= and the constructor of a new matrix do not allocate more.
+
+Products of matrices:
+    Products are computed by the cache-blocked gemm engine defined in Gemm.hpp.
+    Transposed matrices are read in place, no transposed copy is created.
+    The function gemm gives direct access to the engine, as in BLAS: it
+    computes C = alpha*op(A)*op(B) + beta*C in the coefficients of C, op(X)
+    being X or its transposed depending on a flag:
+        NCW.gemm(1, D, false, A, true, 1);      // NCW += D*transpose(A)
+    The function ger accumulates a rank-1 update, or a rank-k update when
+    the vectors have k columns, in place:
+        NCW.ger(1, D, A);                       // NCW += D*transpose(A)
+    The function sigmoid_backward computes the error of the previous layer
+    in the backpropagation, with the derivative of the sigmoid applied in
+    the same pass over W as the product:
+        D_previous.sigmoid_backward(W, D, A);   // (W^t*D)°A°(1-A)
+
+Vectorized kernels:
+    The element-wise operations (fill, +=, -=, *= by a scalar, Hadamard product
+    and sigmoid) use the SSE4.1, AVX2 or AVX-512 kernels selected at startup
+    (see SIMD.hpp). Any other function can be applied element-wise with map
+    and zip, compiled for the same instruction sets (see MatrixExpr.hpp):
+        A.map([](const T x) { return x>0 ? x : 0; });
+        W.zip(W, NW, [=](const T w, const T nw) { return decay*w - eta*nw; });
+    The sigmoid can be computed with several accuracy tiers, from the exact
+    function of the C library to a lookup table; by default, it uses a
+    vectorized polynomial exponential with an absolute error below 1e-7 in
+    float.
  
 Memory freeing:
-    When not used anymore, you need to manually delete the matrix' coefficients.
-    You can do so by calling free() on that matrix. Be careful though that a
-    call to free will delete the coefficients of all the matrices that were
-    poiting to these coefficients in memory.
+    The array of coefficients is reference counted: it is deleted when the
+    last matrix pointing to it is destroyed, so there is nothing to free by
+    hand, even when an exception is thrown. Calling free() on a matrix only
+    releases its own reference early, the other matrices pointing to the same
+    coefficients keep them. Matrices can be moved (std::move) to hand their
+    coefficients over without touching the counter.
+    
+Memory allocation:
+    The arrays of coefficients are allocated on the heap, or in the arena of
+    the current thread when an arena scope is open (see MatrixArena.hpp).
+    The scratch matrix of a product computed in place by *= is allocated in
+    the arena of the thread. Training allocates nothing per batch: it works
+    in matrices allocated once for the whole training (see FNN.hpp).
     
 Function names:
     Functions element_wise_product, sigmoid, transpose, and functions whose
     name begin with 'self' are computed on the matrix. No additional memory is
     allocated. Functions whose name begin with 'create' dupplicate the matrix
     before performing the computation, then return this matrix. They do not
-    modify the original matrix but consume more memory.
+    modify the original matrix but consume more memory. Functions whose name
+    ends with 'into' (gemm_into, add_into, sub_into, hadamard_into,
+    scale_into, copy_into, transpose_into, sigmoid_into) write their result
+    to the matrix given as first argument and never allocate memory:
+        gemm_into(C, A, B);                     // C = A*B
+        sub_into(D, A, Y);                      // D = A - Y
+    
+Memory layout:
+    The coefficients are stored row by row in an array aligned on 64 bytes.
+    The distance between two rows, the leading dimension ld, is the number of
+    columns rounded up to a multiple of 64 bytes, so that every row starts on
+    a cache line and vector loads never straddle two of them. Column vectors
+    are not padded. The coefficients of the padding are never read. The
+    kernels work row by row, or on the whole array at once when there is no
+    padding. Transposed matrices keep the layout of the original one. The
+    array and the leading dimension are given by data and get_ld, to call the
+    kernels directly.
+    
+Concurrent access:
+    A matrix written by a thread while others read it, like the weights shared
+    by the hogwild training threads, must only be accessed with relaxed atomic
+    operations, which compile to plain loads and stores but are not vectorized:
+        W_copy.load_relaxed(W);                 // W_copy = W, W read atomically
+        W.zip_relaxed(NW, [=](const T w, const T nw) { return w - eta*nw; }, &W_copy);
+    The last argument of zip_relaxed, optional, receives a copy of the new
+    coefficients. Every coefficient is read and written atomically, but
+    zip_relaxed is not a read-modify-write operation: two threads updating
+    the same coefficient at the same time may overwrite each other's update.
+    
+    The coefficients can also be stored in 16 bits, with T being Float16 or
+    BFloat16 (see Half.hpp). Such matrices only store coefficients, their
+    products are computed by Gemm::gemm_half.
+    
+Views:
+    A block of a matrix, one of its rows or columns, or an external buffer
+    can be addressed as a matrix without copying anything with the class
+    MatrixView (see MatrixView.hpp). A view does not own its coefficients,
+    its leading dimension is the one of the viewed matrix. A matrix copied
+    from a view, without deep copy, points at the same coefficients.
     
 Matrix initialization:
     When creating a matrix, if this matrix is not a copy of another one, memory
@@ -92,11 +170,27 @@ Exceptions:
 #ifndef Matrix_hpp
 #define Matrix_hpp
 
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <new>
 #include <sstream>
+#include <utility>
+
+#include "Gemm.hpp"
+#include "MatrixArena.hpp"
+#include "MatrixExpr.hpp"
+#include "SIMD.hpp"
+
+template<typename T> class MatrixView;
+template<typename T> class SparseMatrix;
 
 template<typename T>
-class Matrix {
+class Matrix: public MatrixExpr<T, Matrix<T>> {
+
+    friend class MatrixLeaf<T>;
+    friend class MatrixView<T>;
+    friend class SparseMatrix<T>;
 
     public:
     
@@ -106,42 +200,62 @@ class Matrix {
         Matrix(const int, const int);
         Matrix(const Matrix&, const bool=false);
         Matrix(const Matrix* const, const bool=false);
+        Matrix(Matrix&&);
+        template<typename E>
+        Matrix(const MatrixExpr<T, E>&);
         ~Matrix();
     
         void       set_dimensions(const int, const int);
     
         Matrix&    operator=(const Matrix& B);
+        Matrix&    operator=(Matrix&& B);
+        template<typename E>
+        Matrix&    operator=(const MatrixExpr<T, E>&);
+        template<typename E>
+        void       assign(const MatrixExpr<T, E>&);
     
         const bool operator==(const Matrix& B) const;
         const bool operator==(const Matrix* const B) const;
     
         const int  get_I() const { if(transpose) return J; else return I; }
         const int  get_J() const { if(transpose) return I; else return J; }
+        const int  get_ld() const { return ld; }
+        const bool is_transposed() const { return transpose; }
+        const T*   data() const { return matrix; }
+        const bool overlaps(const Matrix& B) const { return matrix<B.matrix + B.extent() && B.matrix<matrix + extent(); }
     
         T          operator()(const int, const int)  const;
         T&         operator()(const int, const int);
     
         void       operator*=(const T);
-        Matrix     operator*(const T)   const;
     
         void       operator*=(const Matrix&);
         void       operator*=(const Matrix* const);
-        Matrix     operator*(const Matrix&)         const;
-        Matrix     operator*(const Matrix* const)   const;
+        void       gemm(const T, const Matrix&, const bool, const Matrix&, const bool, const T);
+        void       ger(const T, const Matrix&, const Matrix&);
     
         void       operator+=(const Matrix&);
         void       operator+=(const Matrix* const);
-        Matrix     operator+(const Matrix&)         const;
-        Matrix     operator+(const Matrix* const)   const;
+        template<typename E>
+        void       operator+=(const MatrixExpr<T, E>&);
     
         void       operator-=(const Matrix&);
         void       operator-=(const Matrix* const);
-        Matrix     operator-(const Matrix&)         const;
-        Matrix     operator-(const Matrix* const)   const;
+        template<typename E>
+        void       operator-=(const MatrixExpr<T, E>&);
     
         void       element_wise_product(const Matrix* const);
         void       element_wise_product(const Matrix&);
-        void       sigmoid();
+        void       sigmoid(const SIMD::Sigmoid=SIMD::sigmoid_poly);
+        void       sigmoid_affine(const Matrix&, const Matrix&, const Matrix&, const SIMD::Sigmoid=SIMD::sigmoid_poly);
+        void       sigmoid_backward(const Matrix&, const Matrix&, const Matrix&);
+        template<typename F>
+        void       map(const F&);
+        template<typename L, typename R, typename F>
+        void       zip(const MatrixExpr<T, L>&, const MatrixExpr<T, R>&, const F&);
+        void       load_relaxed(const Matrix&);
+        template<typename F>
+        void       zip_relaxed(const Matrix&, const F&, Matrix* const=0);
     
         void       self_transpose();
         Matrix     create_transpose() const;
@@ -152,15 +266,41 @@ class Matrix {
         void       free();
         void       print() const;
     
+    protected:
+    
+        Matrix(T* const, const int, const int, const int, const bool);
+    
     private:
     
+        /*
+        Array of coefficients shared by several matrices. The counter and the
+        coefficients are stored in one allocation, the coefficients starting
+        offset bytes after the counter.
+        */
+        struct Buffer {
+            static const int offset = 64;
+            std::atomic<int> count;   /* number of matrices pointing to the array */
+            MatrixArena*     arena;   /* arena the array was allocated in, 0 for the heap */
+            size_t           size;    /* size of the allocation in bytes */
+            T* data() { return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + offset); }
+        };
+    
+        static int leading_dimension(const int);
+    
+        bool is_contiguous() const { return ld==J || I==1; }
+        int  vector_stride() const { return I==1 ? 1 : ld; }
+        int  extent() const { return matrix_extent(I, J, ld); }
         void copy_matrix(const Matrix<T>* const);
         void create_matrix();
+        void acquire(const Matrix&);
+        void release();
 
-        int  I;           /* number of rows */
-        int  J;           /* number of columns */
-        T*   matrix;      /* matrix' coefficients */
-        bool transpose;   /* tells whether the matrix is transposed or not */
+        int     I;           /* number of rows */
+        int     J;           /* number of columns */
+        int     ld;          /* leading dimension, distance between two rows in memory */
+        T*      matrix;      /* matrix' coefficients */
+        bool    transpose;   /* tells whether the matrix is transposed or not */
+        Buffer* buffer;      /* array holding the coefficients */
     
     
     
@@ -211,6 +351,11 @@ class Matrix {
                            "            transpose: " + std::to_string(B->transpose) + "\n"
                            "        ]";
                 }
+         static std::string create_infos_dimensions(const int AI, const int AJ, const int BI, const int BJ, const std::string& p_function) {
+                    return "in function " + p_function + ":\n" +
+                           "    A: " + std::to_string(AI) + "x" + std::to_string(AJ) + "\n" +
+                           "    B: " + std::to_string(BI) + "x" + std::to_string(BJ);
+                }
             
         virtual const char* what()      const throw() { return description.c_str(); }
                 std::string get_infos() const throw() { return infos; }
@@ -233,8 +378,10 @@ template<typename T>
 Matrix<T>::Matrix() :
     I(0),
     J(0),
+    ld(0),
     matrix{0},
-    transpose(false) {
+    transpose(false),
+    buffer{0} {
 }
 
 /*
@@ -244,8 +391,10 @@ template<typename T>
 Matrix<T>::Matrix(const int I, const int J) :
     I(I),
     J(J),
+    ld(leading_dimension(J)),
     matrix{0},
-    transpose(false) {
+    transpose(false),
+    buffer{0} {
     create_matrix();
 }
 
@@ -259,17 +408,68 @@ template<typename T>
 Matrix<T>::Matrix(const Matrix<T>& B, const bool deep_copy) :
     I(B.I),
     J(B.J),
-    matrix{0} {
-    if(deep_copy) { create_matrix(); copy_matrix(&B); transpose = B.transpose; }
-    else          { matrix=B.matrix;                  transpose = B.transpose; }
+    ld(B.ld),
+    matrix{0},
+    transpose(B.transpose),
+    buffer{0} {
+    if(deep_copy) { ld = leading_dimension(J); create_matrix(); copy_matrix(&B); }
+    else          { acquire(B); }
 }
 template<typename T>
 Matrix<T>::Matrix(const Matrix<T>* B, const bool deep_copy) :
     I(B->I),
     J(B->J),
-    matrix{0} {
-    if(deep_copy) { create_matrix(); copy_matrix(B); transpose = B->transpose; }
-    else          { matrix=B->matrix;                transpose = B->transpose; }
+    ld(B->ld),
+    matrix{0},
+    transpose(B->transpose),
+    buffer{0} {
+    if(deep_copy) { ld = leading_dimension(J); create_matrix(); copy_matrix(B); }
+    else          { acquire(*B); }
+}
+
+/*
+Points at coefficients owned by someone else, laid out with the given
+leading dimension. This is the constructor of the views.
+*/
+template<typename T>
+Matrix<T>::Matrix(T* const p_matrix, const int I, const int J, const int ld, const bool transpose) :
+    I(I),
+    J(J),
+    ld(ld),
+    matrix(p_matrix),
+    transpose(transpose),
+    buffer{0} {
+}
+
+/*
+Takes the coefficients of B, which is left empty.
+*/
+template<typename T>
+Matrix<T>::Matrix(Matrix<T>&& B) :
+    I(B.I),
+    J(B.J),
+    ld(B.ld),
+    matrix(B.matrix),
+    transpose(B.transpose),
+    buffer(B.buffer) {
+    B.matrix = 0;
+    B.buffer = 0;
+}
+
+/*
+Creates a new matrix and evaluates the expression in it.
+*/
+template<typename T>
+template<typename E>
+Matrix<T>::Matrix(const MatrixExpr<T, E>& e) :
+    I(e.derived().get_I()),
+    J(e.derived().get_J()),
+    ld(leading_dimension(J)),
+    matrix{0},
+    transpose(false),
+    buffer{0} {
+    create_matrix();
+    MatrixAssign<T>::run(e.derived(), matrix, ld, false, MatrixAssign<T>::set);
 }
 
 /*
@@ -278,94 +478,147 @@ no size parameters. This is not a resizing method!
 */
 template<typename T>
 void Matrix<T>::set_dimensions(const int p_I, const int p_J) {
-    I = p_I;
-    J = p_J;
     free();
+    I         = p_I;
+    J         = p_J;
+    ld        = leading_dimension(J);
+    transpose = false;
     create_matrix();
 }
 
 /*
-Copies the coefficients matrix.
+Copies the coefficients matrix. Both matrices have the same layout, so
+the coefficients are copied as they are in memory, row by row.
 */
 template<typename T>
 void Matrix<T>::copy_matrix(const Matrix<T>* const B) {
-    for(int i=0 ; i<I ; i++) {
-        for(int j=0 ; j<J ; j++) {
-            matrix[i*J + j] = B->operator()(i, j);
-        }
-    }
+    if(is_contiguous() && B->is_contiguous()) std::copy(B->matrix, B->matrix + I*J, matrix);
+    else for(int i=0 ; i<I ; i++)             std::copy(B->matrix + i*B->ld, B->matrix + i*B->ld + J, matrix + i*ld);
+}
+
+/*
+Leading dimension of a matrix with J columns: J rounded up to a multiple
+of the alignment, except for column vectors.
+*/
+template<typename T>
+int Matrix<T>::leading_dimension(const int J) {
+    const int w = SIMD::alignment%sizeof(T)==0 ? SIMD::alignment/sizeof(T) : 1;
+    return J<=1 ? J : (J+w-1)/w*w;
 }
 
 /*
 The matrix of coefficients of this matrix are the same as B's.
-This matrix points at this array in memory.
+This matrix points at this array in memory, and releases the one it was
+pointing at.
 */
 template<typename T>
 Matrix<T>& Matrix<T>::operator=(const Matrix<T>& B) {
-    I         = B.get_I();
-    J         = B.get_J();
-    matrix    = B.matrix;
-    transpose = B.transpose;
+    if(this!=&B) {
+        release();
+        I         = B.I;
+        J         = B.J;
+        ld        = B.ld;
+        transpose = B.transpose;
+        acquire(B);
+    }
     return *this;
 }
+template<typename T>
+Matrix<T>& Matrix<T>::operator=(Matrix<T>&& B) {
+    if(this!=&B) {
+        release();
+        I         = B.I;
+        J         = B.J;
+        ld        = B.ld;
+        transpose = B.transpose;
+        matrix    = B.matrix;   B.matrix = 0;
+        buffer    = B.buffer;   B.buffer = 0;
+    }
+    return *this;
+}
+
+/*
+Evaluates the expression into the existing coefficients of this matrix, which
+must have the dimensions of the expression: unlike =, nothing is allocated,
+and the other matrices pointing at the same coefficients see the result. A
+nested product is computed into this matrix, so the expression can hold one
+product, whose operands are matrices that do not read this matrix, and it
+cannot read this matrix with another layout or at other positions, as an
+overlapping view does.
+*/
+template<typename T>
+template<typename E>
+void Matrix<T>::assign(const MatrixExpr<T, E>& e) {
+    const MatrixNested<E> x(e.derived());
+    if(x.get_I()!=get_I() || x.get_J()!=get_J() || (x.aliases(matrix, extent()) && (!x.has_layout(transpose) || x.offsets(matrix, extent(), ld)))) {
+        const std::string desc     = "Unable to assign the expression in place: dimensions or layouts don't match.";
+        const std::string function = "void Matrix<T>::assign(const MatrixExpr<T, E>& e)";
+        const std::string infos    = Exception::create_infos_dimensions(get_I(), get_J(), x.get_I(), x.get_J(), function);
+        throw Exception(desc, infos);
+    }
+    MatrixAssign<T>::run(x, matrix, ld, transpose, MatrixAssign<T>::set);
+}
+
+/*
+Evaluates the expression. When this matrix is the only one pointing at its
+coefficients, has the right dimensions and is not read by the expression,
+the result is written in place. Otherwise it is written to a new matrix of
+coefficients, which this matrix then points at.
+*/
+template<typename T>
+template<typename E>
+Matrix<T>& Matrix<T>::operator=(const MatrixExpr<T, E>& e) {
+    const E& x = e.derived();
+    if(buffer && buffer->count==1 && !transpose && I==x.get_I() && J==x.get_J() && !x.aliases(matrix, extent())) {
+        MatrixAssign<T>::run(x, matrix, ld, false, MatrixAssign<T>::set);
+        return *this;
+    }
+    return *this = Matrix<T>(e);
+}
+
+/*
+Points at the coefficients of B, which gain one reference.
+*/
+template<typename T>
+void Matrix<T>::acquire(const Matrix<T>& B) {
+    matrix = B.matrix;
+    buffer = B.buffer;
+    if(buffer) buffer->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+Releases the reference to the coefficients, which are deleted if this
+matrix was the last one pointing at them.
+*/
+template<typename T>
+void Matrix<T>::release() {
+    if(buffer && buffer->count.fetch_sub(1, std::memory_order_acq_rel)==1) {
+        MatrixArena* const arena = buffer->arena;
+        const size_t       size  = buffer->size;
+        buffer->~Buffer();
+        if(arena) arena->deallocate(buffer, size);
+        else      MatrixArena::deallocate_on_heap(buffer);
+    }
+    matrix = 0;
+    buffer = 0;
+}
 
 /*
 Comparison operator.
 */
 template<typename T>
 const bool Matrix<T>::operator==(const Matrix<T>& B) const {
-    if(transpose) {
-        if(J!=B.get_I() || I!=B.get_J()) {
-            return false;
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    if(matrix[j*J + i]!=B.matrix[i*BJ + j]) {
-                        return false;
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    if(matrix[j*J + i]!=B.matrix[j*BI + i]) {
-                        return false;
-                    }
-                }
-            }
-        }
-        return true;
+    if(get_I()!=B.get_I() || get_J()!=B.get_J()) {
+        return false;
     }
-    else {
-        if(I!=B.get_I() || J!=B.get_J()) {
-            return false;
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    if(matrix[i*J + j]!=B.matrix[i*BJ + j]) {
-                        return false;
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    if(matrix[i*J + j]!=B.matrix[j*BI + i]) {
-                        return false;
-                    }
-                }
+    for(int i=0 ; i<get_I() ; i++) {
+        for(int j=0 ; j<get_J() ; j++) {
+            if((*this)(i, j)!=B(i, j)) {
+                return false;
             }
         }
-        return true;
     }
+    return true;
 }
 template<typename T>
 const bool Matrix<T>::operator==(const Matrix<T>* const B) const {
@@ -379,21 +632,20 @@ const bool Matrix<T>::operator==(const Matrix<T>* const B) const {
 }
 
 /*
-Deletes the matrix of coefficients.
+Releases the matrix of coefficients. They are deleted if no other matrix
+points at them.
 */
 template<typename T>
 void Matrix<T>::free() {
-    if(matrix) {
-        delete [] matrix;
-        matrix = 0;
-    }
+    release();
 }
 
 /*
-Default destructor.
+Releases the matrix of coefficients.
 */
 template<typename T>
 Matrix<T>::~Matrix() {
+    release();
 }
 
 /*
@@ -405,26 +657,191 @@ const T Matrix<T>::sigmoid(const T x) {
 }
 
 /*
-Applies the sigmoid function to a matrix, element-wise.
+Applies the sigmoid function to a matrix, element-wise, with the given
+accuracy tier.
+*/
+template<typename T>
+void Matrix<T>::sigmoid(const SIMD::Sigmoid tier) {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    if(is_contiguous()) kernels.sigmoid[tier](I*J, matrix);
+    else                for(int i=0 ; i<I ; i++) kernels.sigmoid[tier](J, matrix + i*ld);
+}
+
+/*
+Computes sigmoid(W*X + B) and stores it in this matrix, B being a column
+vector added to every column of W*X. The weights are read in place and the
+result is written to the existing coefficients of this matrix, so nothing
+is allocated. When X is a vector, the product, the bias and the sigmoid are
+computed by one matrix-vector product followed by a single pass on the
+result. The sigmoid is computed with the given accuracy tier. This matrix
+must have the right dimensions and not be transposed.
+*/
+template<typename T>
+void Matrix<T>::sigmoid_affine(const Matrix& W, const Matrix& X, const Matrix& B, const SIMD::Sigmoid tier) {
+    if(W.get_J()!=X.get_I() || B.get_I()!=W.get_I() || B.get_J()!=1 || get_I()!=W.get_I() || get_J()!=X.get_J() || transpose) {
+        const std::string desc     = "Unable to compute sigmoid(W*X + B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::sigmoid_affine(const Matrix& W, const Matrix& X, const Matrix& B, const SIMD::Sigmoid tier)";
+        const std::string infos    = Exception::create_infos_two_matrices(&W, &X, function);
+        throw Exception(desc, infos);
+    }
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    if(J==1) {
+        /* the coefficients of a vector are vector_stride() apart, transposed or not */
+        Gemm<T>::gemv(W.transpose, I, W.get_J(), 1, W.matrix, W.ld, X.matrix, X.vector_stride(), 0, matrix, vector_stride());
+        if(is_contiguous() && B.vector_stride()==1) {
+            kernels.bias_sigmoid[tier](I, B.matrix, matrix);
+        }
+        else {
+            for(int i=0 ; i<I ; i++) matrix[i*ld] += B.matrix[i*B.vector_stride()];
+            sigmoid(tier);
+        }
+    }
+    else {
+        /* every row starts with its bias, the product is accumulated on it */
+        for(int i=0 ; i<I ; i++) {
+            kernels.fill(J, B.matrix[i*B.vector_stride()], matrix + i*ld);
+        }
+        Gemm<T>::gemm(W.transpose, X.transpose, I, J, W.get_J(), 1, W.matrix, W.ld, X.matrix, X.ld, 1, matrix, ld);
+        sigmoid(tier);
+    }
+}
+
+/*
+Computes (W^t*D)°A°(1-A) and stores it in this matrix: the error of the
+previous layer in the backpropagation, given the weights W and the error D
+of a layer, A being the output of the sigmoid of the previous layer. The
+result is written to the existing coefficients of this matrix, nothing is
+allocated. When D is a vector, the product and the derivative are computed
+in one pass over W by Gemm::gemv_sigmoid_prime, otherwise the derivative is
+applied after the product. This matrix must have the right dimensions, not
+be transposed, and not share its coefficients with D or A.
+*/
+template<typename T>
+void Matrix<T>::sigmoid_backward(const Matrix& W, const Matrix& D, const Matrix& A) {
+    if(W.get_I()!=D.get_I() || A.get_I()!=W.get_J() || A.get_J()!=D.get_J() || get_I()!=A.get_I() || get_J()!=A.get_J() || transpose) {
+        const std::string desc     = "Unable to compute (W^t*D)°A°(1-A): dimensions don't match.";
+        const std::string function = "void Matrix<T>::sigmoid_backward(const Matrix& W, const Matrix& D, const Matrix& A)";
+        const std::string infos    = Exception::create_infos_two_matrices(&W, &D, function);
+        throw Exception(desc, infos);
+    }
+    if(J==1) {
+        Gemm<T>::gemv_sigmoid_prime(!W.transpose, I, W.get_I(), W.matrix, W.ld, D.matrix, D.vector_stride(), A.matrix, A.vector_stride(), matrix, vector_stride());
+    }
+    else {
+        Gemm<T>::gemm(!W.transpose, D.transpose, I, J, W.get_I(), 1, W.matrix, W.ld, D.matrix, D.ld, 0, matrix, ld);
+        if(!A.transpose) {
+            const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+            for(int i=0 ; i<I ; i++) kernels.axpy_sigmoid_prime(J, 0, A.matrix + i*A.ld, A.matrix + i*A.ld, matrix + i*ld);
+        }
+        else {
+            for(int i=0 ; i<I ; i++) for(int j=0 ; j<J ; j++) {
+                const T a = A.matrix[j*A.ld + i];
+                matrix[i*ld + j] *= a*(1 - a);
+            }
+        }
+    }
+}
+
+/*
+Applies the functor f to every coefficient of the matrix, in place, with the
+element-wise engine (see MatrixExpr.hpp): x = f(x).
+*/
+template<typename T>
+template<typename F>
+void Matrix<T>::map(const F& f) {
+    MatrixAssign<T>::run(MatrixMap<T, MatrixLeaf<T>, F>(MatrixLeaf<T>(*this), f), matrix, ld, transpose, MatrixAssign<T>::set);
+}
+
+/*
+Stores f(a, b) in this matrix for every pair of coefficients a and b at the
+same position in A and B, with the element-wise engine. The coefficients are
+written in place, nothing is allocated, and A or B can be this matrix.
+*/
+template<typename T>
+template<typename L, typename R, typename F>
+void Matrix<T>::zip(const MatrixExpr<T, L>& A, const MatrixExpr<T, R>& B, const F& f) {
+    const L& a = A.derived();
+    const R& b = B.derived();
+    if(a.get_I()!=get_I() || a.get_J()!=get_J() || b.get_I()!=get_I() || b.get_J()!=get_J()) {
+        const std::string desc     = "Unable to zip these matrices: dimensions don't match.";
+        const std::string function = "void Matrix<T>::zip(const MatrixExpr<T, L>& A, const MatrixExpr<T, R>& B, const F& f)";
+        const std::string infos    = Exception::create_infos_dimensions(a.get_I(), a.get_J(), b.get_I(), b.get_J(), function);
+        throw Exception(desc, infos);
+    }
+    MatrixAssign<T>::run(MatrixZip<T, MatrixNested<L>, MatrixNested<R>, F>(a, b, f), matrix, ld, transpose, MatrixAssign<T>::set);
+}
+
+/*
+Copies B into this matrix, reading the coefficients of B with relaxed atomic
+loads, so that B can be written by other threads with zip_relaxed at the same
+time. Both matrices must have the same dimensions and layout.
+*/
+template<typename T>
+void Matrix<T>::load_relaxed(const Matrix<T>& B) {
+    if(B.I!=I || B.J!=J || B.transpose!=transpose) {
+        const std::string desc     = "Unable to load this matrix: dimensions or layouts don't match.";
+        const std::string function = "void Matrix<T>::load_relaxed(const Matrix<T>& B)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
+    }
+    const int n = J;
+    for(int i=0 ; i<I ; i++) {
+        const T* b = B.matrix + i*B.ld;
+        T*       a = matrix + i*ld;
+        for(int j=0 ; j<n ; j++) __atomic_load(b + j, a + j, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+Stores f(a, b) in this matrix for every coefficient a of this matrix and b at
+the same position in B, a being read and written with relaxed atomic
+operations, so that other threads can do the same or call load_relaxed at the
+same time. The new coefficients are also written to C, if not null, which
+saves a call to load_relaxed. All the matrices must have the same dimensions
+and layout. The functor and the dimensions are copied to local variables,
+which the atomic operations do not force the compiler to read again.
 */
 template<typename T>
-void Matrix<T>::sigmoid() {
+template<typename F>
+void Matrix<T>::zip_relaxed(const Matrix<T>& B, const F& f, Matrix<T>* const C) {
+    if(B.I!=I || B.J!=J || B.transpose!=transpose || (C && (C->I!=I || C->J!=J || C->transpose!=transpose))) {
+        const std::string desc     = "Unable to zip these matrices: dimensions or layouts don't match.";
+        const std::string function = "void Matrix<T>::zip_relaxed(const Matrix<T>& B, const F& f, Matrix<T>* const C)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
+    }
+    const F   g = f;
+    const int n = J;
     for(int i=0 ; i<I ; i++) {
-        for(int j=0 ; j<J ; j++) {
-            matrix[i*J + j] = sigmoid(matrix[i*J + j]);
+        const T* b = B.matrix + i*B.ld;
+        T*       a = matrix + i*ld;
+        T*       c = C ? C->matrix + i*C->ld : 0;
+        for(int j=0 ; j<n ; j++) {
+            T x;
+            __atomic_load(a + j, &x, __ATOMIC_RELAXED);
+            T y = g(x, b[j]);
+            __atomic_store(a + j, &y, __ATOMIC_RELAXED);
+            if(c) c[j] = y;
         }
     }
 }
 
 /*
-Allocates memory for the matrix of coefficients.
+Allocates memory for the matrix of coefficients, with one reference, in the
+arena of the current thread if any, on the heap otherwise.
 */
 template<typename T>
 void Matrix<T>::create_matrix() {
     try {
-        matrix = new T[I*J];
+        MatrixArena* const arena = MatrixArena::get_current();
+        const size_t       size  = Buffer::offset + I*ld*sizeof(T);
+        buffer = new(arena ? arena->allocate(size) : MatrixArena::allocate_on_heap(size)) Buffer;
+        buffer->count.store(1, std::memory_order_relaxed);
+        buffer->arena = arena;
+        buffer->size  = size;
+        matrix = buffer->data();
     }
-    catch(std::exception exc) {
+    catch(std::exception& exc) {
         const std::string description = "Unable to allocate memory for the matrix: " + std::string(exc.what());
         const std::string function    = "void Matrix<T>::create_matrix()";
         const std::string infos       = Exception::create_infos_one_matrix(this, function);
@@ -437,9 +854,9 @@ Fills the matrix with a scalar.
 */
 template<typename T>
 void Matrix<T>::fill(const T alpha) {
-    for(int i=0 ; i<I*J ; i++) {
-        matrix[i] = alpha;
-    }
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    if(is_contiguous()) kernels.fill(I*J, alpha, matrix);
+    else                for(int i=0 ; i<I ; i++) kernels.fill(J, alpha, matrix + i*ld);
 }
 
 /*
@@ -457,7 +874,7 @@ void Matrix<T>::identity() {
         throw Exception(description, infos);
     }
     for(int i=0 ; i<I ; i++) {
-        matrix[i*(I+1)] = 1;
+        matrix[i*(ld+1)] = 1;
     }
 }
 
@@ -470,7 +887,7 @@ void Matrix<T>::print() const {
         for(int i=0 ; i<I ; i++) {
             std::cout << "| ";
             for(int j=0 ; j<J ; j++) {
-                std::cout << matrix[i*J + j] << " ";
+                std::cout << matrix[i*ld + j] << " ";
             }
             std::cout << "|" << std::endl;
         }
@@ -480,7 +897,7 @@ void Matrix<T>::print() const {
         for(int i=0 ; i<J ; i++) {
             std::cout << "| ";
             for(int j=0 ; j<I ; j++) {
-                std::cout << matrix[j*J + i] << " ";
+                std::cout << matrix[j*ld + i] << " ";
             }
             std::cout << "|" << std::endl;
         }
@@ -494,10 +911,10 @@ Returns the matrix coefficient at row i, column j.
 template<typename T>
 T Matrix<T>::operator()(const int i, const int j) const {
     if(!transpose) {
-        return matrix[i*J + j];
+        return matrix[i*ld + j];
     }
     else {
-        return matrix[j*J + i];
+        return matrix[j*ld + i];
     }
 }
 
@@ -507,10 +924,10 @@ Returns a reference to the matrix coefficient at row i, column j.
 template<typename T>
 T& Matrix<T>::operator()(const int i, const int j) {
     if(!transpose) {
-        return matrix[i*J + j];
+        return matrix[i*ld + j];
     }
     else {
-        return matrix[j*J + i];
+        return matrix[j*ld + i];
     }
 }
 
@@ -518,214 +935,116 @@ T& Matrix<T>::operator()(const int i, const int j) {
 Multiplication of a matrix by a scalar.
 */
 template<typename T>
-Matrix<T> Matrix<T>::operator*(const T lambda) const {
-    Matrix<T> result(this, true);
-    result *= lambda;
-    return result;
-}
-template<typename T>
 void Matrix<T>::operator*=(const T lambda) {
-    for(int i=0 ; i<I*J ; i++) {
-        matrix[i] *= lambda;
-    }
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    if(is_contiguous()) kernels.scale(I*J, lambda, matrix);
+    else                for(int i=0 ; i<I ; i++) kernels.scale(J, lambda, matrix + i*ld);
 }
 
 /*
-Product of two matrices.
+Product of two matrices. The product is computed by the gemm engine, which
+reads both matrices in place whatever their transposition. When B is
+square, the product is computed in a scratch matrix allocated in the arena
+of the thread, which reuses the same block on the next call, then copied
+in place.
 */
 template<typename T>
 void Matrix<T>::operator*=(const Matrix& B) {
-    if(!transpose) {
-        if(B.get_I()!=J) {
-            const std::string desc     = "Unable to multiply these two matrices (A*B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator*=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        Matrix res(I, B.get_J());
-        res.fill(0);
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[i*J + k]*B.matrix[k*BJ + j];
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ; j++) {
-                        res.matrix[i*BJ + j] += matrix[i*J + k]*B.matrix[j*BI + k];
-                    }
-                }
-            }
-        }
-        free();
-        *this = res;
+    if(B.get_I()!=get_J()) {
+        const std::string desc     = "Unable to multiply these two matrices (A*B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::operator*=(const Matrix& B)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
     }
-    else {
-        if(B.get_I()!=I) {
-            const std::string desc     = "Unable to multiply these two matrices (A*B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator*=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        Matrix res(J, B.get_J());
-        res.fill(0);
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[k*J + i]*B.matrix[k*BJ + j];
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[k*J + i]*B.matrix[j*BI + k];
-                    }
-                }
-            }
-        }
-        free();
-        *this = res;
+    if(B.get_I()!=B.get_J()) {
+        Matrix res(get_I(), B.get_J());
+        res.gemm(1, *this, false, B, false, 0);
+        *this = std::move(res);
+        return;
     }
+    MatrixArena::Scope scope(MatrixArena::get_thread_arena());
+    Matrix product_scratch(get_I(), get_J());
+    product_scratch.gemm(1, *this, false, B, false, 0);
+    assign(product_scratch);
 }
 template<typename T>
 void Matrix<T>::operator*=(const Matrix* B) {
     *this *= *B;
 }
+
+/*
+Computes this = alpha*op(A)*op(B) + beta*this with the gemm engine, op(A)
+being A^t when transA is true and A otherwise. The flags are combined with
+the transposition of the matrices, which are all read in place: a
+transposed destination is computed as op(B)^t*op(A)^t. When beta is 0, the
+coefficients of this matrix do not need to be initialized. A destination
+whose coefficients overlap an operand, as a view of it does, is computed in
+a new matrix first.
+*/
 template<typename T>
-Matrix<T> Matrix<T>::operator*(const Matrix& B) const {
-    if(!transpose) {
-        if(B.get_I()!=J) {
-            const std::string desc     = "Unable to multiply these two matrices (A*B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator*=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        Matrix res(I, B.get_J());
-        res.fill(0);
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[i*J + k]*B.matrix[k*BJ + j];
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ; j++) {
-                        res.matrix[i*BJ + j] += matrix[i*J + k]*B.matrix[j*BI + k];
-                    }
-                }
-            }
-        }
-        return res;
+void Matrix<T>::gemm(const T alpha, const Matrix& A, const bool transA, const Matrix& B, const bool transB, const T beta) {
+    const bool ta = A.transpose!=transA;
+    const bool tb = B.transpose!=transB;
+    const int  M  = transA ? A.get_J() : A.get_I();
+    const int  K  = transA ? A.get_I() : A.get_J();
+    const int  N  = transB ? B.get_I() : B.get_J();
+    if(K!=(transB ? B.get_J() : B.get_I()) || get_I()!=M || get_J()!=N) {
+        const std::string desc     = "Unable to compute alpha*op(A)*op(B) + beta*C: dimensions don't match.";
+        const std::string function = "void Matrix<T>::gemm(const T alpha, const Matrix& A, const bool transA, const Matrix& B, const bool transB, const T beta)";
+        const std::string infos    = Exception::create_infos_dimensions(M, K, transB ? B.get_J() : B.get_I(), N, function);
+        throw Exception(desc, infos);
     }
-    else {
-        if(B.get_I()!=I) {
-            const std::string desc     = "Unable to multiply these two matrices (A*B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator*=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        Matrix res(J, B.get_J());
-        res.fill(0);
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[k*J + i]*B.matrix[k*BJ + j];
-                    }
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int k=0 ; k<BI ; k++) {
-                    for(int j=0 ; j<BJ ; j++) {
-                        res.matrix[i*BJ + j] += matrix[k*J + i]*B.matrix[j*BI + k];
-                    }
-                }
-            }
-        }
-        return res;
+    if(overlaps(A) || overlaps(B)) {
+        Matrix<T> res(M, N);
+        res.gemm(alpha, A, transA, B, transB, 0);
+        if(beta==0)      fill(0);
+        else if(beta!=1) *this *= beta;
+        *this += res;
     }
+    else if(!transpose) Gemm<T>::gemm(ta, tb, M, N, K, alpha, A.matrix, A.ld, B.matrix, B.ld, beta, matrix, ld);
+    else                Gemm<T>::gemm(!tb, !ta, N, M, K, alpha, B.matrix, B.ld, A.matrix, A.ld, beta, matrix, ld);
 }
+
+/*
+Adds alpha*X*Y^t to this matrix, in place, without any temporary matrix.
+When X and Y are vectors, this is a rank-1 update computed by Gemm::ger,
+one axpy per row in memory: a transposed destination gets alpha*Y*X^t. When
+X and Y have k columns, for instance the inputs and the errors of a batch,
+this is a rank-k update computed by gemm. This matrix must not be read by
+X or Y.
+*/
 template<typename T>
-Matrix<T> Matrix<T>::operator*(const Matrix* B) const {
-    return (*this)*(*B);
+void Matrix<T>::ger(const T alpha, const Matrix& X, const Matrix& Y) {
+    if(X.get_I()!=get_I() || Y.get_I()!=get_J() || X.get_J()!=Y.get_J()) {
+        const std::string desc     = "Unable to compute C + alpha*X*Y^t: dimensions don't match.";
+        const std::string function = "void Matrix<T>::ger(const T alpha, const Matrix& X, const Matrix& Y)";
+        const std::string infos    = Exception::create_infos_two_matrices(&X, &Y, function);
+        throw Exception(desc, infos);
+    }
+    if(X.get_J()!=1)    gemm(alpha, X, false, Y, true, 1);
+    else if(!transpose) Gemm<T>::ger(I, J, alpha, X.matrix, X.vector_stride(), Y.matrix, Y.vector_stride(), 1, matrix, ld);
+    else                Gemm<T>::ger(I, J, alpha, Y.matrix, Y.vector_stride(), X.matrix, X.vector_stride(), 1, matrix, ld);
 }
 
 /*
-Addition of two matrices.
+Addition of two matrices, or of a matrix and an expression.
 */
 template<typename T>
 void Matrix<T>::operator+=(const Matrix& B) {
-    if(!transpose) {
-        if(B.get_I()!=I || B.get_J()!=J) {
-            const std::string desc     = "Unable to add these two matrices (A+B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator+=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] += B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] += B.matrix[j*BI + i];
-                }
-            }
-        }
+    if(B.get_I()!=get_I() || B.get_J()!=get_J()) {
+        const std::string desc     = "Unable to add these two matrices (A+B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::operator+=(const Matrix& B)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
+    }
+    if(transpose==B.transpose) {
+        /* same layout in memory */
+        const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+        if(is_contiguous() && B.is_contiguous()) kernels.add(I*J, B.matrix, matrix);
+        else                                     for(int i=0 ; i<I ; i++) kernels.add(J, B.matrix + i*B.ld, matrix + i*ld);
     }
     else {
-        if(B.get_I()!=J || B.get_J()!=I) {
-            const std::string desc     = "Unable to add these two matrices (A+B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator+=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] += B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] += B.matrix[j*BI + i];
-                }
-            }
-        }
+        MatrixAssign<T>::run(MatrixLeaf<T>(B), matrix, ld, transpose, MatrixAssign<T>::add);
     }
 }
 template<typename T>
@@ -733,70 +1052,36 @@ void Matrix<T>::operator+=(const Matrix* const B) {
     *this += *B;
 }
 template<typename T>
-Matrix<T> Matrix<T>::operator+(const Matrix& B) const {
-    Matrix result(this, true);
-    result += B;
-    return result;
-}
-template<typename T>
-Matrix<T> Matrix<T>::operator+(const Matrix* const B) const {
-    Matrix result(this, true);
-    result += *B;
-    return result;
+template<typename E>
+void Matrix<T>::operator+=(const MatrixExpr<T, E>& e) {
+    if(e.derived().get_I()!=get_I() || e.derived().get_J()!=get_J()) {
+        const std::string desc     = "Unable to add these two matrices (A+B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::operator+=(const MatrixExpr<T, E>& e)";
+        const std::string infos    = Exception::create_infos_dimensions(get_I(), get_J(), e.derived().get_I(), e.derived().get_J(), function);
+        throw Exception(desc, infos);
+    }
+    MatrixAssign<T>::run(e.derived(), matrix, ld, transpose, MatrixAssign<T>::add);
 }
 
 /*
-Substraction of two matrices.
+Substraction of two matrices, or of a matrix and an expression.
 */
 template<typename T>
 void Matrix<T>::operator-=(const Matrix& B) {
-    if(!transpose) {
-        if(B.get_I()!=I || B.get_J()!=J) {
-            const std::string desc     = "Unable to substract these two matrices (A-B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator-=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] -= B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] -= B.matrix[j*BI + i];
-                }
-            }
-        }
+    if(B.get_I()!=get_I() || B.get_J()!=get_J()) {
+        const std::string desc     = "Unable to substract these two matrices (A-B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::operator-=(const Matrix& B)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
+    }
+    if(transpose==B.transpose) {
+        /* same layout in memory */
+        const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+        if(is_contiguous() && B.is_contiguous()) kernels.sub(I*J, B.matrix, matrix);
+        else                                     for(int i=0 ; i<I ; i++) kernels.sub(J, B.matrix + i*B.ld, matrix + i*ld);
     }
     else {
-        if(B.get_I()!=J || B.get_J()!=I) {
-            const std::string desc     = "Unable to substract these two matrices (A-B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::operator-=(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] -= B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] -= B.matrix[j*BI + i];
-                }
-            }
-        }
+        MatrixAssign<T>::run(MatrixLeaf<T>(B), matrix, ld, transpose, MatrixAssign<T>::sub);
     }
 }
 template<typename T>
@@ -804,16 +1089,15 @@ void Matrix<T>::operator-=(const Matrix* const B) {
     *this -= *B;
 }
 template<typename T>
-Matrix<T> Matrix<T>::operator-(const Matrix& B) const {
-    Matrix<T> result(this, true);
-    result -= B;
-    return result;
-}
-template<typename T>
-Matrix<T> Matrix<T>::operator-(const Matrix* const B) const {
-    Matrix<T> result(this, true);
-    result -= *B;
-    return result;
+template<typename E>
+void Matrix<T>::operator-=(const MatrixExpr<T, E>& e) {
+    if(e.derived().get_I()!=get_I() || e.derived().get_J()!=get_J()) {
+        const std::string desc     = "Unable to substract these two matrices (A-B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::operator-=(const MatrixExpr<T, E>& e)";
+        const std::string infos    = Exception::create_infos_dimensions(get_I(), get_J(), e.derived().get_I(), e.derived().get_J(), function);
+        throw Exception(desc, infos);
+    }
+    MatrixAssign<T>::run(e.derived(), matrix, ld, transpose, MatrixAssign<T>::sub);
 }
 
 /*
@@ -825,53 +1109,20 @@ void Matrix<T>::element_wise_product(const Matrix* const B) {
 }
 template<typename T>
 void Matrix<T>::element_wise_product(const Matrix& B) {
-    if(!transpose) {
-        if(B.get_I()!=I || B.get_J()!=J) {
-            const std::string desc     = "Unable to perform Hadamard product with these two matrices (A°B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::self_element_wise_product(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] *= B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<I ; i++) {
-                for(int j=0 ; j<J ; j++) {
-                    matrix[i*J + j] *= B.matrix[j*BI + i];
-                }
-            }
-        }
+    if(B.get_I()!=get_I() || B.get_J()!=get_J()) {
+        const std::string desc     = "Unable to perform Hadamard product with these two matrices (A°B): dimensions don't match.";
+        const std::string function = "void Matrix<T>::self_element_wise_product(const Matrix& B)";
+        const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
+        throw Exception(desc, infos);
+    }
+    if(transpose==B.transpose) {
+        /* same layout in memory */
+        const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+        if(is_contiguous() && B.is_contiguous()) kernels.mul(I*J, B.matrix, matrix);
+        else                                     for(int i=0 ; i<I ; i++) kernels.mul(J, B.matrix + i*B.ld, matrix + i*ld);
     }
     else {
-        if(B.get_I()!=J || B.get_J()!=I) {
-            const std::string desc     = "Unable to perform Hadamard product with these two matrices (A°B): dimensions don't match.";
-            const std::string function = "void Matrix<T>::self_element_wise_product(const Matrix& B)";
-            const std::string infos    = Exception::create_infos_two_matrices(this, &B, function);
-            throw Exception(desc, infos);
-        }
-        const int BI = B.get_I();
-        const int BJ = B.get_J();
-        if(!B.transpose) {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] *= B.matrix[i*BJ + j];
-                }
-            }
-        }
-        else {
-            for(int i=0 ; i<J ; i++) {
-                for(int j=0 ; j<I ; j++) {
-                    matrix[j*J + i] *= B.matrix[j*BI + i];
-                }
-            }
-        }
+        MatrixAssign<T>::run(MatrixBinary<T, MatrixLeaf<T>, MatrixLeaf<T>, ExprMul>(MatrixLeaf<T>(*this), MatrixLeaf<T>(B)), matrix, ld, transpose, MatrixAssign<T>::set);
     }
 }
 
@@ -895,4 +1146,69 @@ void Matrix<T>::self_transpose() {
     else           transpose = false;
 }
 
+
+
+/*
+Destination-passing functions: the result is written to the coefficients of
+the matrix C given first, which must have the right dimensions, and nothing
+is allocated, so they can be called for every sample of a long training or
+serving run. The matrices can be transposed or views. C can be one of the
+operands of the element-wise functions, but not of gemm_into.
+*/
+
+/*
+C = A*B, computed by the gemm engine.
+*/
+template<typename T>
+void gemm_into(Matrix<T>& C, const Matrix<T>& A, const Matrix<T>& B) {
+    if(C.overlaps(A) || C.overlaps(B)) {
+        const std::string desc     = "Unable to compute C = A*B in place: C overlaps an operand of the product.";
+        const std::string function = "void gemm_into(Matrix<T>& C, const Matrix<T>& A, const Matrix<T>& B)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_two_matrices(&A, &B, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    C.gemm(1, A, false, B, false, 0);
+}
+
+/*
+Element-wise functions.
+*/
+template<typename T>
+void add_into(Matrix<T>& C, const Matrix<T>& A, const Matrix<T>& B) {
+    C.zip(A, B, [](const T a, const T b) { return a + b; });
+}
+template<typename T>
+void sub_into(Matrix<T>& C, const Matrix<T>& A, const Matrix<T>& B) {
+    C.zip(A, B, [](const T a, const T b) { return a - b; });
+}
+template<typename T>
+void hadamard_into(Matrix<T>& C, const Matrix<T>& A, const Matrix<T>& B) {
+    C.zip(A, B, [](const T a, const T b) { return a*b; });
+}
+template<typename T>
+void scale_into(Matrix<T>& C, const typename Matrix<T>::value_type alpha, const Matrix<T>& A) {
+    C.assign(alpha*A);
+}
+template<typename T>
+void copy_into(Matrix<T>& C, const Matrix<T>& A) {
+    C.assign(A);
+}
+
+/*
+C = A^t, the coefficients being written in the layout of C. C cannot be A.
+*/
+template<typename T>
+void transpose_into(Matrix<T>& C, const Matrix<T>& A) {
+    C.assign(transpose(A));
+}
+
+/*
+C = sigmoid(A), computed with the given accuracy tier.
+*/
+template<typename T>
+void sigmoid_into(Matrix<T>& C, const Matrix<T>& A, const SIMD::Sigmoid tier=SIMD::sigmoid_poly) {
+    if(C.data()!=A.data()) C.assign(A);
+    C.sigmoid(tier);
+}
+
 #endif
@@ -0,0 +1,184 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iostream>
+
+#include "MatrixArena.hpp"
+#include "SIMD.hpp"
+
+const size_t MatrixArena::chunk_size;
+const size_t MatrixArena::alignment;
+
+/*
+Opens a scope: the matrices created by this thread are allocated in arena.
+*/
+MatrixArena::Scope::Scope(MatrixArena& p_arena) :
+    arena(p_arena),
+    previous(current()) {
+    current() = &arena;
+}
+
+/*
+Closes the scope and resets the arena if it has no matrix left.
+*/
+MatrixArena::Scope::~Scope() {
+    current() = previous;
+    arena.reset();
+}
+
+/*
+Creates an empty arena, the first chunk is allocated with the first matrix.
+*/
+MatrixArena::MatrixArena() :
+    used(0),
+    live(0) {
+}
+
+/*
+Frees the chunks. They are kept if a matrix still points into them, which
+is a matrix that outlived its arena: the leak is reported.
+*/
+MatrixArena::~MatrixArena() {
+    if(live!=0) {
+        std::cerr << "MatrixArena: " << live << " matri" << (live==1 ? "x" : "ces") << " outlived the arena, " << get_capacity() << " bytes not freed" << std::endl;
+        return;
+    }
+    for(const Chunk& c : chunks) SIMD::aligned_free(c.data);
+}
+
+/*
+Allocates size bytes, aligned like the heap allocations of the matrices. A
+freed block of the same size is reused first. Otherwise the block is taken
+from the current chunk, or from a new chunk twice as large as the previous
+one when the current one is full.
+*/
+void* MatrixArena::allocate(const size_t size) {
+    const size_t n = round_size(size);
+    live++;
+    arena_counter().fetch_add(1, std::memory_order_relaxed);
+    FreeList* const list = find_free_list(n);
+    if(list && list->head) {
+        void* const p = list->head;
+        list->head = *static_cast<void**>(p);
+        return p;
+    }
+    if(chunks.empty() || used+n>chunks.back().size) {
+        const size_t len = std::max(n, chunks.empty() ? chunk_size : 2*chunks.back().size);
+        chunks.push_back(Chunk{static_cast<char*>(allocate_on_heap(len)), len});
+        used = 0;
+    }
+    void* const p = chunks.back().data + used;
+    used += n;
+    return p;
+}
+
+/*
+Frees a block of size bytes, which goes to the free list of its size.
+*/
+void MatrixArena::deallocate(void* const p, const size_t size) {
+    const size_t    n    = round_size(size);
+    FreeList* const list = find_free_list(n);
+    if(list) { *static_cast<void**>(p) = list->head; list->head = p; }
+    else     { free_lists.push_back(FreeList{n, p}); *static_cast<void**>(p) = 0; }
+    live--;
+}
+
+/*
+Makes all the memory available again, if there is no allocation left. The
+chunks are replaced by a single chunk as large as all of them.
+*/
+void MatrixArena::reset() {
+    if(live!=0) return;
+    for(FreeList& list : free_lists) list.head = 0;
+    if(chunks.size()>1) {
+        const size_t len = get_capacity();
+        for(const Chunk& c : chunks) SIMD::aligned_free(c.data);
+        chunks.clear();
+        chunks.push_back(Chunk{static_cast<char*>(allocate_on_heap(len)), len});
+    }
+    used = 0;
+}
+
+/*
+Free list of the blocks of size bytes, 0 if there is none yet. There are
+only a few sizes, one per shape of matrix.
+*/
+MatrixArena::FreeList* MatrixArena::find_free_list(const size_t size) {
+    for(FreeList& list : free_lists) { if(list.size==size) return &list; }
+    return 0;
+}
+
+/*
+Total size of the chunks, in bytes.
+*/
+size_t MatrixArena::get_capacity() const {
+    size_t len = 0;
+    for(const Chunk& c : chunks) len += c.size;
+    return len;
+}
+
+/*
+Allocation and release of aligned memory on the heap, counted.
+*/
+void* MatrixArena::allocate_on_heap(const size_t size) {
+    heap_counter().fetch_add(1, std::memory_order_relaxed);
+    return SIMD::aligned_alloc(size);
+}
+void MatrixArena::deallocate_on_heap(void* const p) {
+    SIMD::aligned_free(p);
+}
+
+/*
+Arena of the current thread.
+*/
+MatrixArena& MatrixArena::get_thread_arena() {
+    static thread_local MatrixArena arena;
+    return arena;
+}
+
+/*
+Number of allocations on the heap and in the arenas so far.
+*/
+MatrixArena::Counters MatrixArena::get_counters() {
+    return Counters{heap_counter().load(), arena_counter().load()};
+}
+
+/*
+Arena in use on the current thread, 0 outside of any scope.
+*/
+MatrixArena*& MatrixArena::current() {
+    static thread_local MatrixArena* arena = 0;
+    return arena;
+}
+
+/*
+Counters shared by all the threads.
+*/
+std::atomic<long>& MatrixArena::heap_counter() {
+    static std::atomic<long> counter(0);
+    return counter;
+}
+std::atomic<long>& MatrixArena::arena_counter() {
+    static std::atomic<long> counter(0);
+    return counter;
+}
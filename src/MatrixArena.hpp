@@ -0,0 +1,134 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines an arena, or bump allocator, for the coefficients of the
+matrices. Short-lived matrices created over and over, like the scratch
+matrix of a product computed in place by Matrix::operator*=, would cost a
+call to the global allocator each time, and the threads contend inside it.
+Training does not need the arenas anymore: it works in matrices allocated
+once (see TrainingWorkspace in FNN.hpp).
+
+An arena allocates large chunks of memory on the heap and hands out their
+bytes in order. A freed block is kept in a free list of its size and given
+to the next allocation of the same size: code that creates the same
+matrices in a loop keeps reusing the same memory, which stays in the
+cache. The whole arena is reset at once when all its
+matrices are gone. The chunks are merged into one on reset, so after the
+first batch an arena makes no call to the heap at all.
+
+The matrices are allocated in an arena while a scope is open on the thread
+that creates them. Every thread has its own arena:
+
+    {
+        MatrixArena::Scope scope(MatrixArena::get_thread_arena());
+        Matrix<float> M(100, 784);        // allocated in the arena
+        ...
+    }                                     // M is gone, the arena is reset
+
+A matrix allocated in an arena must not outlive the scope, and must be freed
+by the thread that created it: an arena is not shared between threads. An
+arena that still has matrices when the scope ends is not reset, it keeps
+growing instead, so a matrix that escapes is never overwritten. An arena
+destroyed while it still has matrices, at the end of its thread, reports
+them and leaks its chunks rather than freeing memory still in use. Matrices created
+outside any scope, such as the weights, are allocated on the heap.
+
+The counters give the number of allocations of matrix coefficients made on
+the heap and in the arenas since the start of the program, for all the
+threads. Chunks allocated by the arenas count as heap allocations.
+*/
+
+#ifndef MatrixArena_hpp
+#define MatrixArena_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+class MatrixArena {
+
+    public:
+    
+        /*
+        Sets the arena used by the current thread until the end of the scope,
+        then resets it.
+        */
+        class Scope {
+            public:
+                Scope(MatrixArena&);
+                ~Scope();
+            private:
+                MatrixArena& arena;      /* arena of this scope */
+                MatrixArena* previous;   /* arena of the enclosing scope */
+        };
+    
+        struct Counters {
+            long heap;    /* allocations on the heap */
+            long arena;   /* allocations in an arena */
+        };
+    
+        MatrixArena();
+        ~MatrixArena();
+    
+        void*  allocate(const size_t);
+        void   deallocate(void* const, const size_t);
+        void   reset();
+        size_t get_capacity() const;
+    
+        static void*        allocate_on_heap(const size_t);
+        static void         deallocate_on_heap(void* const);
+        static MatrixArena* get_current()                       { return current(); }
+        static MatrixArena& get_thread_arena();
+        static Counters     get_counters();
+    
+        static const size_t chunk_size = 1 << 20;   /* bytes, size of the first chunk */
+    
+    private:
+    
+        struct Chunk {
+            char*  data;   /* bytes of the chunk */
+            size_t size;   /* size in bytes */
+        };
+    
+        struct FreeList {
+            size_t size;   /* size of the blocks in bytes */
+            void*  head;   /* first free block, each block starts with the address of the next one */
+        };
+    
+        static size_t round_size(const size_t size) { return (size + alignment - 1)/alignment*alignment; }
+        FreeList*     find_free_list(const size_t);
+    
+        static MatrixArena*&      current();
+        static std::atomic<long>& heap_counter();
+        static std::atomic<long>& arena_counter();
+    
+        static const size_t alignment = 64;   /* bytes, alignment of the blocks */
+    
+        std::vector<Chunk>    chunks;       /* chunks, the last one being in use */
+        std::vector<FreeList> free_lists;   /* freed blocks, by size */
+        size_t                used;         /* bytes used in the last chunk */
+        int                   live;         /* allocations not freed yet */
+
+};
+
+#endif
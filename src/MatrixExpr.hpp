@@ -0,0 +1,740 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines the expression templates used by class Matrix. The
+operators +, -, * and the functions hadamard and transpose do not compute
+anything: they return a light object that describes the operation, and the
+whole expression is evaluated when it is assigned to a matrix:
+
+        D = hadamard(transpose(W)*D, hadamard(A, 1 - A));
+        W -= eta*NW;
+
+The element-wise part of an expression is evaluated in a single pass over
+the coefficients, without any intermediate matrix. When all the matrices
+of the expression have the same layout in memory as the destination and
+none of them has padded rows, the pass is a flat loop over the
+coefficients, otherwise the coefficients are accessed with their row and
+column.
+
+Products of matrices cannot be computed element by element. A product
+assigned to a matrix, possibly scaled (C = A*B, C += alpha*A*B, C -= A*B),
+is computed by the gemm engine directly into the destination. A product
+nested in an element-wise expression is computed first, into the
+destination itself when it is a new matrix, and the element-wise pass then
+reads it from there. The operands of a product are read in place when they
+are matrices or transposed matrices, other expressions are evaluated first.
+
+Any function can be applied element-wise with map and zip, which take a
+functor of one or two coefficients. They are expressions like the others,
+so they compose with the operators in a single pass:
+
+        W.zip(W, NW, [=](const T w, const T nw) { return decay*w - eta*nw; });
+        E = map(A - Y, [](const T x) { return x*x; });
+
+The single pass is the engine of all the element-wise expressions. When the
+layouts match, every row in memory, or the whole coefficients when there is
+no padding, goes through a loop compiled once per instruction set (SSE4.1,
+AVX2 and AVX-512), with the functors inlined, so the compiler vectorizes
+and unrolls it; the loop of the instruction set selected at startup is
+called (see SIMD.hpp). Expressions with at least parallel_threshold
+coefficients are split over the threads of the pool (see ThreadPool.hpp).
+
+Assigning an expression to a matrix with = allocates a new matrix of
+coefficients, as copies of matrices share their coefficients: the previous
+coefficients may still be used by another matrix. The compound operators +=
+and -= write in place.
+
+Nested expressions are stored by value and matrices by reference, so an
+expression must be evaluated in the statement that creates it.
+*/
+
+#ifndef MatrixExpr_hpp
+#define MatrixExpr_hpp
+
+#include <vector>
+
+#include "Gemm.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+/* instruction set of a function, for the loops of the element-wise engine */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_EXPR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MATRIX_EXPR_TARGET(isa)
+#endif
+
+/* the coefficient k of the destination only depends on the coefficients k read, even in place */
+#if defined(__clang__)
+#define MATRIX_EXPR_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define MATRIX_EXPR_IVDEP _Pragma("GCC ivdep")
+#else
+#define MATRIX_EXPR_IVDEP
+#endif
+
+template<typename T> class Matrix;
+template<typename T> class MatrixLeaf;
+
+/*
+Base class of all the expressions, including Matrix itself.
+*/
+template<typename T, typename E>
+class MatrixExpr {
+
+    public:
+
+        typedef T value_type;
+
+        const E& derived() const { return static_cast<const E&>(*this); }
+
+};
+
+/*
+Type used to store an operand in an expression: matrices are stored as
+leaves pointing to their coefficients, expressions are stored by value.
+*/
+template<typename E> struct MatrixExprNested            { typedef E             type; };
+template<typename T> struct MatrixExprNested<Matrix<T>> { typedef MatrixLeaf<T> type; };
+
+template<typename E>
+using MatrixNested = typename MatrixExprNested<E>::type;
+
+/*
+Element-wise operations of two coefficients.
+*/
+struct ExprAdd { template<typename T> static T apply(const T a, const T b) { return a+b; } };
+struct ExprSub { template<typename T> static T apply(const T a, const T b) { return a-b; } };
+struct ExprMul { template<typename T> static T apply(const T a, const T b) { return a*b; } };
+
+/*
+Element-wise operations of a scalar and a coefficient.
+*/
+struct ExprScale { template<typename T> static T apply(const T alpha, const T x) { return alpha*x; } };
+struct ExprShift { template<typename T> static T apply(const T alpha, const T x) { return alpha+x; } };
+struct ExprRSub  { template<typename T> static T apply(const T alpha, const T x) { return alpha-x; } };
+
+/*
+Number of coefficients spanned in memory by a matrix of rows*cols
+coefficients in memory, with leading dimension ld.
+*/
+inline int matrix_extent(const int rows, const int cols, const int ld) {
+    return rows>0 && cols>0 ? (rows - 1)*ld + cols : 0;
+}
+
+/*
+All the expressions have the following interface:
+
+        get_I(), get_J()       number of rows and columns
+        operator()(i, j)       coefficient at row i, column j
+        get(r, k)              k-th coefficient of the r-th row in memory,
+                               when has_layout
+        has_layout(t)          tells whether get(r, k) follows the layout of
+                               a matrix transposed (t) or not
+        is_contiguous()        tells whether the rows in memory have no
+                               padding, so that get(0, k) reads all the
+                               coefficients as a single row
+        aliases(p, n)          tells whether any of the n coefficients from p
+                               is read
+        offsets(p, n, ld)      tells whether any of these coefficients is read
+                               at another position than its own in a
+                               destination of leading dimension ld, so that
+                               the destination cannot be written in place
+        prepare(dst, ld, used) computes the nested products, the first one
+                               into dst if dst is not null and not used yet
+
+A leaf reads the coefficients of a matrix, transposed or not. Views share
+the coefficients of their matrix at an offset, so aliasing is an overlap of
+the ranges of memory, not an equality of the first coefficients.
+*/
+template<typename T>
+class MatrixLeaf: public MatrixExpr<T, MatrixLeaf<T>> {
+
+    public:
+
+        MatrixLeaf(const Matrix<T>& M, const bool flip=false) :
+            data(M.matrix), rows(M.I), cols(M.J), ld(M.ld), step(rows==1 ? 1 : ld), trans(M.transpose!=flip) {}
+        MatrixLeaf(const T* const p_data, const int p_rows, const int p_cols, const int p_ld, const bool p_trans) :
+            data(p_data), rows(p_rows), cols(p_cols), ld(p_ld), step(rows==1 ? 1 : ld), trans(p_trans) {}
+
+        int      get_I()                          const { return trans ? cols : rows; }
+        int      get_J()                          const { return trans ? rows : cols; }
+        T        operator()(const int i, const int j) const { return trans ? data[j*ld + i] : data[i*ld + j]; }
+        T        get(const int r, const int k)    const { return data[r*step + k]; }
+        bool     has_layout(const bool t)         const { return t==trans || ((cols==1 || rows==1) && is_contiguous()); }
+        bool     aliases(const T* const p, const int n) const { return p<data + matrix_extent(rows, cols, ld) && data<p + n; }
+        bool     offsets(const T* const p, const int n, const int dst_ld) const { return aliases(p, n) && (p!=data || (rows>1 && ld!=dst_ld)); }
+        void     prepare(T* const, const int, bool&) const {}
+
+        const T* get_data()                       const { return data; }
+        int      get_ld()                         const { return ld; }
+        bool     is_transposed()                  const { return trans; }
+        bool     is_contiguous()                  const { return ld==cols || rows==1; }
+
+    private:
+
+        const T* data;    /* coefficients */
+        int      rows;    /* number of rows in memory */
+        int      cols;    /* number of columns in memory */
+        int      ld;      /* leading dimension */
+        int      step;    /* distance between two rows read by get, 1 for a row vector read as a column */
+        bool     trans;   /* tells whether the matrix is read transposed */
+
+};
+
+/*
+Element-wise operation of two expressions.
+*/
+template<typename T, typename L, typename R, typename Op>
+class MatrixBinary: public MatrixExpr<T, MatrixBinary<T, L, R, Op>> {
+
+    public:
+
+        MatrixBinary(const L& l, const R& r) :
+            lhs(l), rhs(r) {}
+
+        int  get_I()                              const { return lhs.get_I(); }
+        int  get_J()                              const { return lhs.get_J(); }
+        T    operator()(const int i, const int j) const { return Op::apply(lhs(i, j), rhs(i, j)); }
+        T    get(const int r, const int k)        const { return Op::apply(lhs.get(r, k), rhs.get(r, k)); }
+        bool has_layout(const bool t)             const { return lhs.has_layout(t) && rhs.has_layout(t); }
+        bool is_contiguous()                      const { return lhs.is_contiguous() && rhs.is_contiguous(); }
+        bool aliases(const T* const p, const int n) const { return lhs.aliases(p, n) || rhs.aliases(p, n); }
+        bool offsets(const T* const p, const int n, const int ld) const { return lhs.offsets(p, n, ld) || rhs.offsets(p, n, ld); }
+        void prepare(T* const dst, const int ld, bool& used) const { lhs.prepare(dst, ld, used); rhs.prepare(dst, ld, used); }
+
+    private:
+
+        const L lhs;
+        const R rhs;
+
+};
+
+/*
+Element-wise operation of a scalar and an expression.
+*/
+template<typename T, typename E, typename Op>
+class MatrixScalar: public MatrixExpr<T, MatrixScalar<T, E, Op>> {
+
+    public:
+
+        MatrixScalar(const T p_alpha, const E& e) :
+            alpha(p_alpha), expr(e) {}
+
+        int      get_I()                              const { return expr.get_I(); }
+        int      get_J()                              const { return expr.get_J(); }
+        T        operator()(const int i, const int j) const { return Op::apply(alpha, expr(i, j)); }
+        T        get(const int r, const int k)        const { return Op::apply(alpha, expr.get(r, k)); }
+        bool     has_layout(const bool t)             const { return expr.has_layout(t); }
+        bool     is_contiguous()                      const { return expr.is_contiguous(); }
+        bool     aliases(const T* const p, const int n)   const { return expr.aliases(p, n); }
+        bool     offsets(const T* const p, const int n, const int ld) const { return expr.offsets(p, n, ld); }
+        void     prepare(T* const dst, const int ld, bool& used) const { expr.prepare(dst, ld, used); }
+
+        T        get_alpha()                          const { return alpha; }
+        const E& get_expr()                           const { return expr; }
+
+    private:
+
+        const T alpha;
+        const E expr;
+
+};
+
+/*
+Functor applied to every coefficient of an expression (map).
+*/
+template<typename T, typename E, typename F>
+class MatrixMap: public MatrixExpr<T, MatrixMap<T, E, F>> {
+
+    public:
+
+        MatrixMap(const E& e, const F& f) :
+            expr(e), function(f) {}
+
+        int  get_I()                              const { return expr.get_I(); }
+        int  get_J()                              const { return expr.get_J(); }
+        T    operator()(const int i, const int j) const { return function(expr(i, j)); }
+        T    get(const int r, const int k)        const { return function(expr.get(r, k)); }
+        bool has_layout(const bool t)             const { return expr.has_layout(t); }
+        bool is_contiguous()                      const { return expr.is_contiguous(); }
+        bool aliases(const T* const p, const int n) const { return expr.aliases(p, n); }
+        bool offsets(const T* const p, const int n, const int ld) const { return expr.offsets(p, n, ld); }
+        void prepare(T* const dst, const int ld, bool& used) const { expr.prepare(dst, ld, used); }
+
+    private:
+
+        const E expr;
+        const F function;
+
+};
+
+/*
+Functor applied to the coefficients at the same position in two
+expressions (zip).
+*/
+template<typename T, typename L, typename R, typename F>
+class MatrixZip: public MatrixExpr<T, MatrixZip<T, L, R, F>> {
+
+    public:
+
+        MatrixZip(const L& l, const R& r, const F& f) :
+            lhs(l), rhs(r), function(f) {}
+
+        int  get_I()                              const { return lhs.get_I(); }
+        int  get_J()                              const { return lhs.get_J(); }
+        T    operator()(const int i, const int j) const { return function(lhs(i, j), rhs(i, j)); }
+        T    get(const int r, const int k)        const { return function(lhs.get(r, k), rhs.get(r, k)); }
+        bool has_layout(const bool t)             const { return lhs.has_layout(t) && rhs.has_layout(t); }
+        bool is_contiguous()                      const { return lhs.is_contiguous() && rhs.is_contiguous(); }
+        bool aliases(const T* const p, const int n) const { return lhs.aliases(p, n) || rhs.aliases(p, n); }
+        bool offsets(const T* const p, const int n, const int ld) const { return lhs.offsets(p, n, ld) || rhs.offsets(p, n, ld); }
+        void prepare(T* const dst, const int ld, bool& used) const { lhs.prepare(dst, ld, used); rhs.prepare(dst, ld, used); }
+
+    private:
+
+        const L lhs;
+        const R rhs;
+        const F function;
+
+};
+
+/*
+Operand of a product, as read by the gemm engine. Leaves are read in place,
+other expressions are evaluated into a row-major buffer.
+*/
+template<typename T>
+struct GemmOperand {
+
+    GemmOperand(const MatrixLeaf<T>& M) :
+        data(M.get_data()), ld(M.get_ld()), trans(M.is_transposed()) {}
+    template<typename E>
+    GemmOperand(const MatrixExpr<T, E>& e);
+
+    const T*       data;      /* coefficients */
+    int            ld;        /* leading dimension */
+    bool           trans;     /* tells whether the operand is transposed */
+    std::vector<T> storage;   /* coefficients of an evaluated expression */
+
+};
+
+/*
+Product of two expressions. Element access is only possible once the
+product has been computed by prepare.
+*/
+template<typename T, typename L, typename R>
+class MatrixProduct: public MatrixExpr<T, MatrixProduct<T, L, R>> {
+
+    public:
+
+        MatrixProduct(const L& l, const R& r) :
+            lhs(l), rhs(r), result(0), result_ld(0) {}
+
+        int  get_I()                              const { return lhs.get_I(); }
+        int  get_J()                              const { return rhs.get_J(); }
+        T    operator()(const int i, const int j) const { return result[i*result_ld + j]; }
+        T    get(const int r, const int k)        const { return result[r*(get_I()==1 ? 1 : result_ld) + k]; }
+        bool has_layout(const bool t)             const { return !t || ((get_I()==1 || get_J()==1) && is_contiguous()); }
+        bool is_contiguous()                      const { return result_ld==get_J() || get_I()==1; }
+        bool aliases(const T* const p, const int n) const { return lhs.aliases(p, n) || rhs.aliases(p, n); }
+        bool offsets(const T* const p, const int n, const int)  const { return aliases(p, n); }
+        void prepare(T* const, const int, bool&)  const;
+
+        void gemm(const T, const T, T* const, const int) const;
+
+    private:
+
+        const L                lhs;
+        const R                rhs;
+        mutable std::vector<T> storage;   /* result, when not computed into the destination */
+        mutable const T*       result;    /* coefficients of the result */
+        mutable int            result_ld; /* leading dimension of the result */
+
+};
+
+/*
+Evaluation of an expression into raw coefficients, laid out as a matrix
+transposed or not, with a leading dimension. The operation is one of set
+(=), add (+=) or sub (-=).
+The overloads handle the products and the scaled matrices, which are
+dispatched to the gemm engine and to the vectorized kernels.
+*/
+template<typename T>
+class MatrixAssign {
+
+    public:
+
+        enum Op {set, add, sub};
+
+        template<typename E>
+        static void run(const MatrixExpr<T, E>&, T* const, const int, const bool, const Op);
+        template<typename L, typename R>
+        static void run(const MatrixProduct<T, L, R>&, T* const, const int, const bool, const Op);
+        template<typename L, typename R>
+        static void run(const MatrixScalar<T, MatrixProduct<T, L, R>, ExprScale>&, T* const, const int, const bool, const Op);
+        static void run(const MatrixScalar<T, MatrixLeaf<T>, ExprScale>&, T* const, const int, const bool, const Op);
+
+        template<typename E>
+        static void element_wise(const E&, T* const, const int, const bool, const Op);
+
+        static const int parallel_threshold = 1 << 16;   /* coefficients from which a pass uses the thread pool */
+
+    private:
+
+        template<typename E, typename A>
+        static void loop(const E&, T* const, const int, const bool);
+        template<typename E, typename A>
+        static void pass(const E&, T* const, const int, const int, const int);
+        template<typename E, typename A>
+        static void span(const E&, T* const, const int, const int, const int);
+        template<typename E, typename A> MATRIX_EXPR_TARGET("sse4.1")
+        static void span_sse4(const E&, T* const, const int, const int, const int);
+        template<typename E, typename A> MATRIX_EXPR_TARGET("avx2,fma")
+        static void span_avx2(const E&, T* const, const int, const int, const int);
+        template<typename E, typename A> MATRIX_EXPR_TARGET("avx512f,fma")
+        static void span_avx512(const E&, T* const, const int, const int, const int);
+        template<typename E>
+        static bool is_contiguous(const E&, const int, const bool);
+        template<typename E>
+        static int  extent(const E&, const int, const bool);
+
+        struct Set { static void apply(T& d, const T x) { d  = x; } };
+        struct Add { static void apply(T& d, const T x) { d += x; } };
+        struct Sub { static void apply(T& d, const T x) { d -= x; } };
+
+};
+
+template<typename T> const int MatrixAssign<T>::parallel_threshold;
+
+
+
+/*
+Operators building the expressions. The dimensions are checked when the
+expression is built.
+*/
+template<typename T, typename L, typename R>
+void check_expr_dimensions(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b, const bool product, const std::string& desc, const std::string& function) {
+    const L& l = a.derived();
+    const R& r = b.derived();
+    if((product && l.get_J()!=r.get_I()) || (!product && (l.get_I()!=r.get_I() || l.get_J()!=r.get_J()))) {
+        const std::string infos = Matrix<T>::Exception::create_infos_dimensions(l.get_I(), l.get_J(), r.get_I(), r.get_J(), function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+}
+template<typename T, typename L, typename R>
+MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprAdd> operator+(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b) {
+    check_expr_dimensions(a, b, false, "Unable to add these two matrices (A+B): dimensions don't match.", "operator+(A, B)");
+    return MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprAdd>(a.derived(), b.derived());
+}
+template<typename T, typename L, typename R>
+MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprSub> operator-(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b) {
+    check_expr_dimensions(a, b, false, "Unable to substract these two matrices (A-B): dimensions don't match.", "operator-(A, B)");
+    return MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprSub>(a.derived(), b.derived());
+}
+template<typename T, typename L, typename R>
+MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprMul> hadamard(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b) {
+    check_expr_dimensions(a, b, false, "Unable to perform Hadamard product with these two matrices (A°B): dimensions don't match.", "hadamard(A, B)");
+    return MatrixBinary<T, MatrixNested<L>, MatrixNested<R>, ExprMul>(a.derived(), b.derived());
+}
+template<typename T, typename L, typename R>
+MatrixProduct<T, MatrixNested<L>, MatrixNested<R>> operator*(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b) {
+    check_expr_dimensions(a, b, true, "Unable to multiply these two matrices (A*B): dimensions don't match.", "operator*(A, B)");
+    return MatrixProduct<T, MatrixNested<L>, MatrixNested<R>>(a.derived(), b.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprScale> operator*(const typename MatrixExpr<T, E>::value_type alpha, const MatrixExpr<T, E>& e) {
+    return MatrixScalar<T, MatrixNested<E>, ExprScale>(alpha, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprScale> operator*(const MatrixExpr<T, E>& e, const typename MatrixExpr<T, E>::value_type alpha) {
+    return MatrixScalar<T, MatrixNested<E>, ExprScale>(alpha, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprScale> operator-(const MatrixExpr<T, E>& e) {
+    return MatrixScalar<T, MatrixNested<E>, ExprScale>(-1, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprShift> operator+(const typename MatrixExpr<T, E>::value_type alpha, const MatrixExpr<T, E>& e) {
+    return MatrixScalar<T, MatrixNested<E>, ExprShift>(alpha, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprShift> operator+(const MatrixExpr<T, E>& e, const typename MatrixExpr<T, E>::value_type alpha) {
+    return MatrixScalar<T, MatrixNested<E>, ExprShift>(alpha, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprRSub> operator-(const typename MatrixExpr<T, E>::value_type alpha, const MatrixExpr<T, E>& e) {
+    return MatrixScalar<T, MatrixNested<E>, ExprRSub>(alpha, e.derived());
+}
+template<typename T, typename E>
+MatrixScalar<T, MatrixNested<E>, ExprShift> operator-(const MatrixExpr<T, E>& e, const typename MatrixExpr<T, E>::value_type alpha) {
+    return MatrixScalar<T, MatrixNested<E>, ExprShift>(-alpha, e.derived());
+}
+
+/*
+Functors applied element-wise. The dimensions of zip are checked when the
+expression is built.
+*/
+template<typename T, typename E, typename F>
+MatrixMap<T, MatrixNested<E>, F> map(const MatrixExpr<T, E>& e, const F& f) {
+    return MatrixMap<T, MatrixNested<E>, F>(e.derived(), f);
+}
+template<typename T, typename L, typename R, typename F>
+MatrixZip<T, MatrixNested<L>, MatrixNested<R>, F> zip(const MatrixExpr<T, L>& a, const MatrixExpr<T, R>& b, const F& f) {
+    check_expr_dimensions(a, b, false, "Unable to zip these two matrices: dimensions don't match.", "zip(A, B, f)");
+    return MatrixZip<T, MatrixNested<L>, MatrixNested<R>, F>(a.derived(), b.derived(), f);
+}
+
+/*
+Transposed matrix, read in place.
+*/
+template<typename T>
+MatrixLeaf<T> transpose(const Matrix<T>& M) {
+    return MatrixLeaf<T>(M, true);
+}
+
+/*
+Evaluates an expression used as the operand of a product.
+*/
+template<typename T>
+template<typename E>
+GemmOperand<T>::GemmOperand(const MatrixExpr<T, E>& e) :
+    ld(e.derived().get_J()),
+    trans(false),
+    storage(e.derived().get_I()*e.derived().get_J()) {
+    MatrixAssign<T>::run(e, storage.data(), ld, false, MatrixAssign<T>::set);
+    data = storage.data();
+}
+
+/*
+Computes the product when it is nested in an element-wise expression.
+*/
+template<typename T, typename L, typename R>
+void MatrixProduct<T, L, R>::prepare(T* const dst, const int dst_ld, bool& used) const {
+    if(dst && !used) {
+        gemm(1, 0, dst, dst_ld);
+        result    = dst;
+        result_ld = dst_ld;
+        used      = true;
+    }
+    else {
+        storage.resize(get_I()*get_J());
+        gemm(1, 0, storage.data(), get_J());
+        result    = storage.data();
+        result_ld = get_J();
+    }
+}
+
+/*
+C = alpha*lhs*rhs + beta*C, C being row-major.
+*/
+template<typename T, typename L, typename R>
+void MatrixProduct<T, L, R>::gemm(const T alpha, const T beta, T* const C, const int ldc) const {
+    const GemmOperand<T> a(lhs);
+    const GemmOperand<T> b(rhs);
+    Gemm<T>::gemm(a.trans, b.trans, get_I(), get_J(), lhs.get_J(), alpha, a.data, a.ld, b.data, b.ld, beta, C, ldc);
+}
+
+/*
+Generic case: element-wise evaluation.
+*/
+template<typename T>
+template<typename E>
+void MatrixAssign<T>::run(const MatrixExpr<T, E>& e, T* const dst, const int dst_ld, const bool dst_trans, const Op op) {
+    element_wise(e.derived(), dst, dst_ld, dst_trans, op);
+}
+
+/*
+Products are computed by the gemm engine directly into the destination,
+unless it is transposed or read by the product.
+*/
+template<typename T>
+template<typename L, typename R>
+void MatrixAssign<T>::run(const MatrixProduct<T, L, R>& e, T* const dst, const int dst_ld, const bool dst_trans, const Op op) {
+    if(dst_trans || (op!=set && e.aliases(dst, extent(e, dst_ld, dst_trans)))) element_wise(e, dst, dst_ld, dst_trans, op);
+    else                                                                        e.gemm(op==sub ? -1 : 1, op==set ? 0 : 1, dst, dst_ld);
+}
+template<typename T>
+template<typename L, typename R>
+void MatrixAssign<T>::run(const MatrixScalar<T, MatrixProduct<T, L, R>, ExprScale>& e, T* const dst, const int dst_ld, const bool dst_trans, const Op op) {
+    const MatrixProduct<T, L, R>& p = e.get_expr();
+    if(dst_trans || (op!=set && p.aliases(dst, extent(e, dst_ld, dst_trans)))) element_wise(e, dst, dst_ld, dst_trans, op);
+    else                                                                        p.gemm(op==sub ? -e.get_alpha() : e.get_alpha(), op==set ? 0 : 1, dst, dst_ld);
+}
+
+/*
+Scaled matrices use the vectorized kernels when their layout is the one
+of the destination, on the whole coefficients or row by row.
+*/
+template<typename T>
+void MatrixAssign<T>::run(const MatrixScalar<T, MatrixLeaf<T>, ExprScale>& e, T* const dst, const int dst_ld, const bool dst_trans, const Op op) {
+    const MatrixLeaf<T>& M = e.get_expr();
+    const T alpha = op==sub ? -e.get_alpha() : e.get_alpha();
+    const T beta  = op==set ? 0 : 1;
+    if(M.has_layout(dst_trans) && M.is_contiguous() && is_contiguous(M, dst_ld, dst_trans)) {
+        SIMD::kernels<T>().axpby(M.get_I()*M.get_J(), alpha, M.get_data(), beta, dst);
+    }
+    else if(M.is_transposed()==dst_trans) {
+        const int rows = dst_trans ? M.get_J() : M.get_I();
+        const int cols = dst_trans ? M.get_I() : M.get_J();
+        for(int i=0 ; i<rows ; i++) SIMD::kernels<T>().axpby(cols, alpha, M.get_data() + i*M.get_ld(), beta, dst + i*dst_ld);
+    }
+    else {
+        element_wise(e, dst, dst_ld, dst_trans, op);
+    }
+}
+
+/*
+Element-wise evaluation. The nested products are computed first, into the
+destination when it is overwritten and not read by the expression. When the
+destination is read by the expression with another layout, or at other
+positions as through an overlapping view, the expression is evaluated into a
+buffer first, so that no coefficient is overwritten before being read.
+*/
+template<typename T>
+template<typename E>
+void MatrixAssign<T>::element_wise(const E& e, T* const dst, const int dst_ld, const bool dst_trans, const Op op) {
+    const int n = extent(e, dst_ld, dst_trans);
+    if(e.aliases(dst, n) && (!e.has_layout(dst_trans) || e.offsets(dst, n, dst_ld))) {
+        std::vector<T> buffer(e.get_I()*e.get_J());
+        element_wise(e, buffer.data(), e.get_J(), false, set);
+        element_wise(MatrixLeaf<T>(buffer.data(), e.get_I(), e.get_J(), e.get_J(), false), dst, dst_ld, dst_trans, op);
+        return;
+    }
+    bool used = false;
+    e.prepare(op==set && !dst_trans && !e.aliases(dst, n) ? dst : 0, dst_ld, used);
+    switch(op) {
+        case set: loop<E, Set>(e, dst, dst_ld, dst_trans); break;
+        case add: loop<E, Add>(e, dst, dst_ld, dst_trans); break;
+        case sub: loop<E, Sub>(e, dst, dst_ld, dst_trans); break;
+    }
+}
+
+/*
+Single pass over the coefficients. When the layouts match, the rows in
+memory are processed by the loops of the engine, as one row when there is
+no padding. Otherwise the coefficients are accessed with their row and
+column.
+*/
+template<typename T>
+template<typename E, typename A>
+void MatrixAssign<T>::loop(const E& e, T* const dst, const int dst_ld, const bool dst_trans) {
+    const int I = e.get_I();
+    const int J = e.get_J();
+    if(e.has_layout(dst_trans)) {
+        if(e.is_contiguous() && is_contiguous(e, dst_ld, dst_trans)) pass<E, A>(e, dst, 0, 1, I*J);
+        else if(!dst_trans)                                          pass<E, A>(e, dst, dst_ld, I, J);
+        else                                                         pass<E, A>(e, dst, dst_ld, J, I);
+    }
+    else if(!dst_trans) {
+        for(int i=0 ; i<I ; i++) {
+            for(int j=0 ; j<J ; j++) A::apply(dst[i*dst_ld + j], e(i, j));
+        }
+    }
+    else {
+        for(int j=0 ; j<J ; j++) {
+            for(int i=0 ; i<I ; i++) A::apply(dst[j*dst_ld + i], e(i, j));
+        }
+    }
+}
+
+/*
+Pass over the rows in memory, split over the threads when large: by rows,
+or in parts starting on cache lines when there is a single row.
+*/
+template<typename T>
+template<typename E, typename A>
+void MatrixAssign<T>::pass(const E& e, T* const dst, const int dst_ld, const int rows, const int cols) {
+    if(rows==1) {
+        const auto part = [&](const int begin, const int end) { span<E, A>(e, dst, 0, begin, end); };
+        if(cols>=parallel_threshold) ThreadPool::parallel_for(cols, SIMD::alignment/static_cast<int>(sizeof(T)), part);
+        else                         part(0, cols);
+    }
+    else {
+        const auto part = [&](const int begin, const int end) {
+            for(int r=begin ; r<end ; r++) span<E, A>(e, dst + r*dst_ld, r, 0, cols);
+        };
+        if(static_cast<long>(rows)*cols>=parallel_threshold) ThreadPool::parallel_for(rows, 1, part);
+        else                                                 part(0, rows);
+    }
+}
+
+/*
+Coefficients begin to end-1 of the row r, dst pointing to the row of the
+destination, with the loop compiled for the instruction set selected at
+startup. The loops are the same, only the instructions the compiler may use
+differ.
+*/
+template<typename T>
+template<typename E, typename A>
+void MatrixAssign<T>::span(const E& e, T* const dst, const int r, const int begin, const int end) {
+    switch(SIMD::get_isa()) {
+        case SIMD::isa_avx512: span_avx512<E, A>(e, dst, r, begin, end); break;
+        case SIMD::isa_avx2:   span_avx2<E, A>(e, dst, r, begin, end);   break;
+        case SIMD::isa_sse4:   span_sse4<E, A>(e, dst, r, begin, end);   break;
+        default:
+            MATRIX_EXPR_IVDEP
+            for(int k=begin ; k<end ; k++) A::apply(dst[k], e.get(r, k));
+    }
+}
+template<typename T>
+template<typename E, typename A> MATRIX_EXPR_TARGET("sse4.1")
+void MatrixAssign<T>::span_sse4(const E& e, T* const dst, const int r, const int begin, const int end) {
+    MATRIX_EXPR_IVDEP
+    for(int k=begin ; k<end ; k++) A::apply(dst[k], e.get(r, k));
+}
+template<typename T>
+template<typename E, typename A> MATRIX_EXPR_TARGET("avx2,fma")
+void MatrixAssign<T>::span_avx2(const E& e, T* const dst, const int r, const int begin, const int end) {
+    MATRIX_EXPR_IVDEP
+    for(int k=begin ; k<end ; k++) A::apply(dst[k], e.get(r, k));
+}
+template<typename T>
+template<typename E, typename A> MATRIX_EXPR_TARGET("avx512f,fma")
+void MatrixAssign<T>::span_avx512(const E& e, T* const dst, const int r, const int begin, const int end) {
+    MATRIX_EXPR_IVDEP
+    for(int k=begin ; k<end ; k++) A::apply(dst[k], e.get(r, k));
+}
+
+/*
+Tells whether the destination of an expression has no padding.
+*/
+template<typename T>
+template<typename E>
+bool MatrixAssign<T>::is_contiguous(const E& e, const int dst_ld, const bool dst_trans) {
+    const int rows = dst_trans ? e.get_J() : e.get_I();
+    const int cols = dst_trans ? e.get_I() : e.get_J();
+    return dst_ld==cols || rows==1;
+}
+
+/*
+Number of coefficients spanned by the destination of an expression.
+*/
+template<typename T>
+template<typename E>
+int MatrixAssign<T>::extent(const E& e, const int dst_ld, const bool dst_trans) {
+    const int rows = dst_trans ? e.get_J() : e.get_I();
+    const int cols = dst_trans ? e.get_I() : e.get_J();
+    return matrix_extent(rows, cols, dst_ld);
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines a view on the coefficients of a matrix, or on any array
+of coefficients laid out as a matrix. A view does not own its coefficients:
+it reads and writes the ones of the matrix or the array it was created
+from, which must outlive it. It can address a block of a matrix, one of its
+rows or columns, or an external buffer, without copying anything:
+
+    MatrixView<float> W1(W, 0, 0, 50, 784);             // first 50 rows of W
+    MatrixView<float> x = MatrixView<float>::column(X, k);
+    MatrixView<float> images(data, 60000, 784, 784);    // one picture per row
+
+The block is given with the row and column of its first coefficient and its
+dimensions, in the coordinates of the viewed matrix (transposed or not).
+
+A view is a matrix whose leading dimension is the one of the viewed matrix:
+the coefficients of a row are contiguous and two rows are ld coefficients
+apart. It can therefore be given to every function of class Matrix, and
+used in the expressions. The columns of a matrix stored row by row are not
+contiguous though, the kernels then handle them coefficient by coefficient.
+A batch of pictures is better stored with one picture per row in memory and
+read through the transposed matrix, whose columns are contiguous.
+
+Assigning a matrix or an expression to a view with =, += or -= writes to the
+viewed coefficients, the dimensions must match. A view copied to a matrix
+gives a matrix pointing at the same coefficients, a deep copy creates a new
+matrix owning its coefficients.
+*/
+
+#ifndef MatrixView_hpp
+#define MatrixView_hpp
+
+#include "Matrix.hpp"
+
+template<typename T>
+class MatrixView: public Matrix<T> {
+
+    public:
+    
+        MatrixView(const Matrix<T>&, const int, const int, const int, const int);
+        MatrixView(T* const, const int, const int, const int);
+        MatrixView(const MatrixView&);
+    
+        static MatrixView row(const Matrix<T>&, const int);
+        static MatrixView column(const Matrix<T>&, const int);
+    
+        MatrixView& operator=(const MatrixView&);
+        MatrixView& operator=(const Matrix<T>&);
+        template<typename E>
+        MatrixView& operator=(const MatrixExpr<T, E>&);
+    
+    private:
+    
+        static T* block_data(const Matrix<T>&, const int, const int);
+
+};
+
+
+
+/*
+Views the block of M starting at row i and column j, with I rows and J
+columns. The block is read in the layout of M.
+*/
+template<typename T>
+MatrixView<T>::MatrixView(const Matrix<T>& M, const int i, const int j, const int I, const int J) :
+    Matrix<T>(block_data(M, i, j), M.transpose ? J : I, M.transpose ? I : J, M.ld, M.transpose) {
+    if(i<0 || j<0 || I<0 || J<0 || i+I>M.get_I() || j+J>M.get_J()) {
+        const std::string desc     = "Unable to create the view: the block is out of the matrix.";
+        const std::string function = "MatrixView<T>::MatrixView(const Matrix<T>& M, const int i, const int j, const int I, const int J)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(M.get_I(), M.get_J(), i+I, j+J, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+}
+
+/*
+Views an array of I rows of J coefficients, two rows being ld coefficients
+apart.
+*/
+template<typename T>
+MatrixView<T>::MatrixView(T* const data, const int I, const int J, const int ld) :
+    Matrix<T>(data, I, J, ld, false) {
+}
+
+/*
+Views the same coefficients as V.
+*/
+template<typename T>
+MatrixView<T>::MatrixView(const MatrixView<T>& V) :
+    Matrix<T>(V) {
+}
+
+/*
+Views row i or column j of M.
+*/
+template<typename T>
+MatrixView<T> MatrixView<T>::row(const Matrix<T>& M, const int i) {
+    return MatrixView<T>(M, i, 0, 1, M.get_J());
+}
+template<typename T>
+MatrixView<T> MatrixView<T>::column(const Matrix<T>& M, const int j) {
+    return MatrixView<T>(M, 0, j, M.get_I(), 1);
+}
+
+/*
+Copies the coefficients of B to the viewed coefficients.
+*/
+template<typename T>
+MatrixView<T>& MatrixView<T>::operator=(const MatrixView<T>& B) {
+    return *this = static_cast<const Matrix<T>&>(B);
+}
+template<typename T>
+MatrixView<T>& MatrixView<T>::operator=(const Matrix<T>& B) {
+    if(this!=&B) *this = MatrixLeaf<T>(B);
+    return *this;
+}
+
+/*
+Evaluates the expression into the viewed coefficients. An expression that
+reads them is evaluated in a new matrix first.
+*/
+template<typename T>
+template<typename E>
+MatrixView<T>& MatrixView<T>::operator=(const MatrixExpr<T, E>& e) {
+    const E& x = e.derived();
+    if(this->get_I()!=x.get_I() || this->get_J()!=x.get_J()) {
+        const std::string desc     = "Unable to assign to the view: dimensions don't match.";
+        const std::string function = "MatrixView<T>& MatrixView<T>::operator=(const MatrixExpr<T, E>& e)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(this->get_I(), this->get_J(), x.get_I(), x.get_J(), function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    if(x.aliases(this->matrix, this->extent())) {
+        const Matrix<T> result(e);
+        MatrixAssign<T>::run(MatrixLeaf<T>(result), this->matrix, this->ld, this->transpose, MatrixAssign<T>::set);
+    }
+    else {
+        MatrixAssign<T>::run(x, this->matrix, this->ld, this->transpose, MatrixAssign<T>::set);
+    }
+    return *this;
+}
+
+/*
+Address of the coefficient at row i and column j of M.
+*/
+template<typename T>
+T* MatrixView<T>::block_data(const Matrix<T>& M, const int i, const int j) {
+    return M.transpose ? M.matrix + j*M.ld + i : M.matrix + i*M.ld + j;
+}
+
+#endif
@@ -0,0 +1,318 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines feedforward neural networks quantized to 8 bits after
+training, for inference only. They are created from a trained FNN and a set
+of calibration pictures, or loaded from a file:
+
+    QuantizedFNN<float> qnn(fnn, calibration);     // one picture per column
+    qnn.save("fnn_q8.txt");
+    int digit = qnn.classify(pixels);
+
+Every weight matrix W is stored in int8 with one scale per row: the row is
+divided by the largest absolute value of its coefficients and multiplied by
+127. The inputs of a layer are stored in 7 bits, from 0 to 127, with one
+scale per layer. The inputs of all the layers are positive (pixels and
+sigmoids), and their scales are calibrated: they are the largest input of
+the layer over the calibration pictures, computed by the float network. The
+biases are stored in int32 at the scale of the products, so that they are
+added to the products without rounding:
+
+        W(i, k) ~ sw(i) * Wq(i, k)         Wq in int8
+        x(k)    ~ sx * xq(k)               xq in 7 bits
+        B(i)    ~ sw(i) * sx * Bq(i)       Bq in int32
+        W*x + B ~ sw(i) * sx * (Wq*xq + Bq)(i)
+
+The inputs are rounded to 7 bits, the products Wq*xq + Bq computed in
+integers and converted back to T by vectorized kernels (see SIMD.hpp), then
+given to the sigmoid. The weights take four times less memory than in
+float. The first layer stores Wq by groups of 4 columns (see SIMD.hpp):
+most pixels of a picture are 0, and only the groups of columns of the other
+ones are read.
+
+The file of a quantized network is a text file, with the same structure as
+the file of a network (see README.md). Each layer is given by the scale of
+its inputs, then the scales of the rows of W, the rows of Wq and Bq.
+*/
+
+#ifndef QuantizedFNN_hpp
+#define QuantizedFNN_hpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "FNN.hpp"
+#include "Matrix.hpp"
+#include "MatrixView.hpp"
+#include "SIMD.hpp"
+
+template<typename T>
+class QuantizedFNN {
+
+    public:
+    
+        QuantizedFNN(FNN<T>&, const Matrix<T>&);
+    
+        static QuantizedFNN* load(const std::string&);
+        bool                 save(const std::string&) const;
+        static bool          supports(const std::vector<int>&);
+    
+        std::vector<int> get_layers() const                     { return nodes; }
+        void             set_sigmoid(const SIMD::Sigmoid p_tier) { tier = p_tier; }
+        size_t           get_weights_size() const;
+    
+        int classify(const T* const) const;
+    
+    private:
+    
+        struct Layer {
+            int                                           rows;          /* nodes of the layer */
+            int                                           cols;          /* nodes of the previous layer */
+            int                                           ld;            /* distance between two rows of Wq, or two groups of columns, in bytes */
+            bool                                          by_columns;    /* Wq stored by groups of 4 columns, for the sparse pictures */
+            T                                             input_scale;   /* scale of the inputs, sx */
+            std::vector<T>                                row_scales;    /* scales of the rows of W, sw */
+            std::vector<T>                                out_scales;    /* scales of the products, sw*sx */
+            std::vector<int8_t, AlignedAllocator<int8_t>> Wq;            /* weights */
+            std::vector<int32_t>                          Bq;            /* biases */
+        };
+    
+        QuantizedFNN() : tier(SIMD::sigmoid_poly), width(0) {}
+    
+        static void   init_layer(Layer&, const int, const int, const bool);
+        static size_t offset(const Layer& l, const int i, const int k) { return l.by_columns ? static_cast<size_t>(k/4)*l.ld + 4*i + k%4 : static_cast<size_t>(i)*l.ld + k; }
+        static void   quantize_layer(Layer&, const Matrix<T>&, const Matrix<T>&, const T);
+        static bool   is_scale(const T s) { return s>0 && s<=std::numeric_limits<T>::max(); }
+    
+        static const int max_nodes = 1 << 16;   /* nodes of a layer, so that the products Wq*xq fit in 31 bits */
+        static const int max_bias  = 1 << 30;   /* largest |Bq|, so that Wq*xq + Bq fits in int32 */
+    
+        std::vector<int>   nodes;    /* number of nodes of every layer */
+        std::vector<Layer> layers;   /* quantized fully connected layers */
+        SIMD::Sigmoid      tier;     /* sigmoid tier */
+        int                width;    /* largest number of nodes */
+
+};
+
+template<typename T> const int QuantizedFNN<T>::max_nodes;
+template<typename T> const int QuantizedFNN<T>::max_bias;
+
+
+
+/*
+Quantizes fnn, whose layers must be accepted by supports. The scales of the
+inputs of the layers are calibrated on the pictures of calibration, one per
+column.
+*/
+template<typename T>
+QuantizedFNN<T>::QuantizedFNN(FNN<T>& fnn, const Matrix<T>& calibration) :
+    nodes(fnn.get_layers()),
+    tier(fnn.get_inference_sigmoid()),
+    width(*std::max_element(nodes.begin(), nodes.end())) {
+    /* largest input of every layer */
+    std::vector<T>         max_inputs(nodes.size()-1, 0);
+    std::vector<Matrix<T>> activations = fnn.create_activations();
+    for(int j=0 ; j<calibration.get_J() ; j++) {
+        const MatrixView<T> x = MatrixView<T>::column(calibration, j);
+        fnn.feedforward(&x, activations);
+        for(int k=0 ; k<x.get_I() ; k++) max_inputs[0] = std::max(max_inputs[0], x(k, 0));
+        for(size_t i=1 ; i<max_inputs.size() ; i++) {
+            for(int k=0 ; k<activations[i-1].get_I() ; k++) max_inputs[i] = std::max(max_inputs[i], activations[i-1](k, 0));
+        }
+    }
+    /* quantized layers */
+    layers.resize(nodes.size()-1);
+    for(size_t i=0 ; i<layers.size() ; i++) {
+        init_layer(layers[i], nodes[i+1], nodes[i], i==0);
+        FNNFullyConnectedLayer<T>* layer = fnn.get_fully_connected_layer(static_cast<int>(i));
+        quantize_layer(layers[i], *layer->get_weights(), *layer->get_biases(), max_inputs[i]);
+    }
+}
+
+/*
+Sets the dimensions of a layer and allocates its coefficients, by groups of
+4 columns or by rows. The rows, or the groups, of Wq start on cache lines,
+and are padded with zeros.
+*/
+template<typename T>
+void QuantizedFNN<T>::init_layer(Layer& l, const int rows, const int cols, const bool by_columns) {
+    l.rows       = rows;
+    l.cols       = cols;
+    l.by_columns = by_columns;
+    l.ld         = ((by_columns ? rows : cols) + SIMD::alignment - 1)/SIMD::alignment*SIMD::alignment*(by_columns ? 4 : 1);
+    l.row_scales.assign(rows, 0);
+    l.out_scales.assign(rows, 0);
+    l.Wq.assign(static_cast<size_t>(by_columns ? (cols + 3)/4 : rows)*l.ld, 0);
+    l.Bq.assign(rows, 0);
+}
+
+/*
+Quantizes W and B, the largest input of the layer being max_input. The
+scales are floored at the smallest normal T, so that no division overflows,
+and the biases are clamped to max_bias: a bias too large for the scale of
+the products saturates instead of wrapping around.
+*/
+template<typename T>
+void QuantizedFNN<T>::quantize_layer(Layer& l, const Matrix<T>& W, const Matrix<T>& B, const T max_input) {
+    const T epsilon = std::numeric_limits<T>::min();
+    l.input_scale = max_input>0 ? std::max(max_input/127, epsilon) : static_cast<T>(1)/127;
+    for(int i=0 ; i<l.rows ; i++) {
+        T max_w = 0;
+        for(int k=0 ; k<l.cols ; k++) max_w = std::max(max_w, std::abs(W(i, k)));
+        l.row_scales[i] = max_w>0 ? std::max(max_w/127, epsilon) : 1;
+        l.out_scales[i] = std::max(l.row_scales[i]*l.input_scale, epsilon);
+        for(int k=0 ; k<l.cols ; k++) l.Wq[offset(l, i, k)] = static_cast<int8_t>(std::lround(W(i, k)/l.row_scales[i]));
+        const T b = B(i, 0)/l.out_scales[i];
+        l.Bq[i] = b>=max_bias ? max_bias : (b<=-max_bias ? -max_bias : static_cast<int32_t>(std::lround(b)));
+    }
+}
+
+/*
+Returns the index of the output node with the highest value for the input
+x, an array with as many coefficients as the input layer has nodes. Every
+layer rounds its inputs to 7 bits, computes the products in integers and
+applies the sigmoid to them in T. The product of the first layer skips the
+pixels rounded to 0. The other products run over the padding of the rows,
+whose weights are 0, so that the kernel only works on whole registers.
+*/
+template<typename T>
+int QuantizedFNN<T>::classify(const T* const x) const {
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    static thread_local std::vector<uint8_t, AlignedAllocator<uint8_t>> xq;
+    static thread_local std::vector<int32_t, AlignedAllocator<int32_t>> yq;
+    static thread_local std::vector<T, AlignedAllocator<T>>             a;
+    const size_t size = (width + SIMD::alignment - 1)/SIMD::alignment*SIMD::alignment;
+    if(xq.size()<size) { xq.resize(size); yq.resize(size); a.resize(size); }
+    const T* input = x;
+    for(const Layer& l : layers) {
+        kernels.quantize(l.cols, 1/l.input_scale, input, xq.data());
+        if(l.by_columns) kernels.gemv_int8_columns(l.rows, l.cols, l.Wq.data(), l.ld, xq.data(), l.Bq.data(), yq.data());
+        else             kernels.gemv_int8(l.rows, l.ld, l.Wq.data(), l.ld, xq.data(), l.Bq.data(), yq.data());
+        kernels.dequantize(l.rows, yq.data(), l.out_scales.data(), a.data());
+        kernels.sigmoid[tier](l.rows, a.data());
+        input = a.data();
+    }
+    int kmax = 0;
+    for(int k=1 ; k<nodes.back() ; k++) { if(a[k]>a[kmax]) kmax = k; }
+    return kmax;
+}
+
+/*
+Size of the quantized weights in bytes, padding included.
+*/
+template<typename T>
+size_t QuantizedFNN<T>::get_weights_size() const {
+    size_t size = 0;
+    for(const Layer& l : layers) size += l.Wq.size();
+    return size;
+}
+
+/*
+Tells whether a network with these layers can be quantized: it needs at
+least two layers, and every layer must have between 1 and max_nodes nodes.
+*/
+template<typename T>
+bool QuantizedFNN<T>::supports(const std::vector<int>& layers) {
+    if(layers.size()<2) return false;
+    for(const int n : layers) { if(n<1 || n>max_nodes) return false; }
+    return true;
+}
+
+/*
+Loads a quantized network saved by save. Returns 0 if the file cannot be
+read or is not a valid network: its layers must be accepted by supports,
+the layers are read with the dimensions given by their neighbours, the
+scales must be positive and finite, the weights must fit in int8 and the
+biases must not exceed max_bias, so that classify never reads out of its
+buffers or overflows.
+*/
+template<typename T>
+QuantizedFNN<T>* QuantizedFNN<T>::load(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) return 0;
+    QuantizedFNN* q = new QuantizedFNN();
+    int nb_layers = 0;
+    file >> nb_layers;
+    if(!file || nb_layers<2 || nb_layers>max_nodes) { delete q; return 0; }
+    for(int i=0 ; i<nb_layers ; i++) {
+        int nb_nodes = 0;
+        file >> nb_nodes;
+        if(!file) { delete q; return 0; }
+        q->nodes.push_back(nb_nodes);
+    }
+    if(!supports(q->nodes)) { delete q; return 0; }
+    q->width = *std::max_element(q->nodes.begin(), q->nodes.end());
+    q->layers.resize(nb_layers-1);
+    for(int i=0 ; i<nb_layers-1 ; i++) {
+        Layer& l = q->layers[i];
+        init_layer(l, q->nodes[i+1], q->nodes[i], i==0);
+        bool valid = true;
+        file >> l.input_scale;
+        valid = valid && is_scale(l.input_scale);
+        for(int j=0 ; j<l.rows ; j++) { file >> l.row_scales[j]; valid = valid && is_scale(l.row_scales[j]); }
+        for(int j=0 ; j<l.rows ; j++) {
+            for(int k=0 ; k<l.cols ; k++) { int w = 0; file >> w; valid = valid && w>=-127 && w<=127; l.Wq[offset(l, j, k)] = static_cast<int8_t>(w); }
+        }
+        for(int j=0 ; j<l.rows ; j++) {
+            file >> l.Bq[j];
+            valid = valid && l.Bq[j]>=-max_bias && l.Bq[j]<=max_bias;
+            l.out_scales[j] = l.row_scales[j]*l.input_scale;
+            valid = valid && is_scale(l.out_scales[j]);
+        }
+        if(!file || !valid) { delete q; return 0; }
+    }
+    return q;
+}
+
+/*
+Saves the quantized network to a text file. Returns false if the file
+cannot be written.
+*/
+template<typename T>
+bool QuantizedFNN<T>::save(const std::string& path) const {
+    std::ofstream file(path);
+    if(!file) return false;
+    file.precision(std::numeric_limits<T>::max_digits10);
+    file << nodes.size() << std::endl;
+    for(const int n : nodes) file << n << " ";
+    file << std::endl;
+    for(const Layer& l : layers) {
+        file << l.input_scale << std::endl;
+        for(int j=0 ; j<l.rows ; j++) file << l.row_scales[j] << " ";
+        file << std::endl;
+        for(int j=0 ; j<l.rows ; j++) {
+            for(int k=0 ; k<l.cols ; k++) file << static_cast<int>(l.Wq[offset(l, j, k)]) << " ";
+            file << std::endl;
+        }
+        for(int j=0 ; j<l.rows ; j++) file << l.Bq[j] << " ";
+        file << std::endl;
+    }
+    return static_cast<bool>(file);
+}
+
+#endif
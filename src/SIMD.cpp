@@ -0,0 +1,177 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AllocationCounter.hpp"
+#include "SIMD.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define SIMD_X86
+    void simd_sse4_kernels(SIMDKernels<float>&);
+    void simd_sse4_kernels(SIMDKernels<double>&);
+    void simd_avx2_kernels(SIMDKernels<float>&);
+    void simd_avx2_kernels(SIMDKernels<double>&);
+    void simd_avx512_kernels(SIMDKernels<float>&);
+    void simd_avx512_kernels(SIMDKernels<double>&);
+#endif
+
+/*
+Builds the table of kernels for the given instruction set, starting from
+the generic kernels.
+*/
+template<typename T>
+static SIMDKernels<T> build_table(const SIMD::ISA isa) {
+    SIMDKernels<T> k = GenericKernels<T>::table();
+#ifdef SIMD_X86
+    switch(isa) {
+        case SIMD::isa_sse4:   simd_sse4_kernels(k);   break;
+        case SIMD::isa_avx2:   simd_avx2_kernels(k);   break;
+        case SIMD::isa_avx512: simd_avx512_kernels(k); break;
+        default:                                       break;
+    }
+#endif
+    return k;
+}
+
+/*
+Tables of kernels for float and double. They are built on first use, with
+the instruction set currently selected.
+*/
+static SIMDKernels<float>& table_float() {
+    static SIMDKernels<float> k = build_table<float>(SIMD::get_isa());
+    return k;
+}
+static SIMDKernels<double>& table_double() {
+    static SIMDKernels<double> k = build_table<double>(SIMD::get_isa());
+    return k;
+}
+template<>
+const SIMDKernels<float>& SIMD::kernels<float>() {
+    return table_float();
+}
+template<>
+const SIMDKernels<double>& SIMD::kernels<double>() {
+    return table_double();
+}
+
+/*
+Tables of the lut tier of the sigmoid for float and double. They are
+defined here, in the generic code, so that there is only one copy of each
+table for all the instruction sets.
+*/
+template<>
+const float* SigmoidTable<float>::values() {
+    static const std::vector<float> v = build(false);
+    return v.data();
+}
+template<>
+const float* SigmoidTable<float>::slopes() {
+    static const std::vector<float> s = build(true);
+    return s.data();
+}
+template<>
+const double* SigmoidTable<double>::values() {
+    static const std::vector<double> v = build(false);
+    return v.data();
+}
+template<>
+const double* SigmoidTable<double>::slopes() {
+    static const std::vector<double> s = build(true);
+    return s.data();
+}
+
+/*
+Selected instruction set. Defaults to the best one supported by the CPU.
+*/
+SIMD::ISA& SIMD::isa() {
+    static ISA selected = get_supported_isa();
+    return selected;
+}
+
+/*
+Detects the best instruction set supported by the CPU and the OS.
+*/
+SIMD::ISA SIMD::get_supported_isa() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))                                                                 return isa_avx512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) return isa_avx2;
+    if(__builtin_cpu_supports("sse4.1"))                                                                  return isa_sse4;
+#endif
+    return isa_generic;
+}
+
+/*
+Returns the name of an instruction set.
+*/
+std::string SIMD::get_isa_name(const ISA p_isa) {
+    switch(p_isa) {
+        case isa_sse4:   return "SSE4.1";
+        case isa_avx2:   return "AVX2";
+        case isa_avx512: return "AVX-512";
+        default:         return "generic";
+    }
+}
+
+/*
+Allocates memory aligned on SIMD::alignment bytes. Throws std::bad_alloc
+on failure, like new. The memory is freed with aligned_free. The allocation
+is counted by AllocationCounter.
+*/
+void* SIMD::aligned_alloc(const size_t size) {
+    void* p = 0;
+    AllocationCounter::count_allocation();
+    if(posix_memalign(&p, alignment, size>0 ? size : alignment)!=0) throw std::bad_alloc();
+    return p;
+}
+
+/*
+Returns the name of a tier of the sigmoid function.
+*/
+std::string SIMD::get_sigmoid_name(const Sigmoid sigmoid) {
+    switch(sigmoid) {
+        case sigmoid_exact:    return "exact";
+        case sigmoid_rational: return "rational";
+        case sigmoid_lut:      return "lut";
+        default:               return "poly";
+    }
+}
+
+/*
+Returns the name of a format in 16 bits.
+*/
+std::string SIMD::get_half_name(const Half half) {
+    switch(half) {
+        case half_bf16: return "bf16";
+        default:        return "fp16";
+    }
+}
+
+/*
+Selects an instruction set. It cannot be better than the one supported by
+the CPU. This must be called before any computation is launched, as it
+rebuilds the tables of kernels.
+*/
+void SIMD::select_isa(const ISA p_isa) {
+    isa() = p_isa<get_supported_isa() ? p_isa : get_supported_isa();
+    table_float()  = build_table<float>(isa());
+    table_double() = build_table<double>(isa());
+}
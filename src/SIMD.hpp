@@ -0,0 +1,609 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines the runtime dispatch of the vectorized kernels used by
+classes Matrix and Gemm.
+
+The binary is compiled for a generic x86-64 target. The kernels for the
+SSE4.1, AVX2 and AVX-512 instruction sets are compiled in separate files
+(SIMD_sse4.cpp, SIMD_avx2.cpp and SIMD_avx512.cpp) with the corresponding
+compiler flags. At startup, the features of the CPU are detected and the
+best supported instruction set is selected. The kernels are accessed through
+a table of function pointers:
+
+        const SIMDKernels<float>& k = SIMD::kernels<float>();
+        k.add(n, x, y);
+
+Vectorized kernels exist for float and double. For any other type, the
+table is filled with the portable C++ versions defined in this file by
+class GenericKernels.
+
+All the kernels work on contiguous arrays of n coefficients.
+
+The sigmoid function is available in several accuracy tiers, so that the
+cost of the activations can be traded against their accuracy. The maximum
+absolute errors below are measured on the whole real line:
+
+        exact      1/(1+exp(-x)) with the exp function of the C library,
+                   one coefficient at a time. Error below 1e-7 in float.
+        poly       vectorized exponential (polynomial of degree 6 in float,
+                   rational approximation in double). Error below 1e-7 in
+                   float and 2e-16 in double. This is the default tier.
+        rational   0.5 + 0.5*tanh(x/2), tanh being computed by its [7/6]
+                   Pade approximant. No exponential, one division. Error
+                   below 5e-5.
+        lut        table of 4097 values on [-16, 16], linearly interpolated
+                   and saturated outside. Error below 1e-6.
+
+With AVX2 in float, rational is about 1.3 times faster than poly, and lut,
+limited by the gathers, about 1.7 times slower. The lut tier pays off when
+there is no fast exponential, for instance in double with SSE4.1. The
+generic kernels have no vectorized exponential: their poly tier is the
+exact one.
+
+Matrices can also be stored with 16 bits per coefficient, in two formats:
+
+        fp16       IEEE half precision: 5 bits of exponent, 10 bits of
+                   mantissa. Relative error below 5e-4, values up to 65504.
+        bf16       bfloat16, the 16 upper bits of a float: 8 bits of
+                   exponent, 7 bits of mantissa. Relative error below 4e-3,
+                   same range as float.
+
+The kernels convert arrays between T and these formats, rounding to the
+nearest, and compute matrix-vector products with a matrix in 16 bits and
+vectors in T, accumulated in T: the coefficients are converted in registers,
+so the matrix is read with half the memory traffic. The coefficients in 16
+bits are handled as their bits, in arrays of uint16_t. fp16 is converted with
+F16C or AVX-512 instructions, and one coefficient at a time with SSE4.1.
+
+Quantized networks use a matrix-vector product in integers: the matrix is
+in int8 and the vector in 7 bits (0 to 127, stored in uint8), accumulated in
+int32 on the biases. With 7 bits, the pairs of products summed in 16 bits by
+the SSSE3 and AVX2 instructions cannot saturate, so the result is exact and
+identical for all the instruction sets. AVX-512F has no product of bytes:
+its table uses the AVX2 version. The product also exists with the matrix
+stored by groups of 4 columns, for sparse vectors like the pictures: only
+the groups of 4 coefficients that are not all 0 are read. The vectors are
+rounded to 7 bits from T, and the products converted back to T, by
+vectorized kernels too.
+*/
+
+#ifndef SIMD_hpp
+#define SIMD_hpp
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+template<typename T> struct SIMDKernels;
+
+class SIMD {
+
+    public:
+
+        enum ISA     {isa_generic, isa_sse4, isa_avx2, isa_avx512};
+        enum Sigmoid {sigmoid_exact, sigmoid_poly, sigmoid_rational, sigmoid_lut, nb_sigmoids};
+        enum Half    {half_fp16, half_bf16, nb_halfs};
+    
+        static const int alignment = 64;   /* bytes, one cache line and one AVX-512 register */
+
+        static void*       aligned_alloc(const size_t);
+        static void        aligned_free(void* const p) { std::free(p); }
+
+        static ISA         get_isa()                   { return isa(); }
+        static ISA         get_supported_isa();
+        static std::string get_isa_name(const ISA);
+        static void        select_isa(const ISA);
+        static std::string get_sigmoid_name(const Sigmoid);
+        static std::string get_half_name(const Half);
+
+        static uint16_t    float_to_half(const Half, const float);
+        static float       half_to_float(const Half, const uint16_t);
+
+        template<typename T>
+        static const SIMDKernels<T>& kernels();
+
+    private:
+
+        static ISA& isa();
+
+};
+
+template<typename T>
+struct SIMDKernels {
+    void (*fill)(const int, const T, T* const);                                                    /* x = alpha */
+    void (*scale)(const int, const T, T* const);                                                   /* x = alpha*x */
+    void (*add)(const int, const T* const, T* const);                                              /* y = y+x */
+    void (*sub)(const int, const T* const, T* const);                                              /* y = y-x */
+    void (*mul)(const int, const T* const, T* const);                                              /* y = y°x */
+    void (*axpy)(const int, const T, const T* const, T* const);                                    /* y = alpha*x + y */
+    void (*axpby)(const int, const T, const T* const, const T, T* const);                          /* y = alpha*x + beta*y */
+    void (*axpy_sigmoid_prime)(const int, const T, const T* const, const T* const, T* const);      /* y = (alpha*x + y)°a°(1-a) */
+    T    (*dot)(const int, const T* const, const T* const);                                        /* x.y */
+    void (*gemv)(const int, const int, const T* const, const int, const T* const, T* const);       /* y = A*x */
+    void (*sigmoid[SIMD::nb_sigmoids])(const int, T* const);                                       /* x = sigmoid(x), per tier */
+    void (*bias_sigmoid[SIMD::nb_sigmoids])(const int, const T* const, T* const);                  /* y = sigmoid(y+b), per tier */
+    void (*micro_kernel)(const int, const T* const, const T* const, T* const);                     /* gemm tile */
+    void (*to_half[SIMD::nb_halfs])(const int, const T* const, uint16_t* const);                   /* y = x in 16 bits, per format */
+    void (*from_half[SIMD::nb_halfs])(const int, const uint16_t* const, T* const);                 /* y = x in T, per format */
+    void (*gemv_half[SIMD::nb_halfs])(const int, const int, const uint16_t* const, const int, const T* const, T* const);   /* y = A*x, A in 16 bits */
+    void (*gemv_int8)(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);           /* y = A*x + b, A in int8, x in 7 bits */
+    void (*gemv_int8_columns)(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);   /* same, A by groups of 4 columns, x sparse */
+    void (*quantize)(const int, const T, const T* const, uint8_t* const);                          /* y = alpha*x rounded to 7 bits */
+    void (*dequantize)(const int, const int32_t* const, const T* const, T* const);                 /* y = x°s, x in int32 */
+    int  mr;                                                                                       /* rows of the gemm tile */
+    int  nr;                                                                                       /* columns of the gemm tile */
+};
+
+/*
+Allocator of aligned memory, for the standard containers used as buffers
+by the kernels.
+*/
+template<typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    AlignedAllocator() {}
+    template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+    T*   allocate(const size_t n)        { return static_cast<T*>(SIMD::aligned_alloc(n*sizeof(T))); }
+    void deallocate(T* const p, size_t)  { SIMD::aligned_free(p); }
+    template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+/*
+Table of the lut tier of the sigmoid: values at the size+1 regularly spaced
+nodes of [-range, range], and difference with the next node (0 for the
+last one). The tables for float and double are built once in SIMD.cpp and
+shared by all the instruction sets.
+*/
+template<typename T>
+class SigmoidTable {
+
+    public:
+
+        static const int size  = 4096;   /* number of intervals */
+        static const int range = 16;     /* the table covers [-range, range] */
+
+        static const T* values();
+        static const T* slopes();
+
+    private:
+
+        static std::vector<T> build(const bool);
+
+};
+
+template<typename T>
+class GenericKernels {
+
+    public:
+
+        static const int MR = 4;                                    /* rows of the gemm tile */
+        static const int NR = 32/sizeof(T)>=4 ? 32/sizeof(T) : 4;   /* columns of the gemm tile */
+
+        static SIMDKernels<T> table();
+
+        static void fill(const int, const T, T* const);
+        static void scale(const int, const T, T* const);
+        static void add(const int, const T* const, T* const);
+        static void sub(const int, const T* const, T* const);
+        static void mul(const int, const T* const, T* const);
+        static void axpy(const int, const T, const T* const, T* const);
+        static void axpby(const int, const T, const T* const, const T, T* const);
+        static void axpy_sigmoid_prime(const int, const T, const T* const, const T* const, T* const);
+        static T    dot(const int, const T* const, const T* const);
+        static void gemv(const int, const int, const T* const, const int, const T* const, T* const);
+        static void micro_kernel(const int, const T* const, const T* const, T* const);
+
+        static T    exact(const T);
+        static T    rational(const T);
+        static T    lut(const T);
+
+        template<T (*f)(const T)> static void sigmoid(const int, T* const);
+        template<T (*f)(const T)> static void bias_sigmoid(const int, const T* const, T* const);
+
+        template<SIMD::Half h> static void to_half(const int, const T* const, uint16_t* const);
+        template<SIMD::Half h> static void from_half(const int, const uint16_t* const, T* const);
+        template<SIMD::Half h> static void gemv_half(const int, const int, const uint16_t* const, const int, const T* const, T* const);
+
+        static void gemv_int8(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);
+        static void gemv_int8_columns(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);
+        static void quantize(const int, const T, const T* const, uint8_t* const);
+        static void dequantize(const int, const int32_t* const, const T* const, T* const);
+
+};
+
+/* tables of the vectorized kernels and of the sigmoid, defined in SIMD.cpp */
+template<> const SIMDKernels<float>&  SIMD::kernels<float>();
+template<> const SIMDKernels<double>& SIMD::kernels<double>();
+template<> const float*               SigmoidTable<float>::values();
+template<> const float*               SigmoidTable<float>::slopes();
+template<> const double*              SigmoidTable<double>::values();
+template<> const double*              SigmoidTable<double>::slopes();
+
+/*
+Conversion of one coefficient between float and a format in 16 bits,
+rounded to the nearest, ties to even. NaN stays NaN and the values out of
+the range of fp16 become infinite.
+*/
+inline uint16_t SIMD::float_to_half(const Half format, const float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if(format==half_bf16) {
+        if((x & 0x7fffffff)>0x7f800000) return static_cast<uint16_t>((x >> 16) | 0x40);
+        return static_cast<uint16_t>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+    }
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+    if(x>=0x7f800000) return static_cast<uint16_t>(sign | (x>0x7f800000 ? 0x7e00 : 0x7c00));
+    if(x>=0x477ff000) return static_cast<uint16_t>(sign | 0x7c00);
+    if(x>=0x38800000) {
+        /* normal: the exponent is rebiased and the mantissa rounded to 10 bits */
+        uint32_t h = (x - 0x38000000) >> 13;
+        const uint32_t rest = x & 0x1fff;
+        if(rest>0x1000 || (rest==0x1000 && (h & 1))) h++;
+        return static_cast<uint16_t>(sign | h);
+    }
+    /* subnormal: the mantissa with its implicit bit is shifted by the missing exponent */
+    const int e = static_cast<int>(x >> 23);
+    if(e<102) return static_cast<uint16_t>(sign);
+    const int      shift = 126 - e;
+    const uint32_t m     = (x & 0x7fffff) | 0x800000;
+    uint32_t       h     = m >> shift;
+    const uint32_t rest  = m & ((1u << shift) - 1);
+    const uint32_t half  = 1u << (shift - 1);
+    if(rest>half || (rest==half && (h & 1))) h++;
+    return static_cast<uint16_t>(sign | h);
+}
+inline float SIMD::half_to_float(const Half format, const uint16_t h) {
+    uint32_t x;
+    if(format==half_bf16) {
+        x = static_cast<uint32_t>(h) << 16;
+    }
+    else {
+        const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        const uint32_t e    = (h >> 10) & 0x1f;
+        const uint32_t m    = h & 0x3ff;
+        if(e==0x1f)     x = sign | 0x7f800000 | (m << 13);
+        else if(e!=0)   x = sign | ((e + 112) << 23) | (m << 13);
+        else            { const float f = std::ldexp(static_cast<float>(m), -24); return sign ? -f : f; }
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/*
+Types without vectorized kernels use the generic ones.
+*/
+template<typename T>
+const SIMDKernels<T>& SIMD::kernels() {
+    static const SIMDKernels<T> k = GenericKernels<T>::table();
+    return k;
+}
+
+
+
+/*
+Tables of the lut tier for the types without vectorized kernels.
+*/
+template<typename T>
+const T* SigmoidTable<T>::values() {
+    static const std::vector<T> v = build(false);
+    return v.data();
+}
+template<typename T>
+const T* SigmoidTable<T>::slopes() {
+    static const std::vector<T> s = build(true);
+    return s.data();
+}
+
+/*
+Computes the values of the sigmoid at the nodes of the table, or the
+differences between consecutive nodes.
+*/
+template<typename T>
+std::vector<T> SigmoidTable<T>::build(const bool p_slopes) {
+    std::vector<T> t(size+1);
+    const double   h = 2.0*range/size;
+    for(int i=0 ; i<=size ; i++) {
+        const double v = 1/(1+std::exp(-(-range + i*h)));
+        const double w = i<size ? 1/(1+std::exp(-(-range + (i+1)*h))) : v;
+        t[i] = static_cast<T>(p_slopes ? w-v : v);
+    }
+    return t;
+}
+
+/*
+Returns the table of the generic kernels.
+*/
+template<typename T>
+SIMDKernels<T> GenericKernels<T>::table() {
+    SIMDKernels<T> k;
+    k.fill         = &fill;
+    k.scale        = &scale;
+    k.add          = &add;
+    k.sub          = &sub;
+    k.mul          = &mul;
+    k.axpy         = &axpy;
+    k.axpby        = &axpby;
+    k.axpy_sigmoid_prime = &axpy_sigmoid_prime;
+    k.dot          = &dot;
+    k.gemv         = &gemv;
+    k.micro_kernel = &micro_kernel;
+    k.sigmoid[SIMD::sigmoid_exact]         = &sigmoid<&exact>;
+    k.sigmoid[SIMD::sigmoid_poly]          = &sigmoid<&exact>;
+    k.sigmoid[SIMD::sigmoid_rational]      = &sigmoid<&rational>;
+    k.sigmoid[SIMD::sigmoid_lut]           = &sigmoid<&lut>;
+    k.bias_sigmoid[SIMD::sigmoid_exact]    = &bias_sigmoid<&exact>;
+    k.bias_sigmoid[SIMD::sigmoid_poly]     = &bias_sigmoid<&exact>;
+    k.bias_sigmoid[SIMD::sigmoid_rational] = &bias_sigmoid<&rational>;
+    k.bias_sigmoid[SIMD::sigmoid_lut]      = &bias_sigmoid<&lut>;
+    k.to_half[SIMD::half_fp16]             = &to_half<SIMD::half_fp16>;
+    k.to_half[SIMD::half_bf16]             = &to_half<SIMD::half_bf16>;
+    k.from_half[SIMD::half_fp16]           = &from_half<SIMD::half_fp16>;
+    k.from_half[SIMD::half_bf16]           = &from_half<SIMD::half_bf16>;
+    k.gemv_half[SIMD::half_fp16]           = &gemv_half<SIMD::half_fp16>;
+    k.gemv_half[SIMD::half_bf16]           = &gemv_half<SIMD::half_bf16>;
+    k.gemv_int8    = &gemv_int8;
+    k.gemv_int8_columns = &gemv_int8_columns;
+    k.quantize     = &quantize;
+    k.dequantize   = &dequantize;
+    k.mr           = MR;
+    k.nr           = NR;
+    return k;
+}
+
+/*
+Element-wise kernels.
+*/
+template<typename T>
+void GenericKernels<T>::fill(const int n, const T alpha, T* const x) {
+    for(int i=0 ; i<n ; i++) x[i] = alpha;
+}
+template<typename T>
+void GenericKernels<T>::scale(const int n, const T alpha, T* const x) {
+    for(int i=0 ; i<n ; i++) x[i] *= alpha;
+}
+template<typename T>
+void GenericKernels<T>::add(const int n, const T* const x, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] += x[i];
+}
+template<typename T>
+void GenericKernels<T>::sub(const int n, const T* const x, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] -= x[i];
+}
+template<typename T>
+void GenericKernels<T>::mul(const int n, const T* const x, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] *= x[i];
+}
+template<typename T>
+void GenericKernels<T>::axpy(const int n, const T alpha, const T* const x, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] += alpha*x[i];
+}
+
+/*
+y = alpha*x + beta*y. When beta is 0, y is not read.
+*/
+template<typename T>
+void GenericKernels<T>::axpby(const int n, const T alpha, const T* const x, const T beta, T* const y) {
+    if(beta==0) { for(int i=0 ; i<n ; i++) y[i] = alpha*x[i]; }
+    else        { for(int i=0 ; i<n ; i++) y[i] = alpha*x[i] + beta*y[i]; }
+}
+
+/*
+y = (alpha*x + y)°a°(1-a), a being the output of a sigmoid: the last step
+of the error of a layer in the backpropagation.
+*/
+template<typename T>
+void GenericKernels<T>::axpy_sigmoid_prime(const int n, const T alpha, const T* const x, const T* const a, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] = (y[i] + alpha*x[i])*a[i]*(1 - a[i]);
+}
+
+/*
+Dot product.
+*/
+template<typename T>
+T GenericKernels<T>::dot(const int n, const T* const x, const T* const y) {
+    T s = 0;
+    for(int i=0 ; i<n ; i++) s += x[i]*y[i];
+    return s;
+}
+
+/*
+y = A*x, A having M rows and K columns. Four rows are computed at the same
+time so that x is read once for four rows.
+*/
+template<typename T>
+void GenericKernels<T>::gemv(const int M, const int K, const T* const A, const int lda, const T* const x, T* const y) {
+    int i = 0;
+    for( ; i+4<=M ; i+=4) {
+        const T* const a0 = A + (i  )*lda;
+        const T* const a1 = A + (i+1)*lda;
+        const T* const a2 = A + (i+2)*lda;
+        const T* const a3 = A + (i+3)*lda;
+        T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for(int k=0 ; k<K ; k++) {
+            const T xk = x[k];
+            s0 += a0[k]*xk;
+            s1 += a1[k]*xk;
+            s2 += a2[k]*xk;
+            s3 += a3[k]*xk;
+        }
+        y[i] = s0; y[i+1] = s1; y[i+2] = s2; y[i+3] = s3;
+    }
+    for( ; i<M ; i++) y[i] = dot(K, A + i*lda, x);
+}
+
+/*
+Sigmoid function of one number, for the exact, rational and lut tiers (see
+the top of this file).
+*/
+template<typename T>
+T GenericKernels<T>::exact(const T x) {
+    return 1/(1+exp(-x));
+}
+template<typename T>
+T GenericKernels<T>::rational(const T x) {
+    const T y  = x<-10 ? -5 : (x>10 ? 5 : x/2);
+    const T y2 = y*y;
+    const T p  = y*(135135 + y2*(17325 + y2*(378 + y2)));
+    const T q  = 135135 + y2*(62370 + y2*(3150 + 28*y2));
+    const T t  = p/q;
+    return t<-1 ? 0 : (t>1 ? 1 : (1+t)/2);
+}
+template<typename T>
+T GenericKernels<T>::lut(const T x) {
+    T t = (x + SigmoidTable<T>::range)*(SigmoidTable<T>::size/(2*static_cast<T>(SigmoidTable<T>::range)));
+    t = t<0 ? 0 : (t>SigmoidTable<T>::size ? SigmoidTable<T>::size : t);
+    const int i = static_cast<int>(t);
+    return SigmoidTable<T>::values()[i] + (t-i)*SigmoidTable<T>::slopes()[i];
+}
+
+/*
+Sigmoid function, element-wise, f being one of the tiers above.
+*/
+template<typename T>
+template<T (*f)(const T)>
+void GenericKernels<T>::sigmoid(const int n, T* const x) {
+    for(int i=0 ; i<n ; i++) x[i] = f(x[i]);
+}
+
+/*
+Adds the bias and applies the sigmoid function in the same pass.
+*/
+template<typename T>
+template<T (*f)(const T)>
+void GenericKernels<T>::bias_sigmoid(const int n, const T* const b, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] = f(y[i]+b[i]);
+}
+
+/*
+Conversions between T and the formats in 16 bits, through float.
+*/
+template<typename T>
+template<SIMD::Half h>
+void GenericKernels<T>::to_half(const int n, const T* const x, uint16_t* const y) {
+    for(int i=0 ; i<n ; i++) y[i] = SIMD::float_to_half(h, static_cast<float>(x[i]));
+}
+template<typename T>
+template<SIMD::Half h>
+void GenericKernels<T>::from_half(const int n, const uint16_t* const x, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] = SIMD::half_to_float(h, x[i]);
+}
+
+/*
+y = A*x, A having M rows and K columns in 16 bits. Every row is converted
+and accumulated in T.
+*/
+template<typename T>
+template<SIMD::Half h>
+void GenericKernels<T>::gemv_half(const int M, const int K, const uint16_t* const A, const int lda, const T* const x, T* const y) {
+    for(int i=0 ; i<M ; i++) {
+        const uint16_t* const ai = A + i*lda;
+        T s = 0;
+        for(int k=0 ; k<K ; k++) s += SIMD::half_to_float(h, ai[k])*x[k];
+        y[i] = s;
+    }
+}
+
+/*
+y = A*x + b, A having M rows and K columns in int8 and x being in 7 bits.
+The products are accumulated in int32.
+*/
+template<typename T>
+void GenericKernels<T>::gemv_int8(const int M, const int K, const int8_t* const A, const int lda, const uint8_t* const x, const int32_t* const b, int32_t* const y) {
+    for(int i=0 ; i<M ; i++) {
+        const int8_t* const ai = A + i*lda;
+        int32_t s = b[i];
+        for(int k=0 ; k<K ; k++) s += ai[k]*x[k];
+        y[i] = s;
+    }
+}
+
+/*
+y = A*x + b, A having M rows and K columns in int8 stored by groups of 4
+columns: the weight (i, k) is at A + (k/4)*lda + 4*i + k%4. Only the groups
+of coefficients of x that are not 0 are read.
+*/
+template<typename T>
+void GenericKernels<T>::gemv_int8_columns(const int M, const int K, const int8_t* const A, const int lda, const uint8_t* const x, const int32_t* const b, int32_t* const y) {
+    for(int i=0 ; i<M ; i++) y[i] = b[i];
+    for(int k=0 ; k<K ; k+=4) {
+        int32_t xk[4] = {0, 0, 0, 0};   /* the last group is padded with zeros */
+        for(int c=0 ; c<4 && k+c<K ; c++) xk[c] = x[k+c];
+        if(!xk[0] && !xk[1] && !xk[2] && !xk[3]) continue;
+        const int8_t* const ak = A + (k/4)*lda;
+        for(int i=0 ; i<M ; i++) y[i] += ak[4*i]*xk[0] + ak[4*i+1]*xk[1] + ak[4*i+2]*xk[2] + ak[4*i+3]*xk[3];
+    }
+}
+
+/*
+y = alpha*x rounded to the nearest integer and clamped to [0, 127].
+*/
+template<typename T>
+void GenericKernels<T>::quantize(const int n, const T alpha, const T* const x, uint8_t* const y) {
+    for(int i=0 ; i<n ; i++) {
+        const T v = alpha*x[i] + static_cast<T>(0.5);
+        y[i] = v<=0 ? 0 : (v>=127 ? 127 : static_cast<uint8_t>(v));
+    }
+}
+
+/*
+y = x°s, x being in int32.
+*/
+template<typename T>
+void GenericKernels<T>::dequantize(const int n, const int32_t* const x, const T* const s, T* const y) {
+    for(int i=0 ; i<n ; i++) y[i] = static_cast<T>(x[i])*s[i];
+}
+
+/*
+Computes the MR*NR tile of the product of a packed sliver of A (MR rows)
+by a packed sliver of B (NR columns). The tile is kept in local variables
+during the whole loop over k, which allows the compiler to keep it in
+registers.
+*/
+template<typename T>
+void GenericKernels<T>::micro_kernel(const int kc, const T* const Ap, const T* const Bp, T* const tile) {
+    T c[MR][NR];
+    for(int ii=0 ; ii<MR ; ii++) {
+        for(int jj=0 ; jj<NR ; jj++) c[ii][jj] = 0;
+    }
+    const T* a = Ap;
+    const T* b = Bp;
+    for(int k=0 ; k<kc ; k++, a+=MR, b+=NR) {
+        for(int ii=0 ; ii<MR ; ii++) {
+            const T aik = a[ii];
+            for(int jj=0 ; jj<NR ; jj++) c[ii][jj] += aik*b[jj];
+        }
+    }
+    for(int ii=0 ; ii<MR ; ii++) {
+        for(int jj=0 ; jj<NR ; jj++) tile[ii*NR + jj] = c[ii][jj];
+    }
+}
+
+#endif
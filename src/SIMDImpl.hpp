@@ -0,0 +1,679 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This file defines the vectorized kernels once for all instruction sets.
+It is only included by the files SIMD_<isa>.cpp, each of which compiles it
+with its own compiler flags and its own vector type V.
+
+A vector type is a class that wraps the intrinsics of an instruction set
+for a floating point type:
+
+        typedef ... T;                        scalar type
+        typedef ... reg;                      vector register
+        static const int width;               number of T in a register
+        load, store, set1, zero               unaligned memory accesses
+        add, sub, mul, div, min, max          arithmetic
+        fmadd(a, b, c)                        a*b + c
+        fnmadd(a, b, c)                       c - a*b
+        floor, hsum                           rounding, horizontal sum
+        ldexp(x, n)                           x * 2^n, n being integral
+        gather(p, i)                          p[i] in every lane, i being integral
+        load_i32(p)                           int32 coefficients, converted to T
+        store_u8(p, a)                        lanes of a in [0, 255], truncated to
+                                              bytes
+
+The vector types for float also convert registers from and to the formats
+in 16 bits, used by class SIMDHalfImpl:
+
+        load_fp16, store_fp16                 fp16 coefficients, unaligned
+        load_bf16, store_bf16                 bf16 coefficients, unaligned
+
+The integer kernels of class SIMDInt8Impl use a vector type of bytes:
+
+        typedef ... reg;                      vector register
+        static const int width;               number of bytes in a register
+        load, zero                            unaligned memory access
+        dot(s, x, a)                          s + products of the unsigned bytes
+                                              of x by the signed bytes of a,
+                                              summed by groups of 4 in int32
+        hsum                                  horizontal sum of the int32
+        set1(a)                               a in every group of 4 bytes
+        nonzero_groups(x)                     bit mask of the groups of 4 bytes
+                                              of x that are not 0
+        store(p, s)                           int32 of s
+
+The vector types must be defined in an anonymous namespace, so that the
+template functions instantiated for one instruction set are never merged
+by the linker with the ones of another instruction set.
+
+The micro-kernel of the gemm engine computes a tile of MR rows and NV
+vectors (NV*width columns) and keeps it in registers.
+*/
+
+#ifndef SIMDImpl_hpp
+#define SIMDImpl_hpp
+
+#include "SIMD.hpp"
+
+/*
+Vectorized exponential, using the Cephes algorithms: the argument is
+reduced to [-ln(2)/2, ln(2)/2] and e^x = 2^n * e^r is computed with a
+polynomial (float) or a rational approximation (double). The relative
+error is below 2^-22 for float and 2^-50 for double.
+*/
+template<typename V, typename T=typename V::T>
+struct SIMDExp;
+
+template<typename V>
+struct SIMDExp<V, float> {
+    typedef typename V::reg reg;
+    static reg exp(reg x) {
+        x = V::min(V::max(x, V::set1(-87.3f)), V::set1(88.3f));
+        const reg n = V::floor(V::fmadd(x, V::set1(1.44269504088896341f), V::set1(0.5f)));
+        x = V::fnmadd(n, V::set1(0.693359375f), x);
+        x = V::fnmadd(n, V::set1(-2.12194440e-4f), x);
+        const reg z = V::mul(x, x);
+        reg y = V::set1(1.9875691500e-4f);
+        y = V::fmadd(y, x, V::set1(1.3981999507e-3f));
+        y = V::fmadd(y, x, V::set1(8.3334519073e-3f));
+        y = V::fmadd(y, x, V::set1(4.1665795894e-2f));
+        y = V::fmadd(y, x, V::set1(1.6666665459e-1f));
+        y = V::fmadd(y, x, V::set1(5.0000001201e-1f));
+        y = V::fmadd(y, z, V::add(x, V::set1(1.0f)));
+        return V::ldexp(y, n);
+    }
+};
+
+template<typename V>
+struct SIMDExp<V, double> {
+    typedef typename V::reg reg;
+    static reg exp(reg x) {
+        x = V::min(V::max(x, V::set1(-708.0)), V::set1(709.0));
+        const reg n = V::floor(V::fmadd(x, V::set1(1.4426950408889634073599), V::set1(0.5)));
+        x = V::fnmadd(n, V::set1(6.93145751953125e-1), x);
+        x = V::fnmadd(n, V::set1(1.42860682030941723212e-6), x);
+        const reg xx = V::mul(x, x);
+        reg p = V::set1(1.26177193074810590878e-4);
+        p = V::fmadd(p, xx, V::set1(3.02994407707441961300e-2));
+        p = V::fmadd(p, xx, V::set1(9.99999999999999999910e-1));
+        p = V::mul(p, x);
+        reg q = V::set1(3.00198505138664455042e-6);
+        q = V::fmadd(q, xx, V::set1(2.52448340349684104192e-3));
+        q = V::fmadd(q, xx, V::set1(2.27265548208155028766e-1));
+        q = V::fmadd(q, xx, V::set1(2.00000000000000000009e0));
+        x = V::div(p, V::sub(q, p));
+        x = V::fmadd(x, V::set1(2.0), V::set1(1.0));
+        return V::ldexp(x, n);
+    }
+};
+
+template<typename V, int MR, int NV>
+class SIMDImpl {
+
+    typedef typename V::T   T;
+    typedef typename V::reg reg;
+
+    static const int W  = V::width;
+    static const int NR = NV*V::width;
+
+    public:
+
+        static void fill_table(SIMDKernels<T>&);
+
+        static void fill(const int, const T, T* const);
+        static void scale(const int, const T, T* const);
+        static void add(const int, const T* const, T* const);
+        static void sub(const int, const T* const, T* const);
+        static void mul(const int, const T* const, T* const);
+        static void axpy(const int, const T, const T* const, T* const);
+        static void axpby(const int, const T, const T* const, const T, T* const);
+        static void axpy_sigmoid_prime(const int, const T, const T* const, const T* const, T* const);
+        static T    dot(const int, const T* const, const T* const);
+        static void gemv(const int, const int, const T* const, const int, const T* const, T* const);
+        static void micro_kernel(const int, const T* const, const T* const, T* const);
+        static void quantize(const int, const T, const T* const, uint8_t* const);
+        static void dequantize(const int, const int32_t* const, const T* const, T* const);
+
+        template<reg (*f)(const reg)> static void sigmoid(const int, T* const);
+        template<reg (*f)(const reg)> static void bias_sigmoid(const int, const T* const, T* const);
+
+    private:
+
+        static reg  poly(const reg);
+        static reg  rational(const reg);
+        static reg  lut(const reg);
+
+};
+
+
+
+/*
+Replaces the kernels of the table by the vectorized ones.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::fill_table(SIMDKernels<T>& k) {
+    k.fill         = &fill;
+    k.scale        = &scale;
+    k.add          = &add;
+    k.sub          = &sub;
+    k.mul          = &mul;
+    k.axpy         = &axpy;
+    k.axpby        = &axpby;
+    k.axpy_sigmoid_prime = &axpy_sigmoid_prime;
+    k.dot          = &dot;
+    k.gemv         = &gemv;
+    k.micro_kernel = &micro_kernel;
+    k.quantize     = &quantize;
+    k.dequantize   = &dequantize;
+    k.mr           = MR;
+    k.nr           = NR;
+    k.sigmoid[SIMD::sigmoid_poly]          = &sigmoid<&poly>;
+    k.sigmoid[SIMD::sigmoid_rational]      = &sigmoid<&rational>;
+    k.sigmoid[SIMD::sigmoid_lut]           = &sigmoid<&lut>;
+    k.bias_sigmoid[SIMD::sigmoid_poly]     = &bias_sigmoid<&poly>;
+    k.bias_sigmoid[SIMD::sigmoid_rational] = &bias_sigmoid<&rational>;
+    k.bias_sigmoid[SIMD::sigmoid_lut]      = &bias_sigmoid<&lut>;
+}
+
+/*
+Element-wise kernels. The main loops process two registers at a time, the
+remaining coefficients are processed one by one.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::fill(const int n, const T alpha, T* const x) {
+    const reg a = V::set1(alpha);
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) { V::store(x+i, a); V::store(x+i+W, a); }
+    for( ; i<n ; i++) x[i] = alpha;
+}
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::scale(const int n, const T alpha, T* const x) {
+    const reg a = V::set1(alpha);
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        V::store(x+i,   V::mul(a, V::load(x+i)));
+        V::store(x+i+W, V::mul(a, V::load(x+i+W)));
+    }
+    for( ; i<n ; i++) x[i] *= alpha;
+}
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::add(const int n, const T* const x, T* const y) {
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        V::store(y+i,   V::add(V::load(y+i),   V::load(x+i)));
+        V::store(y+i+W, V::add(V::load(y+i+W), V::load(x+i+W)));
+    }
+    for( ; i<n ; i++) y[i] += x[i];
+}
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::sub(const int n, const T* const x, T* const y) {
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        V::store(y+i,   V::sub(V::load(y+i),   V::load(x+i)));
+        V::store(y+i+W, V::sub(V::load(y+i+W), V::load(x+i+W)));
+    }
+    for( ; i<n ; i++) y[i] -= x[i];
+}
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::mul(const int n, const T* const x, T* const y) {
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        V::store(y+i,   V::mul(V::load(y+i),   V::load(x+i)));
+        V::store(y+i+W, V::mul(V::load(y+i+W), V::load(x+i+W)));
+    }
+    for( ; i<n ; i++) y[i] *= x[i];
+}
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::axpy(const int n, const T alpha, const T* const x, T* const y) {
+    const reg a = V::set1(alpha);
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        V::store(y+i,   V::fmadd(a, V::load(x+i),   V::load(y+i)));
+        V::store(y+i+W, V::fmadd(a, V::load(x+i+W), V::load(y+i+W)));
+    }
+    for( ; i<n ; i++) y[i] += alpha*x[i];
+}
+
+/*
+y = alpha*x + beta*y. When beta is 0, y is not read.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::axpby(const int n, const T alpha, const T* const x, const T beta, T* const y) {
+    const reg a = V::set1(alpha);
+    const reg b = V::set1(beta);
+    int i = 0;
+    if(beta==0) {
+        for( ; i+W<=n ; i+=W) V::store(y+i, V::mul(a, V::load(x+i)));
+        for( ; i<n ; i++) y[i] = alpha*x[i];
+    }
+    else {
+        for( ; i+W<=n ; i+=W) V::store(y+i, V::fmadd(a, V::load(x+i), V::mul(b, V::load(y+i))));
+        for( ; i<n ; i++) y[i] = alpha*x[i] + beta*y[i];
+    }
+}
+
+/*
+y = (alpha*x + y)°a°(1-a), a being the output of a sigmoid.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::axpy_sigmoid_prime(const int n, const T alpha, const T* const x, const T* const a, T* const y) {
+    const reg al  = V::set1(alpha);
+    const reg one = V::set1(1);
+    int i = 0;
+    for( ; i+2*W<=n ; i+=2*W) {
+        const reg a0 = V::load(a+i);
+        const reg a1 = V::load(a+i+W);
+        const reg y0 = V::fmadd(al, V::load(x+i),   V::load(y+i));
+        const reg y1 = V::fmadd(al, V::load(x+i+W), V::load(y+i+W));
+        V::store(y+i,   V::mul(V::mul(y0, a0), V::sub(one, a0)));
+        V::store(y+i+W, V::mul(V::mul(y1, a1), V::sub(one, a1)));
+    }
+    for( ; i<n ; i++) y[i] = (y[i] + alpha*x[i])*a[i]*(1 - a[i]);
+}
+
+/*
+Dot product, with four independent accumulators to hide the latency of
+the additions.
+*/
+template<typename V, int MR, int NV>
+typename V::T SIMDImpl<V, MR, NV>::dot(const int n, const T* const x, const T* const y) {
+    reg s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+    int i = 0;
+    for( ; i+4*W<=n ; i+=4*W) {
+        s0 = V::fmadd(V::load(x+i),     V::load(y+i),     s0);
+        s1 = V::fmadd(V::load(x+i+W),   V::load(y+i+W),   s1);
+        s2 = V::fmadd(V::load(x+i+2*W), V::load(y+i+2*W), s2);
+        s3 = V::fmadd(V::load(x+i+3*W), V::load(y+i+3*W), s3);
+    }
+    for( ; i+W<=n ; i+=W) s0 = V::fmadd(V::load(x+i), V::load(y+i), s0);
+    T s = V::hsum(V::add(V::add(s0, s1), V::add(s2, s3)));
+    for( ; i<n ; i++) s += x[i]*y[i];
+    return s;
+}
+
+/*
+y = A*x, A having M rows and K columns. Four rows are computed at the same
+time so that every register of x is loaded once for four rows.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::gemv(const int M, const int K, const T* const A, const int lda, const T* const x, T* const y) {
+    int i = 0;
+    for( ; i+4<=M ; i+=4) {
+        const T* const a0 = A + (i  )*lda;
+        const T* const a1 = A + (i+1)*lda;
+        const T* const a2 = A + (i+2)*lda;
+        const T* const a3 = A + (i+3)*lda;
+        reg s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+        int k = 0;
+        for( ; k+W<=K ; k+=W) {
+            const reg xk = V::load(x+k);
+            s0 = V::fmadd(V::load(a0+k), xk, s0);
+            s1 = V::fmadd(V::load(a1+k), xk, s1);
+            s2 = V::fmadd(V::load(a2+k), xk, s2);
+            s3 = V::fmadd(V::load(a3+k), xk, s3);
+        }
+        T r0 = V::hsum(s0), r1 = V::hsum(s1), r2 = V::hsum(s2), r3 = V::hsum(s3);
+        for( ; k<K ; k++) {
+            r0 += a0[k]*x[k];
+            r1 += a1[k]*x[k];
+            r2 += a2[k]*x[k];
+            r3 += a3[k]*x[k];
+        }
+        y[i] = r0; y[i+1] = r1; y[i+2] = r2; y[i+3] = r3;
+    }
+    for( ; i<M ; i++) y[i] = dot(K, A + i*lda, x);
+}
+
+/*
+y = alpha*x rounded to the nearest integer and clamped to [0, 127], like
+the generic kernel: 0.5 is added and the result truncated.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::quantize(const int n, const T alpha, const T* const x, uint8_t* const y) {
+    const reg a    = V::set1(alpha);
+    const reg half = V::set1(static_cast<T>(0.5));
+    const reg top  = V::set1(127);
+    int i = 0;
+    for( ; i+W<=n ; i+=W) V::store_u8(y+i, V::min(V::max(V::add(V::mul(a, V::load(x+i)), half), V::zero()), top));
+    for( ; i<n ; i++) {
+        const T v = alpha*x[i] + static_cast<T>(0.5);
+        y[i] = v<=0 ? 0 : (v>=127 ? 127 : static_cast<uint8_t>(v));
+    }
+}
+
+/*
+y = x°s, x being in int32.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::dequantize(const int n, const int32_t* const x, const T* const s, T* const y) {
+    int i = 0;
+    for( ; i+W<=n ; i+=W) V::store(y+i, V::mul(V::load_i32(x+i), V::load(s+i)));
+    for( ; i<n ; i++) y[i] = static_cast<T>(x[i])*s[i];
+}
+
+/*
+Sigmoid function of a register, for the poly, rational and lut tiers (see
+SIMD.hpp for their accuracy). The exact tier is the generic one.
+*/
+template<typename V, int MR, int NV>
+typename V::reg SIMDImpl<V, MR, NV>::poly(const reg x) {
+    return V::div(V::set1(1), V::add(V::set1(1), SIMDExp<V>::exp(V::sub(V::zero(), x))));
+}
+template<typename V, int MR, int NV>
+typename V::reg SIMDImpl<V, MR, NV>::rational(const reg x) {
+    const reg y  = V::min(V::max(V::mul(x, V::set1(0.5)), V::set1(-5)), V::set1(5));
+    const reg y2 = V::mul(y, y);
+    reg p = V::add(y2, V::set1(378));
+    p = V::fmadd(p, y2, V::set1(17325));
+    p = V::fmadd(p, y2, V::set1(135135));
+    p = V::mul(p, y);
+    reg q = V::fmadd(y2, V::set1(28), V::set1(3150));
+    q = V::fmadd(q, y2, V::set1(62370));
+    q = V::fmadd(q, y2, V::set1(135135));
+    const reg t = V::min(V::max(V::div(p, q), V::set1(-1)), V::set1(1));
+    return V::fmadd(t, V::set1(0.5), V::set1(0.5));
+}
+template<typename V, int MR, int NV>
+typename V::reg SIMDImpl<V, MR, NV>::lut(const reg x) {
+    const T   scale = SigmoidTable<T>::size/(2*static_cast<T>(SigmoidTable<T>::range));
+    const reg t     = V::min(V::max(V::fmadd(x, V::set1(scale), V::set1(SigmoidTable<T>::range*scale)), V::zero()), V::set1(SigmoidTable<T>::size));
+    const reg i     = V::floor(t);
+    return V::fmadd(V::sub(t, i), V::gather(SigmoidTable<T>::slopes(), i), V::gather(SigmoidTable<T>::values(), i));
+}
+
+/*
+Sigmoid function, element-wise, f being one of the tiers above. The last
+coefficients are copied to a register-sized buffer so that every
+coefficient goes through the same vectorized computation.
+*/
+template<typename V, int MR, int NV>
+template<typename V::reg (*f)(const typename V::reg)>
+void SIMDImpl<V, MR, NV>::sigmoid(const int n, T* const x) {
+    int i = 0;
+    for( ; i+W<=n ; i+=W) V::store(x+i, f(V::load(x+i)));
+    if(i<n) {
+        T buffer[W];
+        for(int j=0 ; j<W ; j++) buffer[j] = i+j<n ? x[i+j] : 0;
+        V::store(buffer, f(V::load(buffer)));
+        for(int j=0 ; i+j<n ; j++) x[i+j] = buffer[j];
+    }
+}
+
+/*
+Adds the bias and applies the sigmoid function in the same pass.
+*/
+template<typename V, int MR, int NV>
+template<typename V::reg (*f)(const typename V::reg)>
+void SIMDImpl<V, MR, NV>::bias_sigmoid(const int n, const T* const b, T* const y) {
+    int i = 0;
+    for( ; i+W<=n ; i+=W) V::store(y+i, f(V::add(V::load(y+i), V::load(b+i))));
+    if(i<n) {
+        T buffer[W];
+        for(int j=0 ; j<W ; j++) buffer[j] = i+j<n ? y[i+j]+b[i+j] : 0;
+        V::store(buffer, f(V::load(buffer)));
+        for(int j=0 ; i+j<n ; j++) y[i+j] = buffer[j];
+    }
+}
+
+/*
+Computes the MR*NR tile of the product of a packed sliver of A (MR rows)
+by a packed sliver of B (NR columns). The MR*NV accumulators stay in
+registers during the whole loop over k.
+*/
+template<typename V, int MR, int NV>
+void SIMDImpl<V, MR, NV>::micro_kernel(const int kc, const T* const Ap, const T* const Bp, T* const tile) {
+    reg c[MR][NV];
+    for(int ii=0 ; ii<MR ; ii++) {
+        for(int v=0 ; v<NV ; v++) c[ii][v] = V::zero();
+    }
+    const T* a = Ap;
+    const T* b = Bp;
+    for(int k=0 ; k<kc ; k++, a+=MR, b+=NR) {
+        reg bk[NV];
+        for(int v=0 ; v<NV ; v++) bk[v] = V::load(b + v*W);
+        for(int ii=0 ; ii<MR ; ii++) {
+            const reg aik = V::set1(a[ii]);
+            for(int v=0 ; v<NV ; v++) c[ii][v] = V::fmadd(aik, bk[v], c[ii][v]);
+        }
+    }
+    for(int ii=0 ; ii<MR ; ii++) {
+        for(int v=0 ; v<NV ; v++) V::store(tile + ii*NR + v*W, c[ii][v]);
+    }
+}
+
+/*
+Kernels working on coefficients in 16 bits. They are only defined for
+float: the formats in 16 bits are converted from and to float.
+*/
+template<typename V>
+class SIMDHalfImpl {
+
+    typedef typename V::reg reg;
+
+    static const int W = V::width;
+
+    public:
+
+        static void fill_table(SIMDKernels<float>&);
+
+        template<SIMD::Half h> static void to_half(const int, const float* const, uint16_t* const);
+        template<SIMD::Half h> static void from_half(const int, const uint16_t* const, float* const);
+        template<SIMD::Half h> static void gemv_half(const int, const int, const uint16_t* const, const int, const float* const, float* const);
+
+    private:
+
+        template<SIMD::Half h> static reg  load(const uint16_t* const p)        { return h==SIMD::half_fp16 ? V::load_fp16(p) : V::load_bf16(p); }
+        template<SIMD::Half h> static void store(uint16_t* const p, const reg a) { if(h==SIMD::half_fp16) V::store_fp16(p, a); else V::store_bf16(p, a); }
+
+};
+
+
+
+/*
+Replaces the kernels in 16 bits of the table by the vectorized ones.
+*/
+template<typename V>
+void SIMDHalfImpl<V>::fill_table(SIMDKernels<float>& k) {
+    k.to_half[SIMD::half_fp16]   = &to_half<SIMD::half_fp16>;
+    k.to_half[SIMD::half_bf16]   = &to_half<SIMD::half_bf16>;
+    k.from_half[SIMD::half_fp16] = &from_half<SIMD::half_fp16>;
+    k.from_half[SIMD::half_bf16] = &from_half<SIMD::half_bf16>;
+    k.gemv_half[SIMD::half_fp16] = &gemv_half<SIMD::half_fp16>;
+    k.gemv_half[SIMD::half_bf16] = &gemv_half<SIMD::half_bf16>;
+}
+
+/*
+Conversions between float and the format h, one register at a time.
+*/
+template<typename V>
+template<SIMD::Half h>
+void SIMDHalfImpl<V>::to_half(const int n, const float* const x, uint16_t* const y) {
+    int i = 0;
+    for( ; i+W<=n ; i+=W) store<h>(y+i, V::load(x+i));
+    for( ; i<n ; i++) y[i] = SIMD::float_to_half(h, x[i]);
+}
+template<typename V>
+template<SIMD::Half h>
+void SIMDHalfImpl<V>::from_half(const int n, const uint16_t* const x, float* const y) {
+    int i = 0;
+    for( ; i+W<=n ; i+=W) V::store(y+i, load<h>(x+i));
+    for( ; i<n ; i++) y[i] = SIMD::half_to_float(h, x[i]);
+}
+
+/*
+y = A*x, A having M rows and K columns in the format h. Like the gemv kernel
+of SIMDImpl, four rows are computed at the same time. The coefficients of A
+are converted in registers and accumulated in float.
+*/
+template<typename V>
+template<SIMD::Half h>
+void SIMDHalfImpl<V>::gemv_half(const int M, const int K, const uint16_t* const A, const int lda, const float* const x, float* const y) {
+    int i = 0;
+    for( ; i+4<=M ; i+=4) {
+        const uint16_t* const a0 = A + (i  )*lda;
+        const uint16_t* const a1 = A + (i+1)*lda;
+        const uint16_t* const a2 = A + (i+2)*lda;
+        const uint16_t* const a3 = A + (i+3)*lda;
+        reg s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+        int k = 0;
+        for( ; k+W<=K ; k+=W) {
+            const reg xk = V::load(x+k);
+            s0 = V::fmadd(load<h>(a0+k), xk, s0);
+            s1 = V::fmadd(load<h>(a1+k), xk, s1);
+            s2 = V::fmadd(load<h>(a2+k), xk, s2);
+            s3 = V::fmadd(load<h>(a3+k), xk, s3);
+        }
+        float r0 = V::hsum(s0), r1 = V::hsum(s1), r2 = V::hsum(s2), r3 = V::hsum(s3);
+        for( ; k<K ; k++) {
+            r0 += SIMD::half_to_float(h, a0[k])*x[k];
+            r1 += SIMD::half_to_float(h, a1[k])*x[k];
+            r2 += SIMD::half_to_float(h, a2[k])*x[k];
+            r3 += SIMD::half_to_float(h, a3[k])*x[k];
+        }
+        y[i] = r0; y[i+1] = r1; y[i+2] = r2; y[i+3] = r3;
+    }
+    for( ; i<M ; i++) {
+        const uint16_t* const ai = A + i*lda;
+        reg s = V::zero();
+        int k = 0;
+        for( ; k+W<=K ; k+=W) s = V::fmadd(load<h>(ai+k), V::load(x+k), s);
+        float r = V::hsum(s);
+        for( ; k<K ; k++) r += SIMD::half_to_float(h, ai[k])*x[k];
+        y[i] = r;
+    }
+}
+
+/*
+Kernels on integers, for the quantized networks. They do not depend on the
+floating point type of the table.
+*/
+template<typename I>
+class SIMDInt8Impl {
+
+    typedef typename I::reg reg;
+
+    static const int W     = I::width;
+    static const int CHUNK = 1024;   /* coefficients of x scanned at a time by gemv_int8_columns */
+
+    public:
+
+        template<typename T>
+        static void fill_table(SIMDKernels<T>& k) { k.gemv_int8 = &gemv_int8; k.gemv_int8_columns = &gemv_int8_columns; }
+
+        static void gemv_int8(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);
+        static void gemv_int8_columns(const int, const int, const int8_t* const, const int, const uint8_t* const, const int32_t* const, int32_t* const);
+
+};
+
+
+
+/*
+y = A*x + b, A having M rows and K columns in int8, x being in 7 bits. Four
+rows are computed at the same time, like the gemv kernel of SIMDImpl.
+*/
+template<typename I>
+void SIMDInt8Impl<I>::gemv_int8(const int M, const int K, const int8_t* const A, const int lda, const uint8_t* const x, const int32_t* const b, int32_t* const y) {
+    int i = 0;
+    for( ; i+4<=M ; i+=4) {
+        const int8_t* const a0 = A + (i  )*lda;
+        const int8_t* const a1 = A + (i+1)*lda;
+        const int8_t* const a2 = A + (i+2)*lda;
+        const int8_t* const a3 = A + (i+3)*lda;
+        reg s0 = I::zero(), s1 = I::zero(), s2 = I::zero(), s3 = I::zero();
+        int k = 0;
+        for( ; k+W<=K ; k+=W) {
+            const reg xk = I::load(x+k);
+            s0 = I::dot(s0, xk, I::load(a0+k));
+            s1 = I::dot(s1, xk, I::load(a1+k));
+            s2 = I::dot(s2, xk, I::load(a2+k));
+            s3 = I::dot(s3, xk, I::load(a3+k));
+        }
+        int32_t r0 = b[i] + I::hsum(s0), r1 = b[i+1] + I::hsum(s1), r2 = b[i+2] + I::hsum(s2), r3 = b[i+3] + I::hsum(s3);
+        for( ; k<K ; k++) {
+            r0 += a0[k]*x[k];
+            r1 += a1[k]*x[k];
+            r2 += a2[k]*x[k];
+            r3 += a3[k]*x[k];
+        }
+        y[i] = r0; y[i+1] = r1; y[i+2] = r2; y[i+3] = r3;
+    }
+    for( ; i<M ; i++) {
+        const int8_t* const ai = A + i*lda;
+        reg s = I::zero();
+        int k = 0;
+        for( ; k+W<=K ; k+=W) s = I::dot(s, I::load(x+k), I::load(ai+k));
+        int32_t r = b[i] + I::hsum(s);
+        for( ; k<K ; k++) r += ai[k]*x[k];
+        y[i] = r;
+    }
+}
+
+/*
+y = A*x + b, A having M rows and K columns in int8 stored by groups of 4
+columns: the group of the columns 4g to 4g+3 starts at A + g*lda and holds
+the 4 weights of every row next to each other, lda being at least 4*M
+rounded up to W. A block of W rows of a group is then 4 registers, every
+group of 4 bytes of which is multiplied by the same 4 coefficients of x.
+The groups of x that are not 0 are listed first, a chunk at a time, and
+only their columns are read.
+*/
+template<typename I>
+void SIMDInt8Impl<I>::gemv_int8_columns(const int M, const int K, const int8_t* const A, const int lda, const uint8_t* const x, const int32_t* const b, int32_t* const y) {
+    int     index[CHUNK/4];   /* first columns of the groups that are not 0 */
+    int32_t value[CHUNK/4];   /* coefficients of these groups */
+    int32_t rows[W];          /* products of a block of rows */
+    for(int i=0 ; i<M ; i++) y[i] = b[i];
+    for(int k0=0 ; k0<K ; k0+=CHUNK) {
+        const int kn = K-k0<CHUNK ? K-k0 : CHUNK;
+        int n = 0;
+        int k = 0;
+        for( ; k+W<=kn ; k+=W) {
+            for(uint32_t m=I::nonzero_groups(I::load(x+k0+k)) ; m ; m&=m-1) {
+                index[n] = k0 + k + 4*__builtin_ctz(m);
+                std::memcpy(value+n, x+index[n], 4);
+                n++;
+            }
+        }
+        for( ; k<kn ; k+=4) {
+            int32_t x4 = 0;
+            std::memcpy(&x4, x+k0+k, kn-k<4 ? kn-k : 4);
+            if(x4) { index[n] = k0 + k; value[n] = x4; n++; }
+        }
+        for(int i=0 ; i<M ; i+=W) {
+            reg s[4] = {I::zero(), I::zero(), I::zero(), I::zero()};
+            for(int j=0 ; j<n ; j++) {
+                const int8_t* const a = A + (index[j]/4)*lda + 4*i;
+                const reg xj = I::set1(value[j]);
+                s[0] = I::dot(s[0], xj, I::load(a));
+                s[1] = I::dot(s[1], xj, I::load(a + W));
+                s[2] = I::dot(s[2], xj, I::load(a + 2*W));
+                s[3] = I::dot(s[3], xj, I::load(a + 3*W));
+            }
+            for(int j=0 ; j<4 ; j++) I::store(rows + j*W/4, s[j]);
+            const int nb_rows = M-i<W ? M-i : W;
+            for(int r=0 ; r<nb_rows ; r++) y[i+r] += rows[r];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+AVX2 kernels. This file is compiled with -mavx2 -mfma -mf16c.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#include "SIMDImpl.hpp"
+
+namespace {
+
+struct AVX2Float {
+    typedef float  T;
+    typedef __m256 reg;
+    static const int width = 8;
+    static reg  load(const T* p)                 { return _mm256_loadu_ps(p); }
+    static void store(T* p, const reg a)         { _mm256_storeu_ps(p, a); }
+    static reg  set1(const T a)                  { return _mm256_set1_ps(a); }
+    static reg  zero()                           { return _mm256_setzero_ps(); }
+    static reg  add(const reg a, const reg b)    { return _mm256_add_ps(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm256_sub_ps(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm256_mul_ps(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm256_div_ps(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm256_min_ps(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm256_max_ps(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm256_fmadd_ps(a, b, c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm256_fnmadd_ps(a, b, c); }
+    static reg  floor(const reg a)               { return _mm256_floor_ps(a); }
+    static T    hsum(const reg a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+    static reg  ldexp(const reg a, const reg n) {
+        const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(a, _mm256_castsi256_ps(e));
+    }
+    static reg  gather(const T* p, const reg i) {
+        const reg all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));   /* masked form: the unmasked one warns in gcc */
+        return _mm256_mask_i32gather_ps(zero(), p, _mm256_cvttps_epi32(i), all, 4);
+    }
+    static reg  load_i32(const int32_t* p)       { return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+    static void store_u8(uint8_t* p, reg a) {
+        const __m256i x = _mm256_cvttps_epi32(a);
+        const __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(w, w));
+    }
+    static reg  load_fp16(const uint16_t* p)     { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static void store_fp16(uint16_t* p, reg a)   { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT)); }
+    static reg  load_bf16(const uint16_t* p) {
+        const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(x, 16));
+    }
+    static void store_bf16(uint16_t* p, reg a) {
+        /* rounded to the nearest, ties to even, NaN stays NaN */
+        const __m256i x = _mm256_castps_si256(a);
+        __m256i r = _mm256_add_epi32(x, _mm256_add_epi32(_mm256_set1_epi32(0x7fff), _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1))));
+        r = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(r), _mm256_castsi256_ps(_mm256_or_si256(x, _mm256_set1_epi32(0x400000))), _mm256_cmp_ps(a, a, _CMP_UNORD_Q)));
+        r = _mm256_srli_epi32(r, 16);
+        /* the packing works within the two halves of the register */
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+    }
+};
+
+struct AVX2Double {
+    typedef double  T;
+    typedef __m256d reg;
+    static const int width = 4;
+    static reg  load(const T* p)                 { return _mm256_loadu_pd(p); }
+    static void store(T* p, const reg a)         { _mm256_storeu_pd(p, a); }
+    static reg  set1(const T a)                  { return _mm256_set1_pd(a); }
+    static reg  zero()                           { return _mm256_setzero_pd(); }
+    static reg  add(const reg a, const reg b)    { return _mm256_add_pd(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm256_sub_pd(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm256_mul_pd(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm256_div_pd(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm256_min_pd(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm256_max_pd(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm256_fmadd_pd(a, b, c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm256_fnmadd_pd(a, b, c); }
+    static reg  floor(const reg a)               { return _mm256_floor_pd(a); }
+    static T    hsum(const reg a) {
+        const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+    static reg  ldexp(const reg a, const reg n) {
+        const __m256i e = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n)), _mm256_set1_epi64x(1023)), 52);
+        return _mm256_mul_pd(a, _mm256_castsi256_pd(e));
+    }
+    static reg  gather(const T* p, const reg i) {
+        const reg all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return _mm256_mask_i32gather_pd(zero(), p, _mm256_cvttpd_epi32(i), all, 8);
+    }
+    static reg  load_i32(const int32_t* p)       { return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static void store_u8(uint8_t* p, reg a) {
+        const __m128i x = _mm256_cvttpd_epi32(a);
+        const __m128i w = _mm_packs_epi32(x, x);
+        const int32_t b = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+        std::memcpy(p, &b, sizeof(b));
+    }
+};
+
+struct AVX2Int8 {
+    typedef __m256i reg;
+    static const int width = 32;
+    static reg     load(const void* p)                { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static reg     zero()                             { return _mm256_setzero_si256(); }
+    static reg     set1(const int32_t a)              { return _mm256_set1_epi32(a); }
+    static reg     dot(const reg s, const reg x, const reg a) {
+        return _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_maddubs_epi16(x, a), _mm256_set1_epi16(1)));
+    }
+    static int32_t hsum(const reg a) {
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+        return _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1)));
+    }
+    static uint32_t nonzero_groups(const reg a)       { return ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, zero())))) & 0xff; }
+    static void    store(int32_t* p, const reg a)     { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+};
+
+}
+
+void simd_avx2_kernels(SIMDKernels<float>& k)  { SIMDImpl<AVX2Float, 6, 2>::fill_table(k); SIMDHalfImpl<AVX2Float>::fill_table(k); SIMDInt8Impl<AVX2Int8>::fill_table(k); }
+void simd_avx2_kernels(SIMDKernels<double>& k) { SIMDImpl<AVX2Double, 6, 2>::fill_table(k); SIMDInt8Impl<AVX2Int8>::fill_table(k); }
+
+#endif
@@ -0,0 +1,126 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+AVX-512 kernels. This file is compiled with -mavx512f -mfma.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#include "SIMDImpl.hpp"
+
+namespace {
+
+struct AVX512Float {
+    typedef float  T;
+    typedef __m512 reg;
+    static const int width = 16;
+    static reg  load(const T* p)                 { return _mm512_loadu_ps(p); }
+    static void store(T* p, const reg a)         { _mm512_storeu_ps(p, a); }
+    static reg  set1(const T a)                  { return _mm512_set1_ps(a); }
+    static reg  zero()                           { return _mm512_setzero_ps(); }
+    static reg  add(const reg a, const reg b)    { return _mm512_add_ps(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm512_sub_ps(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm512_mul_ps(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm512_div_ps(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm512_min_ps(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm512_max_ps(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm512_fmadd_ps(a, b, c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm512_fnmadd_ps(a, b, c); }
+    static reg  floor(const reg a)               { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static T    hsum(const reg a)                { return _mm512_reduce_add_ps(a); }
+    static reg  ldexp(const reg a, const reg n)  { return _mm512_scalef_ps(a, n); }
+    static reg  gather(const T* p, const reg i)  { return _mm512_i32gather_ps(_mm512_cvttps_epi32(i), p, 4); }
+    static reg  load_i32(const int32_t* p)       { return _mm512_cvtepi32_ps(_mm512_loadu_si512(p)); }
+    static void store_u8(uint8_t* p, reg a)      { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(a))); }
+    static reg  load_fp16(const uint16_t* p)     { return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+    static void store_fp16(uint16_t* p, reg a)   { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+    static reg  load_bf16(const uint16_t* p) {
+        const __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(x, 16));
+    }
+    static void store_bf16(uint16_t* p, reg a) {
+        /* rounded to the nearest, ties to even, NaN stays NaN */
+        const __m512i   x   = _mm512_castps_si512(a);
+        const __mmask16 nan = _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q);
+        __m512i r = _mm512_add_epi32(x, _mm512_add_epi32(_mm512_set1_epi32(0x7fff), _mm512_and_si512(_mm512_srli_epi32(x, 16), _mm512_set1_epi32(1))));
+        r = _mm512_mask_or_epi32(r, nan, x, _mm512_set1_epi32(0x400000));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtepi32_epi16(_mm512_srli_epi32(r, 16)));
+    }
+};
+
+struct AVX512Double {
+    typedef double  T;
+    typedef __m512d reg;
+    static const int width = 8;
+    static reg  load(const T* p)                 { return _mm512_loadu_pd(p); }
+    static void store(T* p, const reg a)         { _mm512_storeu_pd(p, a); }
+    static reg  set1(const T a)                  { return _mm512_set1_pd(a); }
+    static reg  zero()                           { return _mm512_setzero_pd(); }
+    static reg  add(const reg a, const reg b)    { return _mm512_add_pd(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm512_sub_pd(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm512_mul_pd(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm512_div_pd(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm512_min_pd(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm512_max_pd(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm512_fmadd_pd(a, b, c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm512_fnmadd_pd(a, b, c); }
+    static reg  floor(const reg a)               { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static T    hsum(const reg a)                { return _mm512_reduce_add_pd(a); }
+    static reg  ldexp(const reg a, const reg n)  { return _mm512_scalef_pd(a, n); }
+    static reg  gather(const T* p, const reg i)  { return _mm512_i32gather_pd(_mm512_cvttpd_epi32(i), p, 8); }
+    static reg  load_i32(const int32_t* p)       { return _mm512_cvtepi32_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+    static void store_u8(uint8_t* p, reg a) {
+        const __m256i x = _mm512_cvttpd_epi32(a);
+        const __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(w, w));
+    }
+};
+
+
+/* 256 bits: the products of bytes in 512 bits need AVX512BW */
+struct AVX512Int8 {
+    typedef __m256i reg;
+    static const int width = 32;
+    static reg     load(const void* p)                { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static reg     zero()                             { return _mm256_setzero_si256(); }
+    static reg     set1(const int32_t a)              { return _mm256_set1_epi32(a); }
+    static reg     dot(const reg s, const reg x, const reg a) {
+        return _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_maddubs_epi16(x, a), _mm256_set1_epi16(1)));
+    }
+    static int32_t hsum(const reg a) {
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+        return _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1)));
+    }
+    static uint32_t nonzero_groups(const reg a)       { return ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, zero())))) & 0xff; }
+    static void    store(int32_t* p, const reg a)     { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+};
+
+}
+
+void simd_avx512_kernels(SIMDKernels<float>& k)  { SIMDImpl<AVX512Float, 6, 2>::fill_table(k); SIMDHalfImpl<AVX512Float>::fill_table(k); SIMDInt8Impl<AVX512Int8>::fill_table(k); }
+void simd_avx512_kernels(SIMDKernels<double>& k) { SIMDImpl<AVX512Double, 6, 2>::fill_table(k); SIMDInt8Impl<AVX512Int8>::fill_table(k); }
+
+#endif
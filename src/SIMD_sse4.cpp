@@ -0,0 +1,155 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+SSE4.1 kernels. This file is compiled with -msse4.1. SSE4.1 is required for
+the rounding and the 64-bit integer conversions used by the exponential.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <smmintrin.h>
+
+#include "SIMDImpl.hpp"
+
+namespace {
+
+struct SSE4Float {
+    typedef float  T;
+    typedef __m128 reg;
+    static const int width = 4;
+    static reg  load(const T* p)                 { return _mm_loadu_ps(p); }
+    static void store(T* p, const reg a)         { _mm_storeu_ps(p, a); }
+    static reg  set1(const T a)                  { return _mm_set1_ps(a); }
+    static reg  zero()                           { return _mm_setzero_ps(); }
+    static reg  add(const reg a, const reg b)    { return _mm_add_ps(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm_sub_ps(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm_mul_ps(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm_div_ps(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm_min_ps(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm_max_ps(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    static reg  floor(const reg a)               { return _mm_floor_ps(a); }
+    static T    hsum(const reg a) {
+        const __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+    static reg  ldexp(const reg a, const reg n) {
+        const __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23);
+        return _mm_mul_ps(a, _mm_castsi128_ps(e));
+    }
+    static reg  gather(const T* p, const reg i) {
+        alignas(16) int k[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(k), _mm_cvttps_epi32(i));
+        return _mm_setr_ps(p[k[0]], p[k[1]], p[k[2]], p[k[3]]);
+    }
+    static reg  load_i32(const int32_t* p)       { return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static void store_u8(uint8_t* p, reg a) {
+        const __m128i x = _mm_cvttps_epi32(a);
+        const __m128i w = _mm_packs_epi32(x, x);
+        const int32_t b = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+        std::memcpy(p, &b, sizeof(b));
+    }
+    static reg  load_fp16(const uint16_t* p) {
+        /* no F16C: one coefficient at a time */
+        T b[width];
+        for(int i=0 ; i<width ; i++) b[i] = SIMD::half_to_float(SIMD::half_fp16, p[i]);
+        return _mm_loadu_ps(b);
+    }
+    static void store_fp16(uint16_t* p, reg a) {
+        T b[width];
+        _mm_storeu_ps(b, a);
+        for(int i=0 ; i<width ; i++) p[i] = SIMD::float_to_half(SIMD::half_fp16, b[i]);
+    }
+    static reg  load_bf16(const uint16_t* p) {
+        const __m128i x = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+        return _mm_castsi128_ps(_mm_slli_epi32(x, 16));
+    }
+    static void store_bf16(uint16_t* p, reg a) {
+        /* rounded to the nearest, ties to even, NaN stays NaN */
+        const __m128i x = _mm_castps_si128(a);
+        __m128i r = _mm_add_epi32(x, _mm_add_epi32(_mm_set1_epi32(0x7fff), _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(1))));
+        r = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(r), _mm_castsi128_ps(_mm_or_si128(x, _mm_set1_epi32(0x400000))), _mm_cmpunord_ps(a, a)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi32(_mm_srli_epi32(r, 16), _mm_setzero_si128()));
+    }
+};
+
+struct SSE4Double {
+    typedef double  T;
+    typedef __m128d reg;
+    static const int width = 2;
+    static reg  load(const T* p)                 { return _mm_loadu_pd(p); }
+    static void store(T* p, const reg a)         { _mm_storeu_pd(p, a); }
+    static reg  set1(const T a)                  { return _mm_set1_pd(a); }
+    static reg  zero()                           { return _mm_setzero_pd(); }
+    static reg  add(const reg a, const reg b)    { return _mm_add_pd(a, b); }
+    static reg  sub(const reg a, const reg b)    { return _mm_sub_pd(a, b); }
+    static reg  mul(const reg a, const reg b)    { return _mm_mul_pd(a, b); }
+    static reg  div(const reg a, const reg b)    { return _mm_div_pd(a, b); }
+    static reg  min(const reg a, const reg b)    { return _mm_min_pd(a, b); }
+    static reg  max(const reg a, const reg b)    { return _mm_max_pd(a, b); }
+    static reg  fmadd(reg a, reg b, reg c)       { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static reg  fnmadd(reg a, reg b, reg c)      { return _mm_sub_pd(c, _mm_mul_pd(a, b)); }
+    static reg  floor(const reg a)               { return _mm_floor_pd(a); }
+    static T    hsum(const reg a)                { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+    static reg  ldexp(const reg a, const reg n) {
+        const __m128i e = _mm_slli_epi64(_mm_add_epi64(_mm_cvtepi32_epi64(_mm_cvtpd_epi32(n)), _mm_set1_epi64x(1023)), 52);
+        return _mm_mul_pd(a, _mm_castsi128_pd(e));
+    }
+    static reg  gather(const T* p, const reg i) {
+        alignas(16) int k[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(k), _mm_cvttpd_epi32(i));
+        return _mm_setr_pd(p[k[0]], p[k[1]]);
+    }
+    static reg  load_i32(const int32_t* p)       { return _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+    static void store_u8(uint8_t* p, reg a) {
+        const __m128i x = _mm_cvttpd_epi32(a);
+        const __m128i w = _mm_packs_epi32(x, x);
+        const int16_t b = static_cast<int16_t>(_mm_cvtsi128_si32(_mm_packus_epi16(w, w)));
+        std::memcpy(p, &b, sizeof(b));
+    }
+};
+
+struct SSE4Int8 {
+    typedef __m128i reg;
+    static const int width = 16;
+    static reg     load(const void* p)                { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+    static reg     zero()                             { return _mm_setzero_si128(); }
+    static reg     set1(const int32_t a)              { return _mm_set1_epi32(a); }
+    static reg     dot(const reg s, const reg x, const reg a) {
+        return _mm_add_epi32(s, _mm_madd_epi16(_mm_maddubs_epi16(x, a), _mm_set1_epi16(1)));
+    }
+    static int32_t hsum(const reg a) {
+        const __m128i s = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0x4e));
+        return _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1)));
+    }
+    static uint32_t nonzero_groups(const reg a)       { return ~static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, zero())))) & 0xf; }
+    static void    store(int32_t* p, const reg a)     { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+};
+
+}
+
+void simd_sse4_kernels(SIMDKernels<float>& k)  { SIMDImpl<SSE4Float, 4, 2>::fill_table(k); SIMDHalfImpl<SSE4Float>::fill_table(k); SIMDInt8Impl<SSE4Int8>::fill_table(k); }
+void simd_sse4_kernels(SIMDKernels<double>& k) { SIMDImpl<SSE4Double, 4, 2>::fill_table(k); SIMDInt8Impl<SSE4Int8>::fill_table(k); }
+
+#endif
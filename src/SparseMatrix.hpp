@@ -0,0 +1,449 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines a sparse matrix, stored in the compressed sparse row
+format (CSR): the nonzero coefficients of each row are stored one after the
+other with their column, and the rows one after the other. Zero coefficients
+take no memory and are skipped by the products.
+
+About 80 % of the pixels of a MNIST picture are zero, so a batch of pictures
+is stored as a sparse matrix with one picture per row. The matrix is filled
+directly from the bytes of the dataset:
+
+    SparseMatrix<float> X(784);
+    X.append_rows(images, 10, 1/255.0f);                // 10 pictures
+    SparseMatrix<float> x = X.row(3);                   // fourth picture
+
+The products with dense matrices only go through the nonzero coefficients:
+
+    SparseMatrix<float>::gemm(1, W, X, true, 0, Z);     // Z = W*X^t
+    SparseMatrix<float>::gemm(1, D, X, false, 1, NW);   // NW += D*X
+    SparseMatrix<float>::gemm(1, X, B, 0, C);           // C = X*B
+
+With the pictures being the rows of X, W*X^t gives the products of the
+first layer of a network with the pictures, one per column, and D*X the
+gradient of its weights. Both only go through the columns of W and NW at
+the nonzero pixels. When these matrices are stored by columns, that is
+when they are transposed matrices, every column is processed with the axpy
+kernel, and the first layer, by far the largest, does about five times less
+work. X*B adds whole rows of B with the axpy kernel.
+
+A row of a sparse matrix can be read as a sparse matrix of one row, which
+does not own its coefficients, like a MatrixView. A sparse matrix copied
+from a view is a view. Appending rows to a matrix invalidates its views.
+*/
+
+#ifndef SparseMatrix_hpp
+#define SparseMatrix_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Matrix.hpp"
+#include "SIMD.hpp"
+
+template<typename T>
+class SparseMatrix {
+
+    public:
+    
+        SparseMatrix(const int, const int=0);
+        SparseMatrix(const SparseMatrix&);
+    
+        SparseMatrix& operator=(const SparseMatrix&);
+    
+        const int get_I()   const { return I; }
+        const int get_J()   const { return J; }
+        const int get_nnz() const { return starts[I] - starts[0]; }
+    
+        const int* row_indexes(const int i) const { return indexes + starts[i]; }
+        const T*   row_values(const int i)  const { return values + starts[i]; }
+        const int  row_nnz(const int i)     const { return starts[i+1] - starts[i]; }
+    
+        SparseMatrix row(const int) const;
+    
+        void clear();
+        void reserve(const int, const int);
+        void append_rows(const unsigned char* const, const int, const T);
+    
+        static void gemm(const T, const Matrix<T>&, const SparseMatrix&, const bool, const T, Matrix<T>&);
+        static void gemm(const T, const SparseMatrix&, const Matrix<T>&, const T, Matrix<T>&);
+        static void sigmoid_affine(Matrix<T>&, const Matrix<T>&, const SparseMatrix&, const Matrix<T>&, const SIMD::Sigmoid=SIMD::sigmoid_poly);
+    
+    private:
+    
+        SparseMatrix(const SparseMatrix&, const int);
+    
+        static void scale(const T, Matrix<T>&);
+    
+        void update_pointers();
+    
+        int              I;                /* number of rows */
+        int              J;                /* number of columns */
+        bool             owner;            /* false for a view on the rows of another matrix */
+        std::vector<int> row_starts;       /* position of the first coefficient of each row, and of the end */
+        std::vector<int> column_indexes;   /* column of each coefficient */
+        std::vector<T>   coefficients;     /* nonzero coefficients */
+        const int*       starts;           /* row_starts, or the ones of the viewed matrix */
+        const int*       indexes;          /* column_indexes, or the ones of the viewed matrix */
+        const T*         values;           /* coefficients, or the ones of the viewed matrix */
+
+};
+
+
+
+/*
+Creates an empty matrix with J columns. Memory is reserved for nb_rows rows
+with 25 % of nonzero coefficients, so that they can be appended without
+reallocation.
+*/
+template<typename T>
+SparseMatrix<T>::SparseMatrix(const int p_J, const int nb_rows) :
+    I(0),
+    J(p_J),
+    owner(true),
+    row_starts(1, 0) {
+    row_starts.reserve(nb_rows+1);
+    column_indexes.reserve(static_cast<size_t>(nb_rows)*(J/4+1));
+    coefficients.reserve(static_cast<size_t>(nb_rows)*(J/4+1));
+    update_pointers();
+}
+
+/*
+Copies S. The copy of a view is a view on the same coefficients, the copy
+of a matrix owns a copy of its coefficients.
+*/
+template<typename T>
+SparseMatrix<T>::SparseMatrix(const SparseMatrix& S) :
+    I(S.I),
+    J(S.J),
+    owner(S.owner),
+    row_starts(S.row_starts),
+    column_indexes(S.column_indexes),
+    coefficients(S.coefficients),
+    starts(S.starts),
+    indexes(S.indexes),
+    values(S.values) {
+    if(owner) update_pointers();
+}
+
+/*
+Views row i of S.
+*/
+template<typename T>
+SparseMatrix<T>::SparseMatrix(const SparseMatrix& S, const int i) :
+    I(1),
+    J(S.J),
+    owner(false),
+    starts(S.starts + i),
+    indexes(S.indexes),
+    values(S.values) {
+}
+
+/*
+Copies S, see the copy constructor.
+*/
+template<typename T>
+SparseMatrix<T>& SparseMatrix<T>::operator=(const SparseMatrix& S) {
+    if(this!=&S) {
+        I              = S.I;
+        J              = S.J;
+        owner          = S.owner;
+        row_starts     = S.row_starts;
+        column_indexes = S.column_indexes;
+        coefficients   = S.coefficients;
+        starts         = S.starts;
+        indexes        = S.indexes;
+        values         = S.values;
+        if(owner) update_pointers();
+    }
+    return *this;
+}
+
+/*
+Views row i as a matrix of one row.
+*/
+template<typename T>
+SparseMatrix<T> SparseMatrix<T>::row(const int i) const {
+    if(i<0 || i>=I) {
+        const std::string desc     = "Unable to view the row: it is out of the sparse matrix.";
+        const std::string function = "SparseMatrix<T> SparseMatrix<T>::row(const int i) const";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(I, J, i+1, J, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    return SparseMatrix(*this, i);
+}
+
+/*
+Removes all the rows. The memory is kept for the next ones.
+*/
+template<typename T>
+void SparseMatrix<T>::clear() {
+    if(!owner) {
+        const std::string desc     = "Unable to clear a view on a sparse matrix.";
+        const std::string function = "void SparseMatrix<T>::clear()";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(I, J, I, J, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    I = 0;
+    row_starts.resize(1);
+    column_indexes.clear();
+    coefficients.clear();
+    update_pointers();
+}
+
+/*
+Reserves memory for nb_rows rows and nnz nonzero coefficients in total, so
+that they can be appended without reallocation.
+*/
+template<typename T>
+void SparseMatrix<T>::reserve(const int nb_rows, const int nnz) {
+    if(!owner) {
+        const std::string desc     = "Unable to reserve memory for a view on a sparse matrix.";
+        const std::string function = "void SparseMatrix<T>::reserve(const int nb_rows, const int nnz)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(I, J, nb_rows, J, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    row_starts.reserve(nb_rows+1);
+    column_indexes.reserve(nnz);
+    coefficients.reserve(nnz);
+    update_pointers();
+}
+
+/*
+Appends nb_rows rows of J bytes each, stored one after the other, every
+nonzero byte giving the coefficient scale*byte. The bytes are tested eight
+at a time, so that the blank parts of the pictures are skipped quickly.
+*/
+template<typename T>
+void SparseMatrix<T>::append_rows(const unsigned char* const bytes, const int nb_rows, const T scale) {
+    if(!owner) {
+        const std::string desc     = "Unable to append rows to a view on a sparse matrix.";
+        const std::string function = "void SparseMatrix<T>::append_rows(const unsigned char* const bytes, const int nb_rows, const T scale)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_dimensions(I, J, I+nb_rows, J, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    for(int i=0 ; i<nb_rows ; i++) {
+        const unsigned char* const row = bytes + static_cast<size_t>(i)*J;
+        int j = 0;
+        for(; j+8<=J ; j+=8) {
+            uint64_t word;
+            std::memcpy(&word, row + j, 8);
+            if(word==0) continue;
+            for(int k=j ; k<j+8 ; k++) {
+                if(row[k]) { column_indexes.push_back(k); coefficients.push_back(scale*row[k]); }
+            }
+        }
+        for(; j<J ; j++) {
+            if(row[j]) { column_indexes.push_back(j); coefficients.push_back(scale*row[j]); }
+        }
+        row_starts.push_back(static_cast<int>(coefficients.size()));
+    }
+    I += nb_rows;
+    update_pointers();
+}
+
+/*
+Computes C = alpha*A*op(S) + beta*C, op(S) being S or its transposed
+depending on the flag transS. Only the columns of A and C at the columns of
+the coefficients of S are read or written.
+
+With transS, column k of C is the sum of the columns of A at the columns of
+row k of S, weighted by its coefficients. Without, every column of A is
+multiplied by the coefficients of a row of S and added to the columns of C
+at their columns. When A and C are stored by columns (transposed matrices,
+or column vectors), the columns are added with the axpy kernel. Otherwise,
+four rows of A are read at once at the columns of the row of S, or C is
+updated one coefficient at a time.
+*/
+template<typename T>
+void SparseMatrix<T>::gemm(const T alpha, const Matrix<T>& A, const SparseMatrix& S, const bool transS, const T beta, Matrix<T>& C) {
+    const int N = transS ? S.I : S.J;
+    const int K = transS ? S.J : S.I;
+    if(A.get_J()!=K || C.get_I()!=A.get_I() || C.get_J()!=N) {
+        const std::string desc     = "Unable to compute the product with the sparse matrix: dimensions don't match.";
+        const std::string function = "void SparseMatrix<T>::gemm(const T alpha, const Matrix<T>& A, const SparseMatrix& S, const bool transS, const T beta, Matrix<T>& C)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_two_matrices(&A, &C, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    const int             M       = A.get_I();
+    /* coefficient (i, j) of A is at i*rsa + j*csa, the one of C at i*rsc + j*csc */
+    const int rsa = A.transpose ? 1 : A.vector_stride();
+    const int csa = A.transpose ? A.ld : 1;
+    const int rsc = C.transpose ? 1 : C.vector_stride();
+    const int csc = C.transpose ? C.ld : 1;
+    static thread_local std::vector<T, AlignedAllocator<T>> buffer;
+    if(buffer.size()<static_cast<size_t>(M)) buffer.resize(M);
+    scale(beta, C);
+    if(transS && rsa==1) {
+        /* columns of A, summed in column k of C or in the buffer */
+        for(int k=0 ; k<N ; k++) {
+            const int* const idx = S.row_indexes(k);
+            const T*   const val = S.row_values(k);
+            T* const         c   = rsc==1 ? C.matrix + k*csc : buffer.data();
+            if(rsc!=1) kernels.fill(M, 0, c);
+            for(int p=0 ; p<S.row_nnz(k) ; p++) kernels.axpy(M, alpha*val[p], A.matrix + idx[p]*csa, c);
+            if(rsc!=1) for(int i=0 ; i<M ; i++) C.matrix[i*rsc + k*csc] += c[i];
+        }
+    }
+    else if(transS) {
+        /* dot products of four rows of A at a time with row k of S */
+        for(int k=0 ; k<N ; k++) {
+            const int* const idx = S.row_indexes(k);
+            const T*   const val = S.row_values(k);
+            const int        nnz = S.row_nnz(k);
+            int i = 0;
+            for(; i+4<=M ; i+=4) {
+                const T* const a0 = A.matrix + i*rsa;
+                const T* const a1 = a0 + rsa;
+                const T* const a2 = a1 + rsa;
+                const T* const a3 = a2 + rsa;
+                T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                for(int p=0 ; p<nnz ; p++) {
+                    const int j = idx[p];
+                    s0 += a0[j]*val[p];
+                    s1 += a1[j]*val[p];
+                    s2 += a2[j]*val[p];
+                    s3 += a3[j]*val[p];
+                }
+                C.matrix[i*rsc + k*csc]     += alpha*s0;
+                C.matrix[(i+1)*rsc + k*csc] += alpha*s1;
+                C.matrix[(i+2)*rsc + k*csc] += alpha*s2;
+                C.matrix[(i+3)*rsc + k*csc] += alpha*s3;
+            }
+            for(; i<M ; i++) {
+                const T* const a = A.matrix + i*rsa;
+                T s = 0;
+                for(int p=0 ; p<nnz ; p++) s += a[idx[p]]*val[p];
+                C.matrix[i*rsc + k*csc] += alpha*s;
+            }
+        }
+    }
+    else if(rsc==1) {
+        /* column k of A, contiguous or copied to the buffer, added to the columns of C */
+        for(int k=0 ; k<K ; k++) {
+            const int* const idx = S.row_indexes(k);
+            const T*   const val = S.row_values(k);
+            const T*         a   = A.matrix + k*csa;
+            if(rsa!=1) {
+                for(int i=0 ; i<M ; i++) buffer[i] = a[i*rsa];
+                a = buffer.data();
+            }
+            for(int p=0 ; p<S.row_nnz(k) ; p++) kernels.axpy(M, alpha*val[p], a, C.matrix + idx[p]*csc);
+        }
+    }
+    else {
+        /* rows of S, weighted by the coefficients of A, added to the rows of C */
+        for(int i=0 ; i<M ; i++) {
+            T* const c = C.matrix + i*rsc;
+            for(int k=0 ; k<K ; k++) {
+                const T a = alpha*A.matrix[i*rsa + k*csa];
+                if(a==0) continue;
+                const int* const idx = S.row_indexes(k);
+                const T*   const val = S.row_values(k);
+                for(int p=0 ; p<S.row_nnz(k) ; p++) c[idx[p]] += a*val[p];
+            }
+        }
+    }
+}
+
+/*
+Computes C = alpha*S*B + beta*C: every row of C is the sum of the rows of B
+at the columns of the row of S, weighted by its coefficients. C must not be
+transposed.
+*/
+template<typename T>
+void SparseMatrix<T>::gemm(const T alpha, const SparseMatrix& S, const Matrix<T>& B, const T beta, Matrix<T>& C) {
+    if(B.get_I()!=S.J || C.get_I()!=S.I || C.get_J()!=B.get_J() || C.transpose) {
+        const std::string desc     = "Unable to compute the product with the sparse matrix: dimensions don't match.";
+        const std::string function = "void SparseMatrix<T>::gemm(const T alpha, const SparseMatrix& S, const Matrix<T>& B, const T beta, Matrix<T>& C)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_two_matrices(&B, &C, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    const SIMDKernels<T>& kernels = SIMD::kernels<T>();
+    const int             N       = C.J;
+    const int             ldc     = C.ld;
+    scale(beta, C);
+    for(int i=0 ; i<S.I ; i++) {
+        T* const         c   = C.matrix + i*ldc;
+        const int* const idx = S.row_indexes(i);
+        const T*   const val = S.row_values(i);
+        for(int p=0 ; p<S.row_nnz(i) ; p++) {
+            if(!B.transpose) {
+                kernels.axpy(N, alpha*val[p], B.matrix + idx[p]*B.ld, c);
+            }
+            else {
+                for(int j=0 ; j<N ; j++) c[j] += alpha*val[p]*B.matrix[j*B.ld + idx[p]];
+            }
+        }
+    }
+}
+
+/*
+Computes Y = sigmoid(W*X^t + B), B being a column vector added to every
+column: this is the first layer of a network, the pictures being the rows
+of X and the activations the columns of Y. Y must have the right dimensions
+and not be transposed. The sigmoid is computed with the given accuracy tier.
+*/
+template<typename T>
+void SparseMatrix<T>::sigmoid_affine(Matrix<T>& Y, const Matrix<T>& W, const SparseMatrix& X, const Matrix<T>& B, const SIMD::Sigmoid tier) {
+    if(B.get_I()!=W.get_I() || B.get_J()!=1 || Y.get_I()!=W.get_I() || Y.get_J()!=X.I) {
+        const std::string desc     = "Unable to compute sigmoid(W*X^t + B): dimensions don't match.";
+        const std::string function = "void SparseMatrix<T>::sigmoid_affine(Matrix<T>& Y, const Matrix<T>& W, const SparseMatrix& X, const Matrix<T>& B, const SIMD::Sigmoid tier)";
+        const std::string infos    = Matrix<T>::Exception::create_infos_two_matrices(&W, &B, function);
+        throw typename Matrix<T>::Exception(desc, infos);
+    }
+    /* every row starts with its bias, the product is accumulated on it */
+    for(int i=0 ; i<Y.get_I() ; i++) {
+        for(int k=0 ; k<Y.get_J() ; k++) Y(i, k) = B(i, 0);
+    }
+    gemm(1, W, X, true, 1, Y);
+    Y.sigmoid(tier);
+}
+
+/*
+Multiplies the coefficients of C by beta, for the products: C is set to 0
+when beta is 0, so that its initial coefficients are never read.
+*/
+template<typename T>
+void SparseMatrix<T>::scale(const T beta, Matrix<T>& C) {
+    if(beta==1) return;
+    if(beta==0) C.fill(0);
+    else        C *= beta;
+}
+
+/*
+Points the coefficients to the vectors of this matrix, which may have been
+reallocated.
+*/
+template<typename T>
+void SparseMatrix<T>::update_pointers() {
+    starts  = row_starts.data();
+    indexes = column_indexes.data();
+    values  = coefficients.data();
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+
+/*
+Creates a pool without workers: products run on the calling thread.
+*/
+ThreadPool::ThreadPool() :
+    size(1),
+    function(0),
+    context(0),
+    n(0),
+    grain(1),
+    nb_parts(0),
+    next(0),
+    remaining(0),
+    generation(0),
+    stop(false) {
+}
+
+/*
+Stops and joins the workers.
+*/
+ThreadPool::~ThreadPool() {
+    resize(1);
+}
+
+/*
+Sets the number of threads working on a product, the calling thread
+included. 1 disables the parallel products.
+*/
+void ThreadPool::set_nb_threads(const int nb_threads) {
+    instance().resize(std::max(1, nb_threads));
+}
+
+/*
+Number of threads working on a product, the calling thread included.
+*/
+int ThreadPool::get_nb_threads() {
+    return instance().size.load(std::memory_order_relaxed);
+}
+
+/*
+Replaces the workers by nb_threads-1 new ones, once the current loop is done.
+*/
+void ThreadPool::resize(const int nb_threads) {
+    std::lock_guard<std::mutex> loop_lock(loop_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : threads) t.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.clear();
+    stop = false;
+    for(int i=1 ; i<nb_threads ; i++) threads.push_back(std::thread(&ThreadPool::work, this));
+    size = nb_threads;
+}
+
+/*
+Runs a loop on the pool, the calling thread taking parts too. The loop runs
+on the calling thread alone if it comes from a part or if the pool is busy.
+*/
+void ThreadPool::run(const Function p_function, const void* const p_context, const int p_n, const int p_grain) {
+    if(in_pool() || !loop_mutex.try_lock()) { p_function(p_context, 0, p_n); return; }
+    std::lock_guard<std::mutex> loop_lock(loop_mutex, std::adopt_lock);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const int nb_grains = (p_n + p_grain - 1)/p_grain;
+        function  = p_function;
+        context   = p_context;
+        n         = p_n;
+        grain     = p_grain;
+        nb_parts  = std::min(nb_grains, static_cast<int>(threads.size()) + 1);
+        next      = 0;
+        remaining = nb_parts;
+        generation++;
+    }
+    wake.notify_all();
+    in_pool() = true;
+    run_parts();
+    in_pool() = false;
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remaining==0; });
+}
+
+/*
+Takes parts of the current loop and runs them until there is none left. The
+bounds of a part are read together with its index, so a late worker never
+mixes two loops.
+*/
+void ThreadPool::run_parts() {
+    while(true) {
+        Function    f;
+        const void* c;
+        int         begin, end;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(next>=nb_parts) return;
+            const int part      = next++;
+            const int nb_grains = (n + grain - 1)/grain;
+            f     = function;
+            c     = context;
+            begin = std::min(n, nb_grains*part/nb_parts*grain);
+            end   = std::min(n, nb_grains*(part+1)/nb_parts*grain);
+        }
+        f(c, begin, end);
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--remaining==0) finished.notify_all();
+    }
+}
+
+/*
+Worker loop: waits for a new loop, takes its parts, and waits again.
+*/
+void ThreadPool::work() {
+    in_pool() = true;
+    long seen = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen = generation;
+    }
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return stop || generation!=seen; });
+            if(stop) return;
+            seen = generation;
+        }
+        run_parts();
+    }
+}
+
+/*
+Pool shared by the whole program.
+*/
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+/*
+True on the workers and on a thread running the parts of a loop.
+*/
+bool& ThreadPool::in_pool() {
+    static thread_local bool flag = false;
+    return flag;
+}
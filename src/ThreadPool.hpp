@@ -0,0 +1,120 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+This class defines the pool of threads used to split a single matrix
+product over several cores. It is independent from the training and testing
+threads, which split the dataset: those run whole products, this pool runs
+parts of one product.
+
+The pool is shared by the whole program and created with the first parallel
+loop. A loop splits a range of indices in as many parts as there are threads,
+the calling thread included:
+
+    ThreadPool::set_nb_threads(4);
+    ThreadPool::parallel_for(M, 16, [&](const int begin, const int end) {
+        ...                               // rows begin to end-1
+    });
+
+The bounds of the parts are multiples of the grain, except for the last one.
+A loop only returns once all its parts are done.
+
+The pool runs one loop at a time. A loop started while the pool is busy, by
+another thread or from inside a part, runs entirely on its calling thread:
+the products of the training threads never wait for each other, and the
+parts of a loop never start loops of their own.
+*/
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+
+    public:
+
+        static void set_nb_threads(const int);
+        static int  get_nb_threads();
+        template<typename F>
+        static void parallel_for(const int, const int, const F&);
+
+    private:
+
+        typedef void (*Function)(const void*, const int, const int);
+
+        ThreadPool();
+        ~ThreadPool();
+
+        static ThreadPool& instance();
+        static bool&       in_pool();
+        template<typename F>
+        static void        call(const void*, const int, const int);
+
+        void resize(const int);
+        void run(const Function, const void* const, const int, const int);
+        void run_parts();
+        void work();
+
+        std::vector<std::thread> threads;       /* workers, the calling thread is not included */
+        std::atomic<int>         size;          /* number of threads, the calling thread included */
+        std::mutex               loop_mutex;    /* held while a loop runs */
+        std::mutex               mutex;         /* protects the loop and the state of the pool */
+        std::condition_variable  wake;          /* a loop started or the pool stops */
+        std::condition_variable  finished;      /* all the parts of the loop are done */
+        Function                 function;      /* body of the loop */
+        const void*              context;       /* argument of the body */
+        int                      n;             /* size of the range */
+        int                      grain;         /* granularity of the bounds */
+        int                      nb_parts;      /* number of parts */
+        int                      next;          /* next part to run */
+        int                      remaining;     /* parts not done yet */
+        long                     generation;    /* number of loops started */
+        bool                     stop;          /* workers must exit */
+
+};
+
+
+
+/*
+Calls f(begin, end) on parts of [0, n) in parallel, and returns when all are
+done. Runs f(0, n) directly when the range is too short to be split.
+*/
+template<typename F>
+void ThreadPool::parallel_for(const int n, const int grain, const F& f) {
+    if(get_nb_threads()<=1 || n<=grain) { f(0, n); return; }
+    instance().run(&call<F>, &f, n, grain);
+}
+
+/*
+Calls the body of a loop, whose type was erased to store it in the pool.
+*/
+template<typename F>
+void ThreadPool::call(const void* f, const int begin, const int end) {
+    (*static_cast<const F*>(f))(begin, end);
+}
+
+#endif
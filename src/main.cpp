@@ -22,12 +22,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 
+#include "Benchmark.hpp"
+#include "Blas.hpp"
 #include "DigitScanner.hpp"
 #include "Parameters.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
 #include "Window.hpp"
 
-void       build_menu(Parameters* const);
-const bool check_errors(Parameters* const);
+void          build_menu(Parameters* const);
+const bool    check_errors(Parameters* const);
+SIMD::Sigmoid sigmoid_tier(const std::string&);
 
 int main(int argc, char **argv) {
 
@@ -68,23 +73,61 @@ int main(int argc, char **argv) {
     }
     
     /* initializations */
-    srand(static_cast<unsigned int>(time(NULL)));
+    const unsigned int seed = p.is_spec("seed") ? static_cast<unsigned int>(p.num_val<int>("seed")) : static_cast<unsigned int>(time(NULL));
+    srand(seed);
+    
+    /* vectorized kernels */
+    if(p.cho_val("isa")=="generic")     SIMD::select_isa(SIMD::isa_generic);
+    else if(p.cho_val("isa")=="sse4")   SIMD::select_isa(SIMD::isa_sse4);
+    else if(p.cho_val("isa")=="avx2")   SIMD::select_isa(SIMD::isa_avx2);
+    else if(p.cho_val("isa")=="avx512") SIMD::select_isa(SIMD::isa_avx512);
+    std::cerr << "using " << SIMD::get_isa_name(SIMD::get_isa()) << " kernels (cpu supports " << SIMD::get_isa_name(SIMD::get_supported_isa()) << ")" << std::endl;
+    
+    /* engine and threads for the matrix products */
+    if(p.cho_val("engine")=="builtin")    Blas::select_engine(Blas::engine_builtin);
+    else if(p.cho_val("engine")=="cblas") Blas::select_engine(Blas::engine_cblas);
+    std::cerr << "using " << Blas::get_engine_name(Blas::get_engine()) << " engine for the matrix products (BLAS library: " << Blas::get_library() << ")" << std::endl;
+    ThreadPool::set_nb_threads(p.num_val<int>("opthreads"));
+    Blas::set_nb_threads(p.num_val<int>("opthreads"));
+    
+    /* benchmark of the engines */
+    if(p.is_spec("bench")) {
+        Benchmark::products();
+        return 0;
+    }
+    
+    /* layers of a new neural network */
+    std::vector<int> layers;
+    if(p.num_val<int>("hlayers", 1)==0)      layers = {784, 10};
+    else if(p.num_val<int>("hlayers", 2)==0) layers = {784, p.num_val<int>("hlayers", 1), 10};
+    else                                     layers = {784, p.num_val<int>("hlayers", 1), p.num_val<int>("hlayers", 2), 10};
+    
+    /* benchmark of the training */
+    if(p.is_spec("benchtrain")) {
+        Benchmark::training(mnist_folder, layers, p.num_val<int>("train", 1), p.num_val<int>("train", 2), p.num_val<int>("train", 3), p.num_val<int>("train", 4), p.num_val<double>("eta"), p.num_val<double>("alpha"), p.num_val<int>("benchtrain", 1), p.num_val<int>("avgperiod"), seed);
+        return 0;
+    }
     
     /* DigitScanner */
     DigitScanner<float> dgs;
-    if(p.is_spec("hlayers")) {
-        if(p.num_val<int>("hlayers", 1)==0)      dgs.set_layers({784, 10});
-        else if(p.num_val<int>("hlayers", 2)==0) dgs.set_layers({784, p.num_val<int>("hlayers", 1), 10});
-        else                                     dgs.set_layers({784, p.num_val<int>("hlayers", 1), p.num_val<int>("hlayers", 2), 10});
-    }
+    if(p.is_spec("hlayers")) dgs.set_layers(layers);
     else if(p.is_spec("fnnin")) { if(!dgs.load(p.str_val("fnnin"))) return 0; }
+    dgs.set_sigmoids(sigmoid_tier(p.cho_val("sigtrain")), sigmoid_tier(p.cho_val("siginfer")));
+    if(p.cho_val("precision")=="fp16")      dgs.set_precision(DigitScanner<float>::precision_fp16);
+    else if(p.cho_val("precision")=="bf16") dgs.set_precision(DigitScanner<float>::precision_bf16);
+    if(p.cho_val("parallel")=="sync")       dgs.set_parallelism(DigitScanner<float>::parallel_sync);
+    else if(p.cho_val("parallel")=="local") dgs.set_parallelism(DigitScanner<float>::parallel_local);
+    dgs.set_averaging(p.num_val<int>("avgperiod"), p.is_spec("avgadaptive"));
     
     /* actions */
     if(p.is_spec("train")) { dgs.train(mnist_folder, p.num_val<int>("train", 1), p.num_val<int>("train", 2), p.num_val<int>("train", 3), p.num_val<int>("train", 4), p.num_val<double>("eta"), p.num_val<double>("alpha"), p.num_val<int>("threads")); }
+    if(p.is_spec("quantize") && !dgs.quantize(mnist_folder, p.num_val<int>("quantize", 1))) return 0;
+    if(p.is_spec("qfnnin") && !dgs.load_quantized(p.str_val("qfnnin"))) return 0;
     if(p.is_spec("test"))  { dgs.test(mnist_folder, p.num_val<int>("test", 1), p.num_val<int>("test", 2), p.num_val<int>("threads")); }
 
     /* save */
     if(p.is_spec("fnnout")) { dgs.save(p.str_val("fnnout")); }
+    if(p.is_spec("qfnnout")) { dgs.save_quantized(p.str_val("qfnnout")); }
     
     /* gui */
     if(p.is_spec("gui")) {
@@ -113,9 +156,15 @@ void build_menu(Parameters* const p) {
     p->define_num_str_param<std::string>   ("fnnin", {"path"}, {""}, "Loads a neural network from a file. If not specified, you must create a new neural network with parameter $p(hlayers).");
     p->define_num_str_param<std::string>   ("fnnout", {"path"}, {""}, "Stores the neural network in a file at exit. This option is useful when training the neural network. If not specified, the neural network is lost - unless it was loaded with parameter $p(fnnin).");
     
+    p->define_num_str_param<std::string>   ("qfnnin", {"path"}, {""}, "Loads a neural network quantized to int8 from a file. It must have the layers of the neural network, which is still needed. Testing and guessing then use the quantized network.");
+    p->define_num_str_param<std::string>   ("qfnnout", {"path"}, {""}, "Stores the quantized neural network in a file at exit. It must have been created with $p(quantize) or loaded with $p(qfnnin).");
+    
     p->insert_subsection("ACTIONS");
     p->define_num_str_param<int>           ("train", {"imgnb", "imgskip", "epochs", "batch_len"}, {0, 0, 0, 0}, "Trains the neural network with the mnist training set. You can set the number of images to be used for training with $_1 (max 60000), the number of images to be skipped at the begining of the training set with $_2, the number of epochs of training with $_3, and the size of the batches with $_4.");
     p->define_num_str_param<int>           ("test", {"imgnb", "imgskip"}, {0, 0}, "Tests the neural network on the mnist testing set. You can set the number of images to be used for training with $_1 (max 10000) and the number of images to be skipped at the beggining of the training set with $_2.");
+    p->define_num_str_param<int>           ("quantize", {"imgnb"}, {0}, "Quantizes the neural network to int8, after training if any. The inputs of the layers are calibrated on the first $_1 images of the training set. Testing then reports the accuracy and the speed of the float and quantized networks side by side.");
+    p->define_param                        ("bench", "Measures the speed of the matrix products used by the neural networks with the built-in engine and with the BLAS library, if DigitScanner was built with one, then exits. No neural network is needed.");
+    p->define_num_str_param<int>           ("benchtrain", {"max_threads"}, {32}, "Trains a new neural network created with $p(hlayers), with the settings of $p(train), with a single thread, then with 2, 4, 8... up to $_1 threads with each mode of $p(parallel), then exits. The local mode is run with 1, 4, 16 and 64 batches between two averagings, then with $p(avgadaptive) starting from $p(avgperiod). The speed of every training and the accuracy of the network on the testing set are printed side by side.");
     p->define_param                        ("gui", "Creates a window that enables you to draw numbers. Use 'g' to guess a number and 'r' to reset the drawing area.");
     
     p->insert_subsection("LEARNING/TESTING PARAMETERS");
@@ -123,12 +172,30 @@ void build_menu(Parameters* const p) {
     p->define_num_str_param<double>        ("alpha", {"value"}, {0.1}, "Weight decay factor.", true);
     p->define_num_str_param<std::string>   ("mnist", {"path"}, {""}, "Path to the MNIST dataset folder.");
     p->define_num_str_param<int>           ("threads", {"nb_threads"}, {1}, "Enables multithreading for training or testing.");
+    p->define_choice_param                 ("parallel", "mode", "hogwild", {{"hogwild", "the threads train on their own batches and update the network with atomic operations, without waiting for each other"}, {"sync", "every batch is split between the threads, which update the network together once per batch"}, {"local", "the threads train their own copy of the network, and the copies are averaged every few batches"}}, "How the threads given with $p(threads) share the training. With 'sync', the training gives the same network for the same $p(seed) and number of threads.", true);
+    p->define_num_str_param<int>           ("avgperiod", {"batches"}, {8}, "Number of batches trained by every thread between two averagings of the copies of the network, with '$p(parallel) local'.", true);
+    p->define_param                        ("avgadaptive", "With '$p(parallel) local', decreases the number of batches between two averagings as the cost decreases, from $p(avgperiod) when the training starts.");
+    p->define_num_str_param<int>           ("seed", {"value"}, {0}, "Seed of the random generators initializing the weights of a new neural network and shuffling the training set. By default, the current time is used.");
+    
+    p->insert_subsection("PERFORMANCE");
+    p->define_choice_param                 ("isa", "set", "auto", {{"auto", "best instruction set supported by the cpu"}, {"avx512", "AVX-512 kernels"}, {"avx2", "AVX2 and FMA kernels"}, {"sse4", "SSE4.1 kernels"}, {"generic", "portable C++ kernels"}}, "Instruction set used by the vectorized kernels. It cannot be better than the one supported by the cpu.", true);
+    p->define_choice_param                 ("engine", "name", "auto", {{"auto", "BLAS library if built with one, built-in engine otherwise"}, {"builtin", "built-in engine"}, {"cblas", "BLAS library given to make with BLAS=..."}}, "Engine computing the matrix products, matrix-vector products and rank-1 updates.", true);
+    p->define_num_str_param<int>           ("opthreads", {"nb_threads"}, {1}, "Number of threads computing each large matrix product, from about 100000 multiply-adds. It is independent from $p(threads), which splits the dataset: the products of the training or testing threads only use these threads when no other product does.", true);
+    p->define_choice_param                 ("sigtrain", "tier", "poly", {{"exact", "C library exp, error < 1e-7"}, {"poly", "vectorized polynomial exp, error < 1e-7"}, {"rational", "Pade approximant of tanh, error < 5e-5"}, {"lut", "interpolated lookup table, error < 1e-6"}}, "Accuracy tier of the sigmoid function used for training.", true);
+    p->define_choice_param                 ("siginfer", "tier", "poly", {{"exact", "C library exp, error < 1e-7"}, {"poly", "vectorized polynomial exp, error < 1e-7"}, {"rational", "Pade approximant of tanh, error < 5e-5"}, {"lut", "interpolated lookup table, error < 1e-6"}}, "Accuracy tier of the sigmoid function used for testing and guessing.", true);
+    p->define_choice_param                 ("precision", "format", "fp32", {{"fp32", "32-bit floats"}, {"fp16", "IEEE half precision, relative error < 5e-4"}, {"bf16", "bfloat16, relative error < 4e-3"}}, "Storage of the weights used for testing and guessing. In 16 bits, the weights take half the memory and the products are still accumulated in 32 bits. Testing then also reports the accuracy of the network in 32 bits.", true);
 }
 
 const bool check_errors(Parameters* const p) {
 
     /* errors on use of parameters */
-    if(!p->is_spec("mnist") && p->is_spec("train"))
+    if(p->cho_val("engine")=="cblas" && !Blas::is_available())
+        std::cerr << "DigitScanner was built without a BLAS library. You can build it with one with \"make linux BLAS=openblas\"." << std::endl;
+    else if(p->is_spec("bench"))
+        return true;
+    else if(p->is_spec("benchtrain") && (!p->is_spec("mnist") || !p->is_spec("hlayers") || !p->is_spec("train")))
+        std::cerr << "The training benchmark needs a new neural network created with \"--hlayers\", the training settings given with \"--train\" and the location of the mnist dataset given with \"--mnist\"." << std::endl;
+    else if(!p->is_spec("mnist") && p->is_spec("train"))
         std::cerr << "You cannot train a neural network without specifying the location of the mnist dataset. You can do so with the \"--mnist\" parameter." << std::endl;
     else if(!p->is_spec("mnist") && p->is_spec("test"))
         std::cerr << "You cannot test a neural network without specifying the location of the mnist dataset. You can do so with the \"--mnist\" parameter." << std::endl;
@@ -138,12 +205,26 @@ const bool check_errors(Parameters* const p) {
         std::cerr << "You can only either load a neural network from a file or create a new one. Not both." << std::endl;
     else if(p->is_spec("test") && !p->is_spec("fnnin") && !p->is_spec("hlayers"))
         std::cerr << "You cannot test a neural network without loading an existing neural network or creating a new one." << std::endl;
+    else if(!p->is_spec("mnist") && p->is_spec("quantize"))
+        std::cerr << "You cannot quantize a neural network without specifying the location of the mnist dataset. You can do so with the \"--mnist\" parameter." << std::endl;
+    else if(p->is_spec("quantize") && p->is_spec("qfnnin"))
+        std::cerr << "You can only either quantize the neural network or load a quantized one. Not both." << std::endl;
+    else if(p->is_spec("qfnnout") && !p->is_spec("quantize") && !p->is_spec("qfnnin"))
+        std::cerr << "You need to quantize the neural network with \"--quantize\" or load a quantized one with \"--qfnnin\" to save it." << std::endl;
     else if(!p->is_spec("test") && !p->is_spec("train") && !p->is_spec("gui"))
         std::cerr << "Once you create an empty neural network or load an existing one, you need to either train it, test it, or play with it." << std::endl;
     
     /* errors on range */
     else if(p->num_val<int>("threads")<1)
         std::cerr << "You cannot have " << p->num_val<int>("threads") << " thread(s) running. Value should be greater than 1." << std::endl;
+    else if(p->is_spec("train") && p->cho_val("parallel")=="sync" && p->num_val<int>("threads")>p->num_val<int>("train", 4))
+        std::cerr << "You cannot split batches of " << p->num_val<int>("train", 4) << " images between " << p->num_val<int>("threads") << " threads. Use at most one thread per image of a batch." << std::endl;
+    else if(p->is_spec("benchtrain") && p->num_val<int>("benchtrain", 1)<1)
+        std::cerr << "The training benchmark needs at least 1 thread." << std::endl;
+    else if(p->num_val<int>("avgperiod")<1)
+        std::cerr << "The copies of the network cannot be averaged every " << p->num_val<int>("avgperiod") << " batches. Value should be at least 1." << std::endl;
+    else if(p->num_val<int>("opthreads")<1)
+        std::cerr << "You cannot have " << p->num_val<int>("opthreads") << " thread(s) per matrix product. Value should be at least 1." << std::endl;
     else if(p->num_val<int>("hlayers", 1)<0)
         std::cerr << "The first hidden layer cannot have a negative number of nodes." << std::endl;
     else if(p->num_val<int>("hlayers", 2)<0)
@@ -158,6 +239,8 @@ const bool check_errors(Parameters* const p) {
         std::cerr << "The testing set only has 10000 images." << std::endl;
     else if(p->is_spec("test") && (p->num_val<int>("test", 1)+p->num_val<int>("test", 2)>10000))
         std::cerr << "If you skip " << p->num_val<int>("test", 2) << " images, you can only test on " << (60000-p->num_val<int>("test", 2)) << " or less images." << std::endl;
+    else if(p->is_spec("quantize") && (p->num_val<int>("quantize", 1)<1 || p->num_val<int>("quantize", 1)>60000))
+        std::cerr << "The neural network must be quantized on 1 to 60000 images of the training set." << std::endl;
     else if(p->num_val<double>("eta")<=0)
         std::cerr << "The learning rate cannot be zero or negative." << std::endl;
     else if(p->num_val<double>("alpha")<0)
@@ -167,3 +250,10 @@ const bool check_errors(Parameters* const p) {
         return true;
     return false;
 }
+
+SIMD::Sigmoid sigmoid_tier(const std::string& name) {
+    if(name=="exact")         return SIMD::sigmoid_exact;
+    else if(name=="rational") return SIMD::sigmoid_rational;
+    else if(name=="lut")      return SIMD::sigmoid_lut;
+    else                      return SIMD::sigmoid_poly;
+}
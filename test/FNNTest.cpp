@@ -0,0 +1,124 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Checks of class FNN, run with 'make test'. The backpropagation of a batch
+computes the nablas of all its pictures with matrix products, in one pass:
+they must be the sums of the nablas computed one picture at a time.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "FNN.hpp"
+
+static int failures = 0;
+
+/*
+Random picture, most of whose pixels are 0 like in the mnist dataset.
+*/
+static void random_picture(std::vector<unsigned char>& picture) {
+    for(unsigned char& pixel : picture) pixel = std::rand()%4 ? 0 : static_cast<unsigned char>(1 + std::rand()%255);
+}
+
+/*
+Compares the nablas of a batch to the sums of the nablas of its pictures,
+relatively to the largest sum, and reports the check.
+*/
+static void check(const std::string& name, const std::vector<Matrix<float>>& batch, const std::vector<std::vector<double>>& sums) {
+    float error = 0;
+    for(size_t l=0 ; l<batch.size() ; l++) {
+        double largest = 0;
+        for(const double s : sums[l]) largest = std::max(largest, std::fabs(s));
+        for(int i=0 ; i<batch[l].get_I() ; i++)
+            for(int j=0 ; j<batch[l].get_J() ; j++)
+                error = std::max(error, static_cast<float>(std::fabs(batch[l](i, j) - sums[l][i*batch[l].get_J() + j])/std::max(largest, 1.0)));
+    }
+    const bool ok = error<1e-5;
+    if(!ok) failures++;
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << name << " (max relative |err| = " << error << ")" << std::endl;
+}
+
+/*
+Adds nablas to their sums, the coefficients being stored by rows.
+*/
+static void accumulate(std::vector<std::vector<double>>& sums, const std::vector<Matrix<float>>& nablas) {
+    sums.resize(nablas.size());
+    for(size_t l=0 ; l<nablas.size() ; l++) {
+        sums[l].resize(static_cast<size_t>(nablas[l].get_I())*nablas[l].get_J(), 0);
+        for(int i=0 ; i<nablas[l].get_I() ; i++)
+            for(int j=0 ; j<nablas[l].get_J() ; j++) sums[l][i*nablas[l].get_J() + j] += nablas[l](i, j);
+    }
+}
+
+/*
+Nablas of a batch of batch_len random pictures, with sparse inputs like the
+training and with dense inputs, against the sums of the nablas of the
+pictures given one at a time.
+*/
+static void batch_against_pictures(const std::vector<int>& layers, const int batch_len) {
+    FNN<float>                       fnn(layers);
+    TrainingWorkspace<float>         batch(fnn, batch_len);
+    TrainingWorkspace<float>         single(fnn, 1);
+    Matrix<float>                    dense(layers.front(), batch_len);
+    Matrix<float>                    dense_single(layers.front(), 1);
+    std::vector<unsigned char>       picture(layers.front());
+    std::vector<std::vector<double>> sums_CW, sums_CB, dense_sums_CW, dense_sums_CB;
+    for(int k=0 ; k<batch_len ; k++) {
+        random_picture(picture);
+        const int label = std::rand()%layers.back();
+        batch.get_batch_input().append_rows(picture.data(), 1, static_cast<float>(1/255.0));
+        for(int j=0 ; j<layers.back() ; j++) batch.get_batch_output()(j, k) = j==label ? 1.0f : 0.0f;
+        for(int i=0 ; i<layers.front() ; i++) dense(i, k) = picture[i]/255.0f;
+        /* nablas of the picture alone */
+        single.get_batch_input().clear();
+        single.get_batch_input().append_rows(picture.data(), 1, static_cast<float>(1/255.0));
+        for(int j=0 ; j<layers.back() ; j++) single.get_batch_output()(j, 0) = j==label ? 1.0f : 0.0f;
+        fnn.compute_nablas(single.get_batch_input(), single.get_batch_output(), single);
+        accumulate(sums_CW, single.get_nabla_CW());
+        accumulate(sums_CB, single.get_nabla_CB());
+        for(int i=0 ; i<layers.front() ; i++) dense_single(i, 0) = picture[i]/255.0f;
+        fnn.compute_nablas(dense_single, single.get_batch_output(), single);
+        accumulate(dense_sums_CW, single.get_nabla_CW());
+        accumulate(dense_sums_CB, single.get_nabla_CB());
+    }
+    const std::string size = " (" + std::to_string(batch_len) + " pictures, " + std::to_string(layers.size()-1) + " layers)";
+    fnn.compute_nablas(batch.get_batch_input(), batch.get_batch_output(), batch);
+    check("nablas of the weights of a sparse batch" + size, batch.get_nabla_CW(), sums_CW);
+    check("nablas of the biases of a sparse batch" + size, batch.get_nabla_CB(), sums_CB);
+    fnn.compute_nablas(dense, batch.get_batch_output(), batch);
+    check("nablas of the weights of a dense batch" + size, batch.get_nabla_CW(), dense_sums_CW);
+    check("nablas of the biases of a dense batch" + size, batch.get_nabla_CB(), dense_sums_CB);
+}
+
+int main() {
+    std::srand(1);
+    std::cout << "FNN:" << std::endl;
+    batch_against_pictures({784, 30, 10}, 10);
+    batch_against_pictures({784, 100, 50, 10}, 37);
+    std::cout << (failures ? "FAILED" : "passed") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+/*
+DigitScanner - Copyright (C) 2016 - Olivier Deiss - olivier.deiss@gmail.com
+
+DigitScanner is a C++ tool to create, train and test feedforward neural
+networks (fnn) for handwritten number recognition. The project uses the
+MNIST dataset to train and test the neural networks. It is also possible
+to draw numbers in a window and ask the tool to guess the number you drew.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Checks of class Matrix, run with 'make test'. The gemm engine is compared
+with naive loops on random sizes, for all the combinations of transposed
+operands and destination. The destination of a product or of an
+element-wise expression can be a view overlapping one of the operands at an
+offset: the result must be the one computed from copies of the operands.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "MatrixView.hpp"
+
+static int failures = 0;
+
+/*
+Fills a matrix with coefficients in [-1, 1].
+*/
+static void random_fill(Matrix<float>& M) {
+    for(int i=0 ; i<M.get_I() ; i++)
+        for(int j=0 ; j<M.get_J() ; j++)
+            M(i, j) = 2*static_cast<float>(std::rand())/RAND_MAX - 1;
+}
+
+/*
+Compares a result to its reference and reports the check.
+*/
+static void check(const std::string& name, const Matrix<float>& result, const Matrix<float>& reference) {
+    float error = 0;
+    for(int i=0 ; i<result.get_I() ; i++)
+        for(int j=0 ; j<result.get_J() ; j++)
+            error = std::max(error, std::fabs(result(i, j) - reference(i, j)));
+    const bool ok = error<1e-3;
+    if(!ok) failures++;
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << name << " (max |err| = " << error << ")" << std::endl;
+}
+
+/*
+C = alpha*op(A)*op(B) + beta*C with gemm against naive loops, C being M*N
+and op(A) M*K, for the 32 combinations of transA, transB, a transposed C, a
+nonzero beta and a view as the destination. The view is taken in a larger
+matrix, whose coefficients around it must not change.
+*/
+static void gemm_against_loops(const int M, const int N, const int K) {
+    const float alpha = 0.75f;
+    float       error = 0;
+    for(int c=0 ; c<32 ; c++) {
+        const bool  transA = c & 1;
+        const bool  transB = c & 2;
+        const bool  transC = c & 4;
+        const bool  view   = c & 8;
+        const float beta   = c & 16 ? 0.5f : 0.0f;
+        const int   pad    = view ? 5 : 0;   /* rows and columns of D around C */
+        Matrix<float> A(transA ? K : M, transA ? M : K);
+        Matrix<float> B(transB ? N : K, transB ? K : N);
+        Matrix<float> D(transC ? N+pad : M+pad, transC ? M+pad : N+pad);
+        if(transC) D.self_transpose();
+        random_fill(A);
+        random_fill(B);
+        random_fill(D);
+        const Matrix<float> initial(D, true);
+        const int           i0 = view ? 2 : 0;
+        const int           j0 = view ? 3 : 0;
+        if(view) {
+            MatrixView<float> C(D, i0, j0, M, N);
+            C.gemm(alpha, A, transA, B, transB, beta);
+        }
+        else {
+            D.gemm(alpha, A, transA, B, transB, beta);
+        }
+        for(int i=0 ; i<M+pad ; i++)
+            for(int j=0 ; j<N+pad ; j++)
+                if(i<i0 || i>=M+i0 || j<j0 || j>=N+j0) error = std::max(error, std::fabs(D(i, j) - initial(i, j)));
+        for(int i=0 ; i<M ; i++) {
+            for(int j=0 ; j<N ; j++) {
+                double s = 0;
+                for(int k=0 ; k<K ; k++) s += static_cast<double>(transA ? A(k, i) : A(i, k))*(transB ? B(j, k) : B(k, j));
+                const double reference = alpha*s + (beta!=0 ? beta*initial(i0+i, j0+j) : 0);
+                error = std::max(error, static_cast<float>(std::fabs(D(i0+i, j0+j) - reference)));
+            }
+        }
+    }
+    const bool ok = error<1e-3;
+    if(!ok) failures++;
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << "gemm against loops, M = " << M << ", N = " << N << ", K = " << K << " (max |err| = " << error << ")" << std::endl;
+}
+
+/*
+C = A*B with gemm, A and B being n*n and C being a view of the matrix of A
+shifted by a few rows and columns. The products larger than the blocks of
+the gemm engine write C before all of A is read.
+*/
+static void gemm_into_overlapping_view(const int n, const int shift) {
+    Matrix<float> M(2*n, 2*n);
+    Matrix<float> B(n, n);
+    random_fill(M);
+    random_fill(B);
+    MatrixView<float> A(M, 0, 0, n, n);
+    MatrixView<float> C(M, shift, shift, n, n);
+    const Matrix<float> reference(Matrix<float>(A, true)*B);
+    C.gemm(1, A, false, B, false, 0);
+    check("gemm into a view shifted by " + std::to_string(shift) + " (n = " + std::to_string(n) + ")", C, reference);
+}
+
+/*
+C = A*B and C += A*B with the expressions, C overlapping A.
+*/
+static void product_into_overlapping_view() {
+    Matrix<float> M(600, 600);
+    Matrix<float> B(300, 300);
+    random_fill(M);
+    random_fill(B);
+    MatrixView<float> A(M, 0, 0, 300, 300);
+    MatrixView<float> C(M, 8, 3, 300, 300);
+    const Matrix<float> product(Matrix<float>(A, true)*B);
+    C = A*B;
+    check("C = A*B into an overlapping view", C, product);
+    const Matrix<float> sum(Matrix<float>(C, true) + Matrix<float>(A, true)*B);
+    C += A*B;
+    check("C += A*B into an overlapping view", C, sum);
+}
+
+/*
+C = A + 2*A, C being A shifted by one column, so that every coefficient
+written is read by the next one.
+*/
+static void element_wise_into_shifted_view() {
+    Matrix<float> M(32, 33);
+    random_fill(M);
+    MatrixView<float> A(M, 0, 0, 32, 32);
+    MatrixView<float> C(M, 0, 1, 32, 32);
+    const Matrix<float> copy(A, true);
+    const Matrix<float> reference(copy + 2*copy);
+    C = A + 2*A;
+    check("C = A + 2*A into a view shifted by one column", C, reference);
+}
+
+/*
+gemm_into allocates nothing, so an overlapping destination is rejected.
+*/
+static void gemm_into_rejects_overlap() {
+    Matrix<float> M(64, 64);
+    Matrix<float> B(32, 32);
+    random_fill(M);
+    random_fill(B);
+    MatrixView<float> A(M, 0, 0, 32, 32);
+    MatrixView<float> C(M, 16, 16, 32, 32);
+    bool thrown = false;
+    try { gemm_into<float>(C, A, B); }
+    catch(const Matrix<float>::Exception&) { thrown = true; }
+    if(!thrown) failures++;
+    std::cout << (thrown ? "  ok    " : "  FAIL  ") << "gemm_into rejects an overlapping view" << std::endl;
+}
+
+int main() {
+    std::srand(1);
+    std::cout << "Matrix:" << std::endl;
+    gemm_against_loops(1, 1, 1);
+    gemm_against_loops(1, 37, 5);
+    gemm_against_loops(29, 1, 300);
+    gemm_against_loops(13, 11, 1);
+    for(int i=0 ; i<6 ; i++) gemm_against_loops(1 + std::rand()%70, 1 + std::rand()%70, 1 + std::rand()%70);
+    gemm_against_loops(1 + std::rand()%300, 1 + std::rand()%300, 257 + std::rand()%300);
+    gemm_into_overlapping_view(48, 16);
+    gemm_into_overlapping_view(400, 1);
+    gemm_into_overlapping_view(400, 200);
+    product_into_overlapping_view();
+    element_wise_into_shifted_view();
+    gemm_into_rejects_overlap();
+    std::cout << (failures ? "FAILED" : "passed") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}